@@ -0,0 +1,370 @@
+#include "batch.hpp"
+
+#include <chrono>
+#include <fstream>
+#include <iomanip>
+
+
+namespace layered_icet {
+
+namespace batch {
+
+namespace {
+
+namespace cron = std::chrono;
+
+using File = std::unique_ptr<FILE, decltype([](FILE* const file) { fclose(file); })>;
+
+/// Return the format to encode results in, if any.
+auto format_of(Options const& options) noexcept -> std::optional<output::Format> {
+	return options.format ? options.format : output::format_of(options.output);
+	}
+
+/// Writes the tile of composited images displayed by this rank to files or `stdout`, either
+/// encoded in a format or as `IceTImage`s.
+/// With several tiles, each rank writes the pixels of its tile into the same uncompressed file.
+class Writer {
+public:
+	[[nodiscard]] Writer(Context const& ctx, Options const& options, tiles::Tile const& tile)
+		: _options {options}
+		, _tile    {tile}
+		, _stdout  {options.output.empty() ? fdopen(ctx.stdout(), "wb") : nullptr}
+		{
+		if (auto const format {format_of(options)}) {
+			_encoding         = options.encoding;
+			_encoding->format = *format;
+			}}
+
+	/// Write the result of frame `number`.
+	/// With asynchronous output, the image is copied, so IceT may overwrite it once this returns.
+	auto write(IceTImage const image, long const number) -> void {
+		auto path {_options.output.empty() ? std::string{} : substitute(_options.output, number)};
+
+		if (not _options.async_output) {
+			if (_tile.count > 1) {
+				output::write_tile(path, _encoding->format, _tile, {
+						reinterpret_cast<Color const*>(icetImageGetColorcub(image)),
+						std::size_t(icetImageGetNumPixels(image))
+						});
+				return;
+				}
+
+			write_file(path, [&](FILE* const out) {
+				if (_encoding) {
+					output::write(image, *_encoding, out);
+					}
+				else {
+					write_image(image, out);
+					}});
+			return;
+			}
+
+		// Keep a single write in flight, which also keeps frames in order.
+		finish();
+
+		if (_encoding) {
+			auto const width  {icetImageGetWidth(image)};
+			auto const height {icetImageGetHeight(image)};
+			auto const colors {reinterpret_cast<Color const*>(icetImageGetColorcub(image))};
+
+			_pending = std::async(std::launch::async, [
+					this,
+					width,
+					height,
+					path   = std::move(path),
+					pixels = std::vector<Color>(colors, colors + std::size_t(width) * height)
+					]() {
+				if (_tile.count > 1) {
+					output::write_tile(path, _encoding->format, _tile, pixels);
+					return;
+					}
+
+				write_file(path, [&](FILE* const out) {
+					output::write(pixels, width, height, *_encoding, out);
+					});
+				});
+			}
+		else {
+			IceTVoid*    data {nullptr};
+			IceTSizeType size {0};
+			icetImagePackageForSend(image, &data, &size);
+
+			auto const bytes {static_cast<std::byte const*>(data)};
+
+			_pending = std::async(std::launch::async, [
+					this,
+					path    = std::move(path),
+					package = std::vector<std::byte>(bytes, bytes + size)
+					]() {
+				write_file(path, [&](FILE* const out) {
+					write_binary(std::span<std::byte const>{package}, out);
+					});
+				});
+			}}
+
+	/// Wait for the pending write, if any, and rethrow its errors.
+	auto finish() -> void {
+		if (_pending.valid()) {
+			_pending.get();
+			}
+
+		if (_stdout) {
+			fflush(_stdout);
+			}}
+
+private:
+	Options const&                 _options;
+	tiles::Tile                    _tile;
+	FILE*                          _stdout;
+	/// Options of encoding results, or none to write `IceTImage`s.
+	std::optional<output::Options> _encoding {};
+	std::future<void>              _pending  {};
+
+	/// Call `write(file)` with the file at `path`, or `stdout` if the path is empty.
+	template<typename TFn>
+	auto write_file(std::string const& path, TFn&& write) const -> void {
+		if (path.empty()) {
+			write(_stdout);
+			return;
+			}
+
+		File const file {fopen(path.c_str(), "wb")};
+
+		if (not file) {
+			throw std::runtime_error{concat("Could not open ", path)};
+			}
+
+		write(file.get());
+		}
+
+	};
+
+} // namespace
+
+
+auto parse_option(Options& options, std::string_view const option, char const* const value)
+		-> bool {
+	if ((option == "--frames" and not options.list.empty())
+			or (option == "--frame-list" and options.range)) {
+		throw std::runtime_error{"Frames must be given either by --frames or by --frame-list."};
+		}
+
+	if (option == "--frames") {
+		char*      first_end;
+		char*      last_end;
+		auto const first {std::strtol(value, &first_end, 10)};
+		auto const last  {std::strtol(first_end + (*first_end == ':'), &last_end, 10)};
+
+		if (first_end == value or *first_end != ':' or last_end == first_end + 1
+				or *last_end != '\0' or last < first
+				) {
+			throw std::runtime_error{concat(
+					"Invalid frame range `", value, "`, must be of the form <first>:<last> with "
+					"<first> <= <last>."
+					)};
+			}
+
+		options.range = {first, last};
+		}
+	else if (option == "--frame-list") {
+		options.list = value;
+		}
+	else if (option == "--output") {
+		options.output = value;
+		}
+	else if (option == "--format") {
+		options.format = output::parse_format(value);
+		}
+	else if (option == "--tiles") {
+		options.tiles = tiles::parse_grid(value);
+		}
+	else {
+		return output::parse_option(options.encoding, option, value);
+		}
+
+	return true;
+	}
+
+auto parse_flag(Options& options, std::string_view const flag) -> bool {
+	if (flag == "--async-output") {
+		options.async_output = true;
+		return true;
+		}
+
+	return false;
+	}
+
+auto substitute(std::string_view pattern, long const number) -> std::string {
+	std::string result;
+
+	for (auto pos {pattern.find("{}")}; pos != std::string_view::npos; pos = pattern.find("{}")) {
+		result += pattern.substr(0, pos);
+		result += std::to_string(number);
+		pattern.remove_prefix(pos + 2);
+		}
+
+	return result += pattern;
+	}
+
+auto frames(Options const& options, std::span<char* const> const args) -> std::vector<Frame> {
+	std::vector<Frame> result;
+
+	// Read one frame per non-empty line of a list.
+	if (not options.list.empty()) {
+		if (not args.empty()) {
+			throw std::runtime_error{"Input files must be given either in a list or as arguments."};
+			}
+
+		std::ifstream list {options.list};
+
+		if (not list) {
+			throw std::runtime_error{concat("Could not open frame list ", options.list)};
+			}
+
+		for (std::string line; std::getline(list, line);) {
+			Frame              frame {static_cast<long>(result.size())};
+			std::istringstream words {line};
+
+			for (std::string word; words >> word;) {
+				frame.args.push_back(std::move(word));
+				}
+
+			if (not frame.args.empty()) {
+				result.push_back(std::move(frame));
+				}}
+
+		return result;
+		}
+
+	// Substitute frame numbers into the arguments.
+	auto const [first, last] {options.range.value_or(std::pair{0l, 0l})};
+
+	for (auto number {first}; number <= last; ++number) {
+		Frame& frame {result.emplace_back(number)};
+
+		for (auto const arg : args) {
+			frame.args.push_back(options.range ? substitute(arg, number) : arg);
+			}}
+
+	return result;
+	}
+
+auto run(
+		Context&                                      ctx,
+		Options const&                                options,
+		std::vector<Frame> const&                     frames,
+		std::function<RawImage(Frame const&)> const& load
+		) -> void {
+	using Clock = cron::steady_clock;
+
+	if (frames.empty()) {
+		throw std::runtime_error{"No frames to composite."};
+		}
+
+	// Frames written to the same file would overwrite each other.
+	if (frames.size() > 1 and not options.output.empty()
+			and options.output.find("{}") == std::string::npos
+			) {
+		throw std::runtime_error{
+				"The output file must contain `{}` to be replaced by the frame number when "
+				"compositing multiple frames."
+				};
+		}
+
+	// Several tiles can only be written to their places in a file with a fixed layout.
+	if (options.tiles.count() > 1) {
+		auto const format {format_of(options)};
+
+		if (options.output.empty() or not format or *format == output::Format::png) {
+			throw std::runtime_error{
+					"Multiple tiles require an output file in format ppm, pam, or raw."
+					};
+			}}
+
+	std::optional<Writer> writer;
+
+	if (auto const tile {tiles::displayed()}) {
+		writer.emplace(ctx, options, *tile);
+		}
+
+	// Start all ranks together, so the throughput is not skewed by startup.
+	MPI_Barrier(MPI_COMM_WORLD);
+	auto const start_time {Clock::now()};
+
+	auto next {std::async(std::launch::async, load, std::cref(frames.front()))};
+
+	// Error of loading the current frame or writing the previous one, which all ranks must learn
+	// of before compositing, since the others would wait for a failed rank forever.
+	std::exception_ptr error;
+
+	for (std::size_t idx {0}; idx < frames.size(); ++idx) {
+		// Take this frame and start reading the next one.
+		std::optional<RawImage> in_buffer;
+
+		try {
+			in_buffer.emplace(next.get());
+			}
+		catch (...) {
+			error = std::current_exception();
+			}
+
+		int failed {error != nullptr};
+		MPI_Allreduce(MPI_IN_PLACE, &failed, 1, MPI_INT, MPI_MAX, MPI_COMM_WORLD);
+
+		if (error) {
+			std::rethrow_exception(error);
+			}
+
+		if (failed) {
+			throw std::runtime_error{concat(
+					"Another rank failed to load frame ", frames[idx].number,
+					" or write the previous one."
+					)};
+			}
+
+		if (idx + 1 < frames.size()) {
+			next = std::async(std::launch::async, load, std::cref(frames[idx + 1]));
+			}
+
+		// Composite fragments from all ranks.
+		std::array<IceTFloat, 4> const background {0, 0, 0, 0};
+		auto const out_image {icetCompositeImageLayered(
+				in_buffer->color().data(),
+				in_buffer->depth().data(),
+				in_buffer->num_layers(),
+				nullptr,
+				nullptr,
+				nullptr,
+				background.data()
+				)};
+		memory::record_icet_state_bytes();
+
+		// Output result image.
+		if (writer) {
+			try {
+				writer->write(out_image, frames[idx].number);
+				}
+			catch (...) {
+				error = std::current_exception();
+				}}}
+
+	if (error) {
+		std::rethrow_exception(error);
+		}
+
+	if (writer) {
+		writer->finish();
+		}
+
+	// Report throughput.
+	if (ctx.proc_rank() == 0 and options) {
+		cron::duration<double> const seconds {Clock::now() - start_time};
+
+		std::clog << log_sev_info << std::fixed << std::setprecision(3) << "Composited "
+		          << frames.size() << " frames in " << seconds.count() << " s ("
+		          << frames.size() / seconds.count() << " frames/s)\n";
+		}}
+
+} // namespace batch
+
+} // namespace layered_icet
@@ -0,0 +1,97 @@
+#pragma once
+
+#include <functional>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include "common.hpp"
+#include "output.hpp"
+#include "tiles.hpp"
+
+
+namespace layered_icet {
+
+/// Compositing of multiple frames within a single launch of a blending tool, which reuses its MPI
+/// and IceT context and strategy settings for all frames, and reads each frame while the previous
+/// one is composited.
+namespace batch {
+
+/// Options selecting the frames to composite and where to write them.
+struct Options {
+	/// First and last frame number to substitute for `{}` in the input arguments.
+	std::optional<std::pair<long, long>> range        {};
+	/// File listing the input arguments of one frame per line, in place of the command line.
+	std::string                          list         {};
+	/// Output file name, in which `{}` is replaced by the frame number and which must contain it
+	/// for multiple frames, or empty to write all frames to `stdout` in order.
+	std::string                          output       {};
+	/// Format to encode results in, which defaults to the one implied by the extension of the
+	/// output file, or none to write `IceTImage`s.
+	std::optional<output::Format>        format       {};
+	/// Options of encoding results, except for the format.
+	output::Options                      encoding     {};
+	/// Whether results are written on a background thread while the next frame is composited.
+	bool                                 async_output {false};
+	/// Tiles of the image, each of which is collected and written to the output file by a
+	/// different process, which requires an uncompressed format if there is more than one.
+	tiles::Grid                          tiles        {};
+
+	/// Return whether multiple frames may be composited.
+	[[nodiscard]] explicit operator bool() const noexcept {
+		return range or not list.empty();
+		}
+
+	};
+
+/// Usage of the options accepted by `parse_option` and `parse_flag`.
+constexpr std::string_view options_usage {
+		"[--frames <first>:<last> | --frame-list <file>] [--output <file>] [--async-output] "
+		"[--tiles <columns>x<rows>] [--format png|ppm|pam|raw|rgba] [--level <0-9>] "
+		"[--filter none|sub|up|average|paeth|adaptive] [--threads <#threads>]"
+		};
+
+/// Parse a command line option `--frames`, `--frame-list`, `--output` or `--tiles`, or an option of
+/// encoding accepted by `output::parse_option`, with the given value into `options`.
+/// Returns false if `option` is not one of these options.
+[[nodiscard]] auto parse_option(Options& options, std::string_view option, char const* value)
+		-> bool;
+
+/// Parse a command line flag `--async-output` into `options`.
+/// Returns false if `flag` is not this flag.
+[[nodiscard]] auto parse_flag(Options& options, std::string_view flag) -> bool;
+
+/// Return `pattern` with each occurrence of `{}` replaced by `number`.
+[[nodiscard]] auto substitute(std::string_view pattern, long number) -> std::string;
+
+/// A frame to composite.
+struct Frame {
+	long                     number {0};
+	/// Input arguments of the frame, as given on the command line when compositing a single frame.
+	std::vector<std::string> args   {};
+	};
+
+/// Return the frames selected by `options`, where `args` are the input arguments given on the
+/// command line.
+/// Without options, these describe a single frame numbered 0.
+[[nodiscard]] auto frames(Options const& options, std::span<char* const> args)
+		-> std::vector<Frame>;
+
+/// Composite `frames` in order with the current IceT context, where `load(frame)` returns this
+/// rank's fragments of a frame and runs on a background thread ahead of compositing.
+/// The ranks displaying tiles write the results, each its tile into the same file if there are
+/// several, and rank 0 reports the throughput in batch mode.
+/// If a rank fails to load a frame or write a result, all ranks throw before compositing the next
+/// frame.
+auto run(
+		Context&                                      ctx,
+		Options const&                                options,
+		std::vector<Frame> const&                     frames,
+		std::function<RawImage(Frame const&)> const& load
+		) -> void;
+
+} // namespace batch
+
+} // namespace layered_icet
@@ -1,14 +1,30 @@
+#include <algorithm>
 #include <array>
+#include <bit>
 #include <chrono>
+#include <cmath>
+#include <condition_variable>
+#include <deque>
 #include <filesystem>
 #include <fstream>
+#include <functional>
+#include <iomanip>
 #include <iostream>
 #include <memory>
+#include <mutex>
 #include <numeric>
+#include <optional>
+#include <thread>
 #include <utility>
 #include <vector>
 
 #include "common.hpp"
+#include "output.hpp"
+#include "strategy.hpp"
+#include "synthetic.hpp"
+#include "tiles.hpp"
+
+#include <IceTDevState.h>
 
 
 namespace {
@@ -25,28 +41,180 @@ namespace layered_icet {
 
 using ByteBuffer = std::unique_ptr<std::byte[]>;
 
+/// Split a comma-separated list, skipping empty elements.
+auto split_list(std::string_view list) -> std::vector<std::string_view> {
+	std::vector<std::string_view> elements;
+
+	while (not list.empty()) {
+		auto const end {std::min(list.find(','), list.size())};
+
+		if (end > 0) {
+			elements.push_back(list.substr(0, end));
+			}
+
+		list.remove_prefix(std::min(end + 1, list.size()));
+		}
+
+	return elements;
+	}
+
 enum class ImageType : uint8_t {
 	flat,
 	layered,
 	};
 
+/// How the data composited by groups of processes relates to their size in scaling studies.
+enum class Scaling : uint8_t {
+	/// Composite once with all processes.
+	none,
+	/// Every group composites the data of all processes, merged into one frame per member.
+	strong,
+	/// Every member of a group composites the data of one process, so data grows with the group.
+	weak,
+	};
+
 struct Args {
-	std::string_view in_dir     {};
-	std::string_view dataset    {};
-	std::string_view renderer   {};
-	IceTSizeType     width      {};
-	IceTSizeType     height     {};
-	int              num_reps   {};
-	IceTLayerCount   num_layers {};
-	ImageType        image_type {};
+	std::string_view in_dir         {};
+	std::string_view dataset        {};
+	std::string_view renderer       {};
+	IceTSizeType     width          {};
+	IceTSizeType     height         {};
+	int              num_reps       {};
+	/// Number of repetitions run before `num_reps`, whose timings are discarded.
+	int              num_warmup     {0};
+	IceTLayerCount   num_layers     {};
+	ImageType        image_type     {};
+	/// Number of frames loaded ahead of the one being composited.
+	unsigned         prefetch_depth {2};
+	/// Whether all frames are loaded before compositing starts.
+	bool             resident       {false};
+	/// Whether ranks synchronize before each frame, so differences in arrival are not timed as
+	/// compositing.
+	bool             barrier        {false};
+	/// Strategies to sweep, each of the form `<strategy>[/<single-image-strategy>]`.
+	std::vector<std::string_view> strategies              {"sequential/radixk"};
+	/// Single image strategies to sweep with each strategy which uses one and is given without it.
+	std::vector<std::string_view> single_image_strategies {};
+	/// Values of `ICET_MAGIC_K` to sweep, or none to use IceT's default.
+	std::vector<IceTInt>          magic_ks                {};
+	/// Number of frames to generate instead of loading captured ones, or 0 to load captures.
+	unsigned                      num_synthetic           {0};
+	/// Parameters of generated frames, whose size is that given for the benchmark.
+	synthetic::Params             synthetic_params        {};
+	/// Whether to composite within groups of 1, 2, 4, and so on up to all processes.
+	Scaling                       scaling                 {Scaling::none};
+	/// Tiles of the image, each collected by a different process, in groups of at least as many
+	/// processes as tiles.
+	tiles::Grid                   tiles                   {};
 
 	Args(int argc, char const* argv[], bool print_errors) {
 		auto print_usage = [&]() {
 			std::clog << "Usage: " << (argc >= 1 ? argv[0] : "icet-benchmark")
-			          << " <#repetitions> <input dir> <dataset> <renderer> <width> <height> "
-			             "[<#layers>]\n";
+			          << " [--warmup <#repetitions>] [--prefetch <#frames>] [--resident] "
+			             "[--barrier] [--strategies <strategy>[/<single-image-strategy>],...] "
+			             "[--single-image-strategies <single-image-strategy>,...] "
+			             "[--magic-k <k>,...] [--synthetic <#frames> " << synthetic::options_usage
+			          << "] [--scaling strong|weak] [--tiles <columns>x<rows>] <#repetitions> "
+			             "<input dir> <dataset> <renderer> <width> <height> [<#layers>]\n"
+			             "All combinations of strategies, single image strategies, and values of k "
+			             "are run, where --single-image-strategies applies to strategies given "
+			             "without one.\n"
+			             "With --synthetic, the input directory is ignored.\n"
+			             "With --tiles, groups of fewer processes than tiles use a single tile.\n"
+			             "With --scaling, frames are composited within groups of 1, 2, 4, ... "
+			             "processes, either dividing the data of all processes among the group "
+			             "(strong) or using that of its members only (weak). Strong scaling "
+			             "requires a power of two number of processes.\n";
 			};
 
+		// Parse options, then drop them from the arguments.
+		for (;;) {
+			if (argc >= 3 and argv[1] == "--warmup"sv) {
+				num_warmup  = std::max(0, atoi(argv[2]));
+				argv[2]     = argv[0];
+				argv       += 2;
+				argc       -= 2;
+				}
+			else if (argc >= 3 and argv[1] == "--prefetch"sv) {
+				prefetch_depth = std::max(1, atoi(argv[2]));
+				argv[2]        = argv[0];
+				argv          += 2;
+				argc          -= 2;
+				}
+			else if (argc >= 2 and argv[1] == "--resident"sv) {
+				resident  = true;
+				argv[1]   = argv[0];
+				argv     += 1;
+				argc     -= 1;
+				}
+			else if (argc >= 2 and argv[1] == "--barrier"sv) {
+				barrier  = true;
+				argv[1]  = argv[0];
+				argv    += 1;
+				argc    -= 1;
+				}
+			else if (argc >= 3 and argv[1] == "--strategies"sv) {
+				strategies  = split_list(argv[2]);
+				argv[2]     = argv[0];
+				argv       += 2;
+				argc       -= 2;
+				}
+			else if (argc >= 3 and argv[1] == "--single-image-strategies"sv) {
+				single_image_strategies  = split_list(argv[2]);
+				argv[2]                  = argv[0];
+				argv                    += 2;
+				argc                    -= 2;
+				}
+			else if (argc >= 3 and argv[1] == "--magic-k"sv) {
+				magic_ks.clear();
+
+				for (auto const k : split_list(argv[2])) {
+					magic_ks.push_back(std::max(2, atoi(std::string{k}.c_str())));
+					}
+
+				argv[2]  = argv[0];
+				argv    += 2;
+				argc    -= 2;
+				}
+			else if (argc >= 3 and argv[1] == "--synthetic"sv) {
+				num_synthetic  = std::max(1, atoi(argv[2]));
+				argv[2]        = argv[0];
+				argv          += 2;
+				argc          -= 2;
+				}
+			else if (argc >= 3 and argv[1] == "--scaling"sv) {
+				if (argv[2] == "strong"sv) {
+					scaling = Scaling::strong;
+					}
+				else if (argv[2] == "weak"sv) {
+					scaling = Scaling::weak;
+					}
+				else {
+					if (not print_errors) return;
+					std::clog << log_sev_error << "Unknown scaling mode '" << argv[2]
+					          << "'. Must be either 'strong' or 'weak'.\n";
+					return;
+					}
+
+				argv[2]  = argv[0];
+				argv    += 2;
+				argc    -= 2;
+				}
+			else if (argc >= 3 and argv[1] == "--tiles"sv) {
+				tiles    = tiles::parse_grid(argv[2]);
+				argv[2]  = argv[0];
+				argv    += 2;
+				argc    -= 2;
+				}
+			else if (argc >= 3 and synthetic::parse_option(synthetic_params, argv[1], argv[2])) {
+				argv[2]  = argv[0];
+				argv    += 2;
+				argc    -= 2;
+				}
+			else {
+				break;
+				}}
+
 		if (argc < 7) {
 			if (not print_errors) return;
 			std::clog << log_sev_error << "Too few arguments.\n";
@@ -88,10 +256,14 @@ struct Args {
 		dataset  = argv[3];
 		width    = atoi(argv[5]);
 		height   = atoi(argv[6]);
+
+		synthetic_params.width      = width;
+		synthetic_params.height     = height;
+		synthetic_params.max_layers = num_layers;
 		}
 
 	constexpr auto is_valid() const noexcept -> bool {
-		return not in_dir.empty();
+		return not in_dir.empty() and not strategies.empty();
 		}
 
 	constexpr auto num_fragments() const noexcept -> IceTSizeType {
@@ -107,7 +279,258 @@ auto read_binary(std::ifstream& file, std::size_t size) -> ByteBuffer {
 	return buffer;
 	}
 
-using Duration = cron::milliseconds;
+/// Return the number of bytes of fragment data of a frame.
+auto frame_bytes(RawImage const& frame) noexcept -> std::size_t {
+	return frame.color().size_bytes() + frame.depth().size_bytes();
+	}
+
+/// Loads frames in order on a background thread, at most a fixed number of frames ahead of the one
+/// being composited, so memory use does not depend on the number of frames.
+class FramePrefetcher {
+public:
+	/// Start loading the frames returned by `load(0)` up to `load(count - 1)`, keeping at most
+	/// `depth` loaded frames which have not been taken yet.
+	FramePrefetcher(
+			std::size_t                          count,
+			std::size_t                          depth,
+			std::function<RawImage(std::size_t)> load
+			)
+		: _depth  {depth}
+		, _thread {[this, count, load = std::move(load)](std::stop_token const stop) {
+			for (std::size_t idx {0}; idx < count; ++idx) {
+				// Wait until a loaded frame has been taken.
+				{
+					std::unique_lock lock {_mutex};
+
+					if (not _cond.wait(lock, stop, [&]() { return _ready.size() < _depth; })) {
+						return;
+						}}
+
+				try {
+					auto frame {load(idx)};
+
+					std::lock_guard const lock {_mutex};
+					_ready_bytes += frame_bytes(frame);
+					_ready.push_back(std::move(frame));
+					}
+				catch (...) {
+					std::lock_guard const lock {_mutex};
+					_error = std::current_exception();
+					}
+
+				_cond.notify_all();
+
+				if (_error) {
+					return;
+					}}}}
+		{}
+
+	/// Wait for the next frame and take it, which lets the next one be loaded.
+	/// Rethrows errors encountered while loading.
+	auto next() -> RawImage {
+		std::unique_lock lock {_mutex};
+		_cond.wait(lock, [&]() { return not _ready.empty() or _error; });
+
+		if (_ready.empty()) {
+			std::rethrow_exception(_error);
+			}
+
+		auto frame {std::move(_ready.front())};
+		_ready.pop_front();
+		_ready_bytes -= frame_bytes(frame);
+		lock.unlock();
+
+		_cond.notify_all();
+		return frame;
+		}
+
+	/// Return the number of bytes of fragment data of frames loaded, but not taken yet.
+	auto ready_bytes() -> std::size_t {
+		std::lock_guard const lock {_mutex};
+		return _ready_bytes;
+		}
+
+private:
+	std::size_t                 _depth       {1};
+	std::mutex                  _mutex       {};
+	std::condition_variable_any _cond        {};
+	std::deque<RawImage>        _ready       {};
+	std::size_t                 _ready_bytes {0};
+	std::exception_ptr          _error       {};
+	/// Declared last, so the thread stops before the state it uses is destroyed.
+	std::jthread                _thread      {};
+
+	};
+
+/// Read every page of a frame, so memory-mapped frames are read from disk by the loading thread
+/// rather than while compositing.
+auto touch(RawImage const& frame) -> void {
+	auto const page_size {static_cast<std::size_t>(sysconf(_SC_PAGESIZE))};
+
+	auto touch_bytes = [&](std::span<std::byte const> const bytes) {
+		for (std::size_t idx {0}; idx < bytes.size(); idx += page_size) {
+			[[maybe_unused]] volatile auto const byte {bytes[idx]};
+			}};
+
+	touch_bytes(std::as_bytes(frame.color()));
+	touch_bytes(std::as_bytes(frame.depth()));
+	}
+
+/// Summary statistics of a set of timings.
+struct Summary {
+	double min    {0};
+	double median {0};
+	double mean   {0};
+	double p95    {0};
+	double p99    {0};
+	double stddev {0};
+
+	/// Summarize a non-empty set of samples.
+	[[nodiscard]] static auto of(std::vector<double> samples) -> Summary {
+		std::sort(samples.begin(), samples.end());
+
+		// Interpolate linearly between the closest ranks.
+		auto percentile = [&](double const p) {
+			auto const rank  {p / 100.0 * (samples.size() - 1)};
+			auto const lower {static_cast<std::size_t>(rank)};
+			auto const upper {std::min(lower + 1, samples.size() - 1)};
+			return samples[lower] + (rank - lower) * (samples[upper] - samples[lower]);
+			};
+
+		Summary summary;
+		summary.min    = samples.front();
+		summary.median = percentile(50);
+		summary.mean   = std::accumulate(samples.begin(), samples.end(), 0.0) / samples.size();
+		summary.p95    = percentile(95);
+		summary.p99    = percentile(99);
+
+		for (auto const sample : samples) {
+			summary.stddev += (sample - summary.mean) * (sample - summary.mean);
+			}
+
+		summary.stddev = std::sqrt(summary.stddev / samples.size());
+		return summary;
+		}
+
+	/// Write the statistics as the members of a JSON object.
+	auto write_json(std::ostream& out) const -> void {
+		out << "\"min\": "      << min
+		    << ", \"median\": " << median
+		    << ", \"mean\": "   << mean
+		    << ", \"p95\": "    << p95
+		    << ", \"p99\": "    << p99
+		    << ", \"stddev\": " << stddev;
+		}
+
+	/// Write the statistics as a row of a table, following a label.
+	auto write_row(std::ostream& out, std::string_view const label) const -> void {
+		out << std::setw(8) << label;
+
+		for (auto const value : {min, median, mean, p95, p99, stddev}) {
+			out << std::setw(11) << value;
+			}
+
+		out << '\n';
+		}
+
+	};
+
+/// Time one rank spent on one frame, in milliseconds.
+struct FrameTiming {
+	/// Time spent waiting for other ranks to arrive at the barrier before the frame, if any.
+	double wait      {0};
+	/// Time spent compositing, excluding collection.
+	double composite {0};
+	/// Time spent collecting the composited image.
+	double collect   {0};
+
+	[[nodiscard]] constexpr auto busy() const noexcept -> double {
+		return composite + collect;
+		}
+
+	};
+
+static_assert(sizeof(FrameTiming) == 3 * sizeof(double));
+
+/// Distribution of the compositing work of a frame across ranks.
+struct Balance {
+	/// Rank which took longest to composite and collect, thereby determining the frame time.
+	int         critical_rank {0};
+	/// Longest compositing time divided by the mean across ranks.
+	double      imbalance     {1};
+	/// Mean timing of the critical rank, except for `wait`, which is the longest wait of any rank.
+	FrameTiming timing        {};
+
+	/// Determine the balance from timings indexed by rank, then sample, considering only samples
+	/// `first`, `first + stride`, and so on, up to `last`.
+	[[nodiscard]] static auto of(
+			std::span<FrameTiming const> const timings,
+			std::size_t const                  num_ranks,
+			std::size_t const                  first,
+			std::size_t const                  last,
+			std::size_t const                  stride
+			) -> Balance {
+		auto const num_samples {timings.size() / num_ranks};
+		assert(last <= num_samples);
+
+		// Average each rank's timings over the considered samples.
+		std::vector<FrameTiming> means (num_ranks);
+
+		for (std::size_t rank {0}; rank < num_ranks; ++rank) {
+			std::size_t count {0};
+
+			for (auto sample {first}; sample < last; sample += stride, ++count) {
+				auto const& timing {timings[rank * num_samples + sample]};
+				means[rank].wait      += timing.wait;
+				means[rank].composite += timing.composite;
+				means[rank].collect   += timing.collect;
+				}
+
+			means[rank].wait      /= std::max<std::size_t>(count, 1);
+			means[rank].composite /= std::max<std::size_t>(count, 1);
+			means[rank].collect   /= std::max<std::size_t>(count, 1);
+			}
+
+		auto const by_busy  = [](auto const& a, auto const& b) { return a.busy() < b.busy(); };
+		auto const by_wait  = [](auto const& a, auto const& b) { return a.wait < b.wait; };
+		auto const add_busy = [](double const sum, auto const& rhs) { return sum + rhs.busy(); };
+
+		auto const critical  {std::max_element(means.begin(), means.end(), by_busy)};
+		auto const total     {std::accumulate(means.begin(), means.end(), 0.0, add_busy)};
+		auto const mean_busy {total / num_ranks};
+
+		Balance balance;
+		balance.critical_rank = static_cast<int>(critical - means.begin());
+		balance.imbalance     = mean_busy > 0 ? critical->busy() / mean_busy : 1;
+		balance.timing        = *critical;
+		balance.timing.wait   = std::max_element(means.begin(), means.end(), by_wait)->wait;
+		return balance;
+		}
+
+	/// Write the balance as the members of a JSON object.
+	auto write_json(std::ostream& out) const -> void {
+		out << "\"critical_rank\": " << critical_rank
+		    << ", \"imbalance\": "   << imbalance
+		    << ", \"wait\": "        << timing.wait
+		    << ", \"composite\": "   << timing.composite
+		    << ", \"collect\": "     << timing.collect;
+		}
+
+	/// Write the balance as a row of a table, following a label.
+	auto write_row(std::ostream& out, std::string_view const label) const -> void {
+		out << std::setw(8) << label << std::setw(11) << critical_rank;
+
+		for (auto const value : {imbalance, timing.wait, timing.composite, timing.collect}) {
+			out << std::setw(11) << value;
+			}
+
+		out << '\n';
+		}
+
+	};
+
+using Duration     = cron::nanoseconds;
+using Milliseconds = cron::duration<double, std::milli>;
 
 template<typename TFn>
 auto time(TFn&& fn) -> std::tuple<Duration, std::invoke_result_t<TFn>> {
@@ -137,27 +560,91 @@ auto main(int argc, char const* argv[]) -> int {
 		return EXIT_FAILURE;
 		}
 
-	// Configure IceT.
-	icetStrategy(ICET_STRATEGY_SEQUENTIAL);
-	icetSingleImageStrategy(ICET_SINGLE_IMAGE_STRATEGY_RADIXK);
+	// Dividing the data of all processes among fewer ones requires merging their fragments.
+	if (args.scaling == Scaling::strong and args.image_type != ImageType::layered) {
+		if (ctx.proc_rank() == 0) {
+			std::clog << log_sev_error << "Strong scaling requires layered images.\n";
+			}
 
-	icetDiagnostics(ICET_DIAG_OFF);
+		return EXIT_FAILURE;
+		}
 
-	icetAddTile(0, 0, args.width, args.height, 0);
+	// Groups of 1, 2, 4, ... processes only merge equally many shares on each member, and thus
+	// composite equally many layers, if they divide the number of processes.
+	if (args.scaling == Scaling::strong
+			and not std::has_single_bit(static_cast<unsigned>(ctx.num_procs()))
+			) {
+		if (ctx.proc_rank() == 0) {
+			std::clog << log_sev_error
+			          << "Strong scaling requires a power of two number of processes.\n";
+			}
 
-	switch (args.image_type) {
-		case ImageType::flat: {
-			std::vector<IceTInt> ranks (ctx.num_procs());
-			std::iota(ranks.begin(), ranks.end(), 0);
-			icetCompositeOrder(ranks.data());
-			icetSetDepthFormat(ICET_IMAGE_DEPTH_NONE);
-			break;
+		return EXIT_FAILURE;
+		}
+
+	// Combine each strategy given without a single image strategy, but using one, with each given
+	// single image strategy.
+	std::vector<std::string> strategy_names;
+
+	for (auto const name : args.strategies) {
+		auto const strategy {StrategyLut::find(name.data(), name.size())};
+
+		if (args.single_image_strategies.empty()
+				or not strategy
+				or not strategy->uses_single_image_strategy
+				) {
+			strategy_names.emplace_back(name);
+			continue;
 			}
-		case ImageType::layered:
-			icetSetDepthFormat(ICET_IMAGE_DEPTH_FLOAT);
-			break;
+
+		for (auto const si_name : args.single_image_strategies) {
+			strategy_names.push_back(concat(name, "/", si_name));
+			}}
+
+	// Parse the configurations to sweep, which are all combinations of the strategies and values of
+	// k.
+	struct Config {
+		Strategy               strategy {};
+		std::optional<IceTInt> magic_k  {};
+		};
+
+	std::vector<Config> configs;
+
+	for (auto const& name : strategy_names) {
+		auto const strategy {parse_strategy(name)};
+
+		if (args.magic_ks.empty()) {
+			configs.push_back({strategy});
 			}
 
+		for (auto const k : args.magic_ks) {
+			configs.push_back({strategy, k});
+			}}
+
+	// Configure the current IceT context for a group of processes.
+	auto configure_group = [&](int const num_procs) {
+		icetDiagnostics(ICET_DIAG_OFF);
+
+		tiles::add(
+				args.tiles.count() <= num_procs ? args.tiles : tiles::Grid{},
+				args.width,
+				args.height,
+				num_procs
+				);
+
+		switch (args.image_type) {
+			case ImageType::flat: {
+				std::vector<IceTInt> ranks (num_procs);
+				std::iota(ranks.begin(), ranks.end(), 0);
+				icetCompositeOrder(ranks.data());
+				icetSetDepthFormat(ICET_IMAGE_DEPTH_NONE);
+				break;
+				}
+			case ImageType::layered:
+				icetSetDepthFormat(ICET_IMAGE_DEPTH_FLOAT);
+				break;
+				}};
+
 	// Construct path used for both input and output.
 	auto subdirs {fs::path{args.dataset} / args.renderer / std::to_string(ctx.num_procs())};
 
@@ -167,8 +654,8 @@ auto main(int argc, char const* argv[]) -> int {
 
 	auto in_path {fs::path(args.in_dir) / subdirs / ""};
 
-	// Ensure input directory exists.
-	if (not fs::is_directory(in_path)) {
+	// Ensure input directory exists, unless frames are generated.
+	if (args.num_synthetic == 0 and not fs::is_directory(in_path)) {
 		if (ctx.proc_rank() == 0) {
 			std::clog << log_sev_error << "Missing directory " << in_path << ".\n";
 			}
@@ -176,146 +663,519 @@ auto main(int argc, char const* argv[]) -> int {
 		return EXIT_FAILURE;
 		}
 
-	// Load input data.
-	if (ctx.proc_rank() == 0) {
-		std::clog << "Loading frame data...\n";
-		}
+	// Return the path of a file of the share of a frame rendered by process `share`, where
+	// `extension` selects a self-describing frame file or a color or depth file.
+	auto frame_path = [&](unsigned const fnum, int const share, std::string_view const extension) {
+		auto path {in_path};
+		path.replace_filename(concat(fnum, "-", share, ".frame"));
+		path.replace_extension(extension);
+		return path;
+		};
 
-	std::vector<RawImage> frames;
-	std::ifstream         in_file;
-	auto const            com_rank_str {std::to_string(ctx.proc_rank())};
-	auto const            color_suffix {"-"s + com_rank_str + ".color"};
+	// Load the share of a frame rendered by process `share`, preferring self-describing frame
+	// files, which contain both color and depth data, or generate it.
+	auto load_share = [&](unsigned const fnum, int const share) {
+		// Generate frames on a single thread while streaming them, to avoid competing with
+		// compositing.
+		if (args.num_synthetic > 0) {
+			return synthetic::generate(
+					args.synthetic_params,
+					share,
+					ctx.num_procs(),
+					fnum,
+					args.resident ? default_num_threads() : 1
+					);
+			}
 
-	in_file.exceptions(std::ios_base::goodbit | std::ios_base::badbit);
+		using File = std::unique_ptr<FILE, decltype([](FILE* const file) { fclose(file); })>;
 
-	for (unsigned fnum = 1;; ++fnum) { // Skip the first frame, since it is empty.
-		in_path.replace_filename(std::to_string(fnum) + color_suffix);
-		FILE* const color_file {fopen(in_path.c_str(), "rb")};
+		File const frame_file {fopen(frame_path(fnum, share, ".frame").c_str(), "rb")};
+		File       color_file {};
+		File       depth_file {};
 
-		// Last frame has been reached.
-		if (not color_file) {
-			break;
+		if (not frame_file) {
+			color_file.reset(fopen(frame_path(fnum, share, ".color").c_str(), "rb"));
 			}
 
-		FILE* depth_file {nullptr};
+		if (not frame_file and not color_file) {
+			throw std::runtime_error{concat("Missing frame #", fnum)};
+			}
 
-		if (args.image_type != ImageType::flat) {
-			in_path.replace_extension(".depth");
-			depth_file = fopen(in_path.c_str(), "rb");
+		if (not frame_file and args.image_type != ImageType::flat) {
+			depth_file.reset(fopen(frame_path(fnum, share, ".depth").c_str(), "rb"));
 			}
 
-		auto const& frame {frames.emplace_back(args.width, args.height, color_file, depth_file)};
+		RawImage frame {
+				args.width,
+				args.height,
+				frame_file ? frame_file.get() : color_file.get(),
+				depth_file.get(),
+				};
 
 		if (frame.num_layers() != args.num_layers) {
-			std::clog << log_sev_error << "Frame #" << fnum << " has " << frame.num_layers()
-			                           << " layers, not " << args.num_layers << "\n";
-			return EXIT_FAILURE;
-			}}
+			throw std::runtime_error{concat(
+					"Frame #", fnum, " has ", frame.num_layers(), " layers, not ", args.num_layers
+					)};
+			}
+
+		touch(frame);
+		return frame;
+		};
+
+	// Count frames, skipping the first one, since it is empty.
+	unsigned num_frames {args.num_synthetic};
+
+	while (args.num_synthetic == 0 and (
+			fs::exists(frame_path(num_frames + 1, ctx.proc_rank(), ".frame"))
+			or fs::exists(frame_path(num_frames + 1, ctx.proc_rank(), ".color"))
+			)) {
+		++num_frames;
+		}
 
 	// When LiV is interrupted, some processes may not have stored the last frame yet.
 	// Ensure we only use frames for which all ranks have data, otherwise the program will run
 	// indefinitely.
-	unsigned num_frames {static_cast<unsigned>(frames.size())};
 	MPI_Allreduce(MPI_IN_PLACE, &num_frames, 1, MPI_UNSIGNED, MPI_MIN, MPI_COMM_WORLD);
-	frames.resize(num_frames);
 
 	if (ctx.proc_rank() == 0) {
-		std::clog << "Found " << frames.size() << " complete frames.\n";
+		std::clog << "Found " << num_frames << " complete frames.\n";
 		}
 
-	// Create output files.
-	auto out_path {fs::path{"out/bench"} / subdirs};
-	fs::create_directories(out_path);
-	out_path /= "rank-" + com_rank_str + ".csv";
-
-	std::ofstream out_file {out_path};
-	out_file << "frame,duration\n";
-
-	out_path.replace_extension(".prof.csv");
-	std::ofstream prof_file {out_path};
-	prof_file << "image_type,num_procs,num_layers,rank,frame,split_t,interlace_t,merge_t,collect_t,"
-	             "total_t,bytes_sent\n";
-
-	// Columns of the profiling file that do not change.
-	auto const prof_consts {
-		std::string{args.renderer} + ","
-		+ std::to_string(ctx.num_procs()) + ","
-		+ std::to_string(args.num_layers) + ","
-		+ com_rank_str + ","
-		};
+	// Name of the scaling mode, which tags results.
+	auto const scaling_name {
+			args.scaling == Scaling::strong ? "strong"
+			: args.scaling == Scaling::weak ? "weak"
+			: "none"
+			};
 
-	// Repeatedly composite each frame.
-	for (int rep {1}; rep <= args.num_reps; ++rep) {
-		if (ctx.proc_rank() == 0) {
-			std::clog << "Repetition " << rep << '/' << args.num_reps << "\n";
+	// Composite all frames in each configuration within a group of processes communicating over
+	// `com`, which is current in IceT, where `load(fnum)` loads this process's frames, and write
+	// the results to `out_dir`.
+	auto run = [&](
+			MPI_Comm const                           com,
+			int const                                num_procs,
+			int const                                proc_rank,
+			fs::path const&                          out_dir,
+			std::function<RawImage(unsigned)> const& load
+			) -> void {
+		// Either load all frames now, or stream them in order of compositing during each
+		// repetition.
+		std::vector<RawImage>          resident_frames;
+		std::size_t                    resident_bytes {0};
+		std::optional<FramePrefetcher> prefetcher;
+
+		if (args.resident) {
+			if (proc_rank == 0) {
+				std::clog << "Loading frame data...\n";
+				}
+
+			for (unsigned fnum {1}; fnum <= num_frames; ++fnum) {
+				resident_frames.push_back(load(fnum));
+				resident_bytes += frame_bytes(resident_frames.back());
+				}}
+		else {
+			prefetcher.emplace(
+					configs.size() * num_frames * std::max(args.num_warmup + args.num_reps, 0),
+					args.prefetch_depth,
+					[&](std::size_t const idx) { return load(idx % num_frames + 1); }
+					);
 			}
 
-		for (unsigned fnum {1}; fnum <= frames.size(); ++fnum) {
-			std::array<float, 4>            background {0, 0, 0, 0};
-			std::tuple<Duration, IceTImage> result;
-
-			switch (args.image_type) {
-				case ImageType::flat:
-					result = time([&]() {
-						return icetCompositeImage(
-							frames[fnum - 1].color().data(),
-							nullptr,
-							nullptr,
-							nullptr,
-							nullptr,
-							background.data()
-							);
-						});
-					break;
-				case ImageType::layered:
-					result = time([&]() {
-						return icetCompositeImageLayered(
-							frames[fnum - 1].color().data(),
-							frames[fnum - 1].depth().data(),
-							args.num_layers,
-							nullptr,
-							nullptr,
-							nullptr,
-							background.data()
+		// Each process collects at most one tile of the result, with rank 0 displaying the first.
+		auto const tile {tiles::displayed()};
+
+		// Create output files.
+		auto const rank_str {std::to_string(proc_rank)};
+		auto       out_path {out_dir};
+		fs::create_directories(out_path);
+		out_path /= "rank-" + rank_str + ".csv";
+
+		std::ofstream out_file {out_path};
+		out_file << "strategy,magic_k,frame,duration,wait,composite,collect\n";
+
+		out_path.replace_extension(".prof.csv");
+		std::ofstream prof_file {out_path};
+		prof_file << "strategy,magic_k,image_type,num_procs,num_layers,rank,frame,split_t,"
+		             "interlace_t,merge_t,collect_t,total_t,bytes_sent,rss,peak_rss,image_bytes,"
+		             "cache_bytes,icet_bytes\n";
+
+		// Columns of the profiling file that do not change.
+		auto const prof_consts {
+			std::string{args.renderer} + ","
+			+ std::to_string(num_procs) + ","
+			+ std::to_string(args.num_layers) + ","
+			+ rank_str + ","
+			};
+
+		// Durations and their breakdown of measured repetitions in milliseconds, by configuration,
+		// then repetition, then frame.
+		auto const num_samples {std::size_t(num_frames) * std::max(args.num_reps, 0)};
+
+		std::vector<double>      durations;
+		std::vector<FrameTiming> timings;
+		std::vector<IceTInt>     config_ks;
+		durations.reserve(configs.size() * num_samples);
+		timings.reserve(durations.capacity());
+
+		for (std::size_t config_idx {0}; config_idx < configs.size(); ++config_idx) {
+			auto const& config {configs[config_idx]};
+
+			config.strategy.apply();
+
+			if (config.magic_k) {
+				icetStateSetInteger(ICET_MAGIC_K, *config.magic_k);
+				}
+
+			// Tag rows with the value of k in effect, which is IceT's default if none was given.
+			IceTInt magic_k;
+			icetGetIntegerv(ICET_MAGIC_K, &magic_k);
+			config_ks.push_back(magic_k);
+
+			auto const config_consts {concat(config.strategy.name, ",", magic_k, ",")};
+
+			if (proc_rank == 0 and configs.size() > 1) {
+				std::clog << "Configuration " << (config_idx + 1) << '/' << configs.size() << ": "
+				          << config.strategy.name << ", k = " << magic_k << "\n";
+				}
+
+			// Repeatedly composite each frame, starting with warm-up repetitions, which are
+			// numbered from `1 - num_warmup` to 0.
+			for (int rep {1 - args.num_warmup}; rep <= args.num_reps; ++rep) {
+				if (proc_rank == 0) {
+					if (rep <= 0) {
+						std::clog << "Warm-up repetition " << (rep + args.num_warmup) << '/'
+						          << args.num_warmup << "\n";
+						}
+					else {
+						std::clog << "Repetition " << rep << '/' << args.num_reps << "\n";
+						}}
+
+				for (unsigned fnum {1}; fnum <= num_frames; ++fnum) {
+					std::array<float, 4>            background {0, 0, 0, 0};
+					std::tuple<Duration, IceTImage> result;
+
+					// The previously streamed frame is released when the next one is taken.
+					RawImage const  streamed_frame {
+							args.resident ? RawImage{} : prefetcher->next()
+							};
+					RawImage const& frame          {
+							args.resident ? resident_frames[fnum - 1] : streamed_frame
+							};
+
+					// Wait for all ranks to arrive, so the time spent compositing does not include
+					// skew.
+					Duration wait {0};
+
+					if (args.barrier) {
+						std::tie(wait, std::ignore) = time([&]() {
+							return MPI_Barrier(com);
+							});
+						}
+
+					switch (args.image_type) {
+						case ImageType::flat:
+							result = time([&]() {
+								return icetCompositeImage(
+									frame.color().data(),
+									nullptr,
+									nullptr,
+									nullptr,
+									nullptr,
+									background.data()
+									);
+								});
+							break;
+						case ImageType::layered:
+							result = time([&]() {
+								return icetCompositeImageLayered(
+									frame.color().data(),
+									frame.depth().data(),
+									frame.num_layers(),
+									nullptr,
+									nullptr,
+									nullptr,
+									background.data()
+									);
+								});
+							break;
+						}
+
+					auto const [duration, result_image] = std::move(result);
+
+					if (rep <= 0) {
+						continue;
+						}
+
+					IceTDouble collect_time;
+					icetGetDoublev(ICET_COLLECT_TIME, &collect_time);
+
+					FrameTiming timing;
+					timing.wait      = Milliseconds{wait}.count();
+					timing.collect   = std::min(
+							collect_time * 1000.0, Milliseconds{duration}.count()
 							);
-						});
-					break;
+					timing.composite = Milliseconds{duration}.count() - timing.collect;
+
+					out_file << config_consts << fnum << "," << Milliseconds{duration}.count()
+					         << "," << timing.wait << "," << timing.composite << ","
+					         << timing.collect << "\n";
+					durations.push_back(Milliseconds{duration}.count());
+					timings.push_back(timing);
+
+					// Save the output image as headerless RGBA on the first repetition of the first
+					// configuration only, with each process writing its tile to its place in the
+					// file.
+					if (tile and rep == 1 and config_idx == 0) {
+						out_path.replace_filename("frame-"s + std::to_string(fnum) + ".out");
+
+						output::write_tile(out_path, output::Format::rgba, *tile, {
+								reinterpret_cast<Color const*>(icetImageGetColorcub(result_image)),
+								std::size_t(icetImageGetNumPixels(result_image))
+								});
+						}
+
+					// Save IceT's built-in metrics for profiling.
+					prof_file << config_consts << prof_consts << fnum << ",";
+
+					std::array constexpr timing_enums {
+						ICET_COMPRESS_TIME,
+						ICET_INTERLACE_TIME,
+						ICET_BLEND_TIME,
+						ICET_COLLECT_TIME,
+						ICET_TOTAL_DRAW_TIME,
+						};
+
+					for (std::size_t i {0}; i < timing_enums.size(); ++i) {
+						IceTDouble time;
+						icetGetDoublev(timing_enums[i], &time);
+						prof_file << (time * 1000.0) << ",";
+						}
+
+					IceTInt bytes_sent;
+					icetGetIntegerv(ICET_BYTES_SENT, &bytes_sent);
+					prof_file << bytes_sent << ",";
+
+					// Save memory use, where the frame cache consists of the frames held in memory
+					// for compositing, including the current one.
+					auto const cache_bytes {args.resident
+							? resident_bytes
+							: prefetcher->ready_bytes() + frame_bytes(frame)};
+
+					prof_file << memory::rss()                     << ","
+					          << memory::peak_rss()                << ","
+					          << memory::image_bytes()             << ","
+					          << cache_bytes                       << ","
+					          << memory::record_icet_state_bytes() << "\n";
+					}}}
+
+		// Gather the breakdown of all ranks' timings, by rank, then sample.
+		std::vector<FrameTiming> all_timings (
+				proc_rank == 0 ? timings.size() * num_procs : 0
+				);
+
+		MPI_Gather(
+			timings.data(),
+			timings.size() * 3,
+			MPI_DOUBLE,
+			all_timings.data(),
+			timings.size() * 3,
+			MPI_DOUBLE,
+			0,
+			com
+			);
+
+		// A frame is only composited once all ranks are done with it, so aggregate each timing by
+		// its maximum across ranks.
+		MPI_Reduce(
+			proc_rank == 0 ? MPI_IN_PLACE : durations.data(),
+			durations.data(),
+			durations.size(),
+			MPI_DOUBLE,
+			MPI_MAX,
+			0,
+			com
+			);
+
+		if (proc_rank != 0 or durations.empty()) {
+			return;
+			}
+
+		// Summarize each configuration.
+		ctx.restore_stdout();
+		std::cout << std::fixed << std::setprecision(3);
+
+		out_path.replace_filename("summary.json");
+		std::ofstream json_file {out_path};
+
+		json_file << "{\n"
+		             "\t\"renderer\": \""   << args.renderer   << "\",\n"
+		             "\t\"scaling\": \""    << scaling_name    << "\",\n"
+		             "\t\"num_procs\": "    << num_procs       << ",\n"
+		             "\t\"num_layers\": "   << args.num_layers << ",\n"
+		             "\t\"width\": "        << args.width      << ",\n"
+		             "\t\"height\": "       << args.height     << ",\n"
+		             "\t\"num_tiles\": "    << tile->count     << ",\n"
+		             "\t\"repetitions\": "  << args.num_reps   << ",\n"
+		             "\t\"warmup\": "       << args.num_warmup << ",\n"
+		             "\t\"barrier\": "      << std::boolalpha << args.barrier << ",\n"
+		             "\t\"unit\": \"ms\",\n"
+		             "\t\"configurations\": [\n";
+
+		for (std::size_t config_idx {0}; config_idx < configs.size(); ++config_idx) {
+			auto const first {config_idx * num_samples};
+			auto const last  {first + num_samples};
+
+			// Summarize each frame across repetitions, then all frames.
+			std::vector<Summary> frame_summaries;
+			std::vector<Balance> frame_balances;
+
+			for (unsigned fnum {1}; fnum <= num_frames; ++fnum) {
+				std::vector<double> samples;
+
+				for (auto idx {first + fnum - 1}; idx < last; idx += num_frames) {
+					samples.push_back(durations[idx]);
+					}
+
+				frame_summaries.push_back(Summary::of(std::move(samples)));
+				frame_balances.push_back(Balance::of(
+						all_timings, num_procs, first + fnum - 1, last, num_frames
+						));
 				}
 
-			auto const [duration, result_image] = std::move(result);
+			auto const summary {Summary::of({&durations[first], &durations[first] + num_samples})};
+			auto const balance {Balance::of(all_timings, num_procs, first, last, 1)};
 
-			out_file << fnum << "," << duration.count() << "\n";
+			// Print tables of the summaries.
+			std::cout << (config_idx > 0 ? "\n" : "")
+			          << "Strategy " << configs[config_idx].strategy.name
+			          << ", k = " << config_ks[config_idx] << "\n"
+			          << "Milliseconds per frame (maximum across " << num_procs << " ranks, "
+			          << args.num_reps << " repetitions)\n"
+			          << std::setw(8) << "frame";
 
-			// Save the output image on the first repetition only.
-			if (ctx.proc_rank() == 0 and rep == 1) {
-				out_path.replace_filename("frame-"s + std::to_string(fnum) + ".out");
-				std::ofstream{out_path, std::ios::binary}.write(
-					reinterpret_cast<char const*>(icetImageGetColorcub(result_image)),
-					icetImageGetNumPixels(result_image) * 4
-					);
+			for (auto const column : {"min", "median", "mean", "p95", "p99", "stddev"}) {
+				std::cout << std::setw(11) << column;
 				}
 
-			// Save IceT's built-in metrics for profiling.
-			prof_file << prof_consts << fnum << ",";
+			std::cout << '\n';
 
-			std::array constexpr timing_enums {
-				ICET_COMPRESS_TIME,
-				ICET_INTERLACE_TIME,
-				ICET_BLEND_TIME,
-				ICET_COLLECT_TIME,
-				ICET_TOTAL_DRAW_TIME,
-				};
+			for (unsigned fnum {1}; fnum <= num_frames; ++fnum) {
+				frame_summaries[fnum - 1].write_row(std::cout, std::to_string(fnum));
+				}
+
+			summary.write_row(std::cout, "all");
+
+			std::cout << "Milliseconds per frame on the critical path"
+			          << (args.barrier ? "" : " (arrival is only timed with --barrier)") << "\n"
+			          << std::setw(8) << "frame";
 
-			for (std::size_t i {0}; i < timing_enums.size(); ++i) {
-				IceTDouble time;
-				icetGetDoublev(timing_enums[i], &time);
-				prof_file << (time * 1000.0) << ",";
+			for (auto const column : {"rank", "imbalance", "wait", "composite", "collect"}) {
+				std::cout << std::setw(11) << column;
 				}
 
-			IceTInt bytes_sent;
-			icetGetIntegerv(ICET_BYTES_SENT, &bytes_sent);
-			prof_file << bytes_sent << "\n";
-			}}
+			std::cout << '\n';
+
+			for (unsigned fnum {1}; fnum <= num_frames; ++fnum) {
+				frame_balances[fnum - 1].write_row(std::cout, std::to_string(fnum));
+				}
+
+			balance.write_row(std::cout, "all");
+
+			// Write the summaries as JSON.
+			json_file << "\t\t{\n"
+			             "\t\t\t\"strategy\": \"" << configs[config_idx].strategy.name << "\",\n"
+			             "\t\t\t\"magic_k\": "    << config_ks[config_idx] << ",\n"
+			             "\t\t\t\"overall\": {";
+			summary.write_json(json_file);
+			json_file << ", \"balance\": {";
+			balance.write_json(json_file);
+			json_file << "}},\n\t\t\t\"frames\": [\n";
+
+			for (unsigned fnum {1}; fnum <= num_frames; ++fnum) {
+				json_file << "\t\t\t\t{\"frame\": " << fnum << ", ";
+				frame_summaries[fnum - 1].write_json(json_file);
+				json_file << ", \"balance\": {";
+				frame_balances[fnum - 1].write_json(json_file);
+				json_file << (fnum < num_frames ? "}},\n" : "}}\n");
+				}
+
+			json_file << "\t\t\t]\n\t\t}" << (config_idx + 1 < configs.size() ? ",\n" : "\n");
+			}
+
+		json_file << "\t]\n}\n";
+
+		ctx.stdout_to_stderr();
+		};
+
+	auto const out_root {fs::path{"out/bench"} / subdirs};
+
+	if (args.scaling == Scaling::none) {
+		configure_group(ctx.num_procs());
+		run(MPI_COMM_WORLD, ctx.num_procs(), ctx.proc_rank(), out_root, [&](unsigned const fnum) {
+			return load_share(fnum, ctx.proc_rank());
+			});
+
+		return EXIT_SUCCESS;
+		}
+
+	// Composite within groups of increasing size, each formed by the lowest ranks and using its own
+	// IceT context, while all other processes wait.
+	std::vector<int> group_sizes;
+
+	for (int size {1}; size < ctx.num_procs(); size *= 2) {
+		group_sizes.push_back(size);
+		}
+
+	group_sizes.push_back(ctx.num_procs());
+
+	for (auto const size : group_sizes) {
+		auto const member {ctx.proc_rank() < size};
+		auto const com    {mpi::Communicator::split(
+				MPI_COMM_WORLD, member ? 0 : MPI_UNDEFINED, ctx.proc_rank()
+				)};
+
+		if (ctx.proc_rank() == 0) {
+			std::clog << "Group of " << size << " processes\n";
+			}
+
+		if (com) {
+			Group const group {com.handle()};
+			configure_group(size);
+
+			// With strong scaling, each member merges the shares of all processes congruent to its
+			// rank, so the group composites the data of all processes.
+			auto load = [&](unsigned const fnum) {
+				if (args.scaling == Scaling::weak or size == ctx.num_procs()) {
+					return load_share(fnum, group.proc_rank());
+					}
+
+				std::vector<RawImage> shares;
+
+				for (auto share {group.proc_rank()}; share < ctx.num_procs(); share += size) {
+					shares.push_back(load_share(fnum, share));
+					}
+
+				return RawImage{
+						args.width,
+						args.height,
+						shares,
+						args.resident ? default_num_threads() : 1
+						};
+				};
+
+			run(
+				com.handle(),
+				group.num_procs(),
+				group.proc_rank(),
+				out_root / concat(scaling_name, "-", size),
+				load
+				);
+			}
+
+		MPI_Barrier(MPI_COMM_WORLD);
+		}
+
+	ctx.world().activate();
 
 	return EXIT_SUCCESS;
 	});
@@ -1,8 +1,11 @@
 #include "common.hpp"
+#include "simd.hpp"
 
 
 /// Blend a layered fragment buffer, back to front, into a regular `IceTImage`.
-/// Arguments: <width> <height>
+/// With `--packed`, the whole input is packed into lists of its active fragments, which are then
+/// blended, instead of blending the input band by band.
+/// Arguments: [--packed] [<width> <height>]
 auto main(int argc, char* argv[]) -> int {
 	using namespace layered_icet;
 	return try_main([&]() {
@@ -15,56 +18,103 @@ auto main(int argc, char* argv[]) -> int {
 		return EXIT_SUCCESS;
 		}
 
-	// Parse output size.
-	IceTSizeType width, height;
+	// Parse options, then drop them from the arguments.
+	auto packed {false};
 
-	if (argc < 3
-			or (width  = atoi(argv[1])) == 0
+	if (argc >= 2 and std::string_view{argv[1]} == "--packed") {
+		packed  = true;
+		argv[1] = argv[0];
+		argv   += 1;
+		argc   -= 1;
+		}
+
+	// Parse input size, which is only required for headerless input.
+	IceTSizeType width {0}, height {0};
+
+	if (argc == 2 or (argc >= 3 and (
+			(width  = atoi(argv[1])) == 0
 			or (height = atoi(argv[2])) == 0
-			) {
-		std::cerr << log_sev_fatal << "Invalid or missing arguments.\n"
-		             "Usage: " << argv[0] << " <width> <height>\n";
+			))) {
+		std::cerr << log_sev_fatal << "Invalid arguments.\n"
+		             "Usage: " << argv[0] << " [--packed] [<width> <height>]\n";
 		return EXIT_FAILURE;
 		}
 
-	// Read input.
-	RawImage in_buffer {width, height, freopen(nullptr, "rb", stdin)};
-
-	// Allocate result image.
-	auto const out_image {icetGetStateBufferImage(
-			ICET_RENDER_BUFFER,
-			in_buffer.width(),
-			in_buffer.height()
-			)};
-
-	// Blend fragments.
-	auto in_pixel {in_buffer.color().begin()};
-
-	// For each pixel:
-	for (auto& out_color : std::span{
-			reinterpret_cast<Color*>(icetImageGetColorVoid(out_image, nullptr)),
-			int_cast<std::size_t>(icetImageGetNumPixels(out_image))
-			}) {
-		// Initialize the output color to a black background.
-		out_color = {0, 0, 0, 0};
-
-		// Iterate fragments back to front.
-		for (IceTSizeType layer_idx {in_buffer.num_layers()}; layer_idx-- > 0;) {
-			auto const in_color     {in_pixel[layer_idx]};
-			auto const transparency {color::channel_max - in_color[color::alpha_channel]};
-
-			// Blend color using the over-operator.
-			for (std::size_t i {0}; i < in_color.size(); ++i) {
-				out_color[i] = out_color[i] * transparency / color::channel_max + in_color[i];
-				}}
-
-		// Advance input iterator.
-		in_pixel += in_buffer.num_layers();
+	// Let IceT fill in the header of an empty result image prepared for output, which determines its
+	// formats without allocating the whole image.
+	// Colored background correction is never enabled, so this does not depend on pixel values.
+	std::vector<std::byte> out_header (icetImageBufferSize(0, 0));
+	auto const             out_image  {icetImageAssignBuffer(out_header.data(), 0, 0)};
+	icetImageAdjustForOutput(out_image);
+
+	auto* const in_file  {freopen(nullptr, "rb", stdin)};
+	auto* const out_file {fdopen(ctx.stdout(), "wb")};
+
+	// Write the header, with the dimensions, followed by the maximum number of pixels and the size
+	// in bytes, filled in.
+	auto write_header = [&](IceTSizeType const out_width, IceTSizeType const out_height) {
+		std::array<IceTInt32, dense_header::num_fields> fields;
+		assert(out_header.size() >= sizeof(fields));
+		std::memcpy(fields.data(), out_header.data(), sizeof(fields));
+
+		fields[dense_header::width_index]      = out_width;
+		fields[dense_header::height_index]     = out_height;
+		fields[dense_header::max_pixels_index] = int_cast<IceTInt32>(
+				std::int64_t{out_width} * out_height
+				);
+		fields[dense_header::size_index]       = int_cast<IceTInt32>(icetImageBufferSizeType(
+				icetImageGetColorFormat(out_image),
+				icetImageGetDepthFormat(out_image),
+				out_width,
+				out_height
+				));
+
+		write_binary(std::span<IceTInt32 const>{fields}, out_file);
+		};
+
+	std::vector<Color> out_band;
+
+	if (packed) {
+		// Pack the whole input, whose depth data is only read to be packed along.
+		CsrImage const in_image {RawImage{width, height, in_file}, default_num_threads()};
+		write_header(in_image.width(), in_image.height());
+
+		// Blend the fragment lists of bands of rows, then output each band's rows.
+		auto const row_size {static_cast<std::size_t>(in_image.width())};
+		auto const num_rows {static_cast<std::size_t>(in_image.height())};
+		auto const offsets  {in_image.offsets()};
+
+		for (std::size_t first_row {0}; first_row < num_rows; first_row += default_band_height) {
+			auto const band_rows {std::min<std::size_t>(default_band_height, num_rows - first_row)};
+			out_band.resize(band_rows * row_size);
+
+			simd::blend_over(
+					offsets.subspan(first_row * row_size, out_band.size() + 1),
+					in_image.color(),
+					out_band
+					);
+
+			write_binary(std::span<Color const>{out_band}, out_file);
+			}
+
+		fflush(out_file);
+		return EXIT_SUCCESS;
+		}
+
+	// Read input in bands of rows, without depth data.
+	RawImageReader in_image {width, height, in_file, false};
+	write_header(in_image.width(), in_image.height());
+
+	// Blend fragments band by band, then output each band's rows.
+	for (auto band {in_image.next()}; not band.empty(); band = in_image.next()) {
+		out_band.resize(std::size_t(band.num_rows) * in_image.width());
+
+		simd::blend_over(band.color, in_image.num_layers(), out_band);
+
+		write_binary(std::span<Color const>{out_band}, out_file);
 		}
 
-	// Output result image.
-	icetImageAdjustForOutput(out_image);
-	write_image(out_image, fdopen(ctx.stdout(), "wb"));
+	fflush(out_file);
 	return EXIT_SUCCESS;
 	});
 	}
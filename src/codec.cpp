@@ -0,0 +1,373 @@
+#include "codec.hpp"
+
+#include <bit>
+#include <cstring>
+
+
+namespace layered_icet {
+
+namespace codec {
+
+namespace {
+
+/// Thrown for data which cannot be decoded.
+auto corrupt(char const* const reason) -> std::runtime_error {
+	return std::runtime_error{concat("Corrupt encoded frame: ", reason)};
+	}
+
+/// Append an unsigned integer to a stream, 7 bits per byte, with the high bit of each byte set
+/// unless it is the last.
+auto write_varint(std::vector<std::byte>& out, std::uint64_t value) -> void {
+	for (; value >= 0x80; value >>= 7) {
+		out.push_back(static_cast<std::byte>(value | 0x80));
+		}
+
+	out.push_back(static_cast<std::byte>(value));
+	}
+
+/// Read an integer written by `write_varint` and advance past it.
+auto read_varint(std::byte const*& pos, std::byte const* const end) -> std::uint64_t {
+	std::uint64_t value {0};
+
+	for (int shift {0}; shift < 64; shift += 7) {
+		if (pos == end) {
+			throw corrupt("truncated stream");
+			}
+
+		auto const byte {static_cast<std::uint64_t>(*pos++)};
+		value |= (byte & 0x7F) << shift;
+
+		if (byte < 0x80) {
+			return value;
+			}}
+
+	throw corrupt("integer too long");
+	}
+
+/// Return the bit pattern of a color, which is zero for inactive fragments.
+auto bits(Color const& color) noexcept -> std::uint32_t {
+	return std::bit_cast<std::uint32_t>(color);
+	}
+
+/// Return the predicted bit pattern of a depth from those preceding it in its band.
+auto predict(std::span<std::uint32_t const> depths, std::size_t const idx, std::size_t const layers)
+		noexcept -> std::uint32_t {
+	return idx >= layers ? depths[idx - layers] : 0;
+	}
+
+/// Map signed differences to unsigned integers, so small ones of either sign have few bits.
+auto zigzag(std::uint32_t const diff) noexcept -> std::uint32_t {
+	return (diff << 1) ^ static_cast<std::uint32_t>(static_cast<std::int32_t>(diff) >> 31);
+	}
+
+auto unzigzag(std::uint32_t const value) noexcept -> std::uint32_t {
+	return (value >> 1) ^ (0 - (value & 1));
+	}
+
+/// Encode the colors of a band.
+auto encode_colors(std::span<Color const> const in, std::vector<std::byte>& out) -> void {
+	for (std::size_t idx {0}; idx < in.size();) {
+		auto const zeros_begin {idx};
+
+		while (idx < in.size() and bits(in[idx]) == 0) {
+			++idx;
+			}
+
+		auto const literals_begin {idx};
+
+		while (idx < in.size() and bits(in[idx]) != 0) {
+			++idx;
+			}
+
+		write_varint(out, literals_begin - zeros_begin);
+		write_varint(out, idx - literals_begin);
+
+		auto const literals {std::as_bytes(in.subspan(literals_begin, idx - literals_begin))};
+		out.insert(out.end(), literals.begin(), literals.end());
+		}}
+
+/// Decode the colors of a band from a stream, which must be consumed entirely.
+auto decode_colors(std::span<std::byte const> const in, std::span<Color> const out) -> void {
+	auto       pos {in.data()};
+	auto const end {in.data() + in.size()};
+
+	for (std::size_t idx {0}; idx < out.size();) {
+		auto const num_zeros    {read_varint(pos, end)};
+		auto const num_literals {read_varint(pos, end)};
+
+		if ((num_zeros == 0 and num_literals == 0)
+				or num_zeros > out.size() - idx
+				or num_literals > out.size() - idx - num_zeros
+				or num_literals > std::size_t(end - pos) / sizeof(Color)
+				) {
+			throw corrupt("invalid color run");
+			}
+
+		std::fill_n(out.begin() + idx, num_zeros, Color{0, 0, 0, 0});
+		idx += num_zeros;
+
+		std::memcpy(out.data() + idx, pos, num_literals * sizeof(Color));
+		idx += num_literals;
+		pos += num_literals * sizeof(Color);
+		}
+
+	if (pos != end) {
+		throw corrupt("trailing color data");
+		}}
+
+/// Encode the depths of a band with `layers` fragments per pixel.
+auto encode_depths(
+		std::span<Depth const> const in,
+		std::size_t const            layers,
+		std::vector<std::byte>&      out
+		) -> void {
+	auto const depths {std::span{reinterpret_cast<std::uint32_t const*>(in.data()), in.size()}};
+
+	auto residual = [&](std::size_t const idx) {
+		return zigzag(depths[idx] - predict(depths, idx, layers));
+		};
+
+	for (std::size_t idx {0}; idx < depths.size();) {
+		auto const zeros_begin {idx};
+
+		while (idx < depths.size() and residual(idx) == 0) {
+			++idx;
+			}
+
+		auto const literals_begin {idx};
+
+		while (idx < depths.size() and residual(idx) != 0) {
+			++idx;
+			}
+
+		write_varint(out, literals_begin - zeros_begin);
+		write_varint(out, idx - literals_begin);
+
+		for (auto literal {literals_begin}; literal < idx; ++literal) {
+			write_varint(out, residual(literal));
+			}}}
+
+/// Decode the depths of a band with `layers` fragments per pixel from a stream, which must be
+/// consumed entirely.
+auto decode_depths(
+		std::span<std::byte const> const in,
+		std::size_t const                layers,
+		std::span<Depth> const           out
+		) -> void {
+	auto const depths {std::span{reinterpret_cast<std::uint32_t*>(out.data()), out.size()}};
+	auto       pos    {in.data()};
+	auto const end    {in.data() + in.size()};
+
+	for (std::size_t idx {0}; idx < depths.size();) {
+		auto const num_zeros    {read_varint(pos, end)};
+		auto const num_literals {read_varint(pos, end)};
+
+		if ((num_zeros == 0 and num_literals == 0)
+				or num_zeros > depths.size() - idx
+				or num_literals > depths.size() - idx - num_zeros
+				) {
+			throw corrupt("invalid depth run");
+			}
+
+		for (auto const zeros_end {idx + num_zeros}; idx < zeros_end; ++idx) {
+			depths[idx] = predict(depths, idx, layers);
+			}
+
+		for (auto const literals_end {idx + num_literals}; idx < literals_end; ++idx) {
+			auto const residual {read_varint(pos, end)};
+
+			if (residual > std::numeric_limits<std::uint32_t>::max()) {
+				throw corrupt("invalid depth residual");
+				}
+
+			depths[idx] = predict(depths, idx, layers)
+			            + unzigzag(static_cast<std::uint32_t>(residual));
+			}}
+
+	if (pos != end) {
+		throw corrupt("trailing depth data");
+		}}
+
+/// Return the range of fragments in a band of rows.
+auto band_fragments(Header const& header, std::size_t const band) noexcept
+		-> std::pair<std::size_t, std::size_t> {
+	auto const row_size  {std::size_t(header.width) * std::size_t(header.num_layers)};
+	auto const first_row {band * header.band_height};
+	auto const end_row   {std::min<std::size_t>(first_row + header.band_height, header.height)};
+
+	return {first_row * row_size, end_row * row_size};
+	}
+
+/// Return the number of bands of a frame.
+auto num_bands(Header const& header) noexcept -> std::size_t {
+	return (std::size_t(header.height) + header.band_height - 1) / header.band_height;
+	}
+
+} // namespace
+
+
+auto is_encoded(std::span<std::byte const> const data) noexcept -> bool {
+	return data.size() >= sizeof(Header::Magic)
+	   and std::memcmp(data.data(), Header::magic_value.data(), sizeof(Header::Magic)) == 0;
+	}
+
+auto probe(FILE* const in) -> bool {
+	auto const start {ftell(in)};
+
+	if (start < 0) {
+		throw std::runtime_error{"Cannot probe a file which is not seekable"};
+		}
+
+	Header::Magic magic {};
+	auto const    count {fread(magic.data(), 1, magic.size(), in)};
+	fseek(in, start, SEEK_SET);
+
+	return count == magic.size() and magic == Header::magic_value;
+	}
+
+auto encode(RawImage const& image, unsigned const num_threads, IceTSizeType const band_height)
+		-> std::vector<std::byte> {
+	Header header;
+	header.width       = image.width();
+	header.height      = image.height();
+	header.num_layers  = image.num_layers();
+	header.band_height = std::max(band_height, 1);
+
+	auto const layers {static_cast<std::size_t>(image.num_layers())};
+
+	// Encode bands in parallel into separate buffers.
+	std::vector<std::vector<std::byte>> colors (num_bands(header));
+	std::vector<std::vector<std::byte>> depths (colors.size());
+
+	parallel_for(colors.size(), 1, num_threads, [&](
+			std::size_t const band_begin,
+			std::size_t const band_end,
+			unsigned
+			) {
+		for (auto band {band_begin}; band < band_end; ++band) {
+			auto const [begin, end] {band_fragments(header, band)};
+
+			encode_colors(image.color().subspan(begin, end - begin), colors[band]);
+			encode_depths(image.depth().subspan(begin, end - begin), layers, depths[band]);
+			}});
+
+	// Index the bands, which directly follow the metadata.
+	std::vector<FrameBand> index (colors.size());
+	std::uint64_t          offset {sizeof(Header) + index.size() * sizeof(FrameBand)};
+
+	for (std::size_t band {0}; band < index.size(); ++band) {
+		index[band] = {offset, offset + colors[band].size()};
+		offset      = index[band].depth_offset + depths[band].size();
+		}
+
+	header.size = offset;
+
+	// Concatenate header, index and bands.
+	std::vector<std::byte> out;
+	out.reserve(header.size);
+
+	auto append = [&](std::span<std::byte const> const bytes) {
+		out.insert(out.end(), bytes.begin(), bytes.end());
+		};
+
+	append(std::as_bytes(std::span{&header, 1}));
+	append(std::as_bytes(std::span{index}));
+
+	for (std::size_t band {0}; band < index.size(); ++band) {
+		append(colors[band]);
+		append(depths[band]);
+		}
+
+	return out;
+	}
+
+auto decode(std::span<std::byte const> const data, unsigned const num_threads) -> RawImage {
+	// Read and validate the header.
+	Header header;
+
+	if (not is_encoded(data) or data.size() < sizeof(header)) {
+		throw corrupt("missing header");
+		}
+
+	std::memcpy(&header, data.data(), sizeof(header));
+
+	if (header.version > Header::current_version) {
+		throw std::runtime_error{concat("Unsupported encoded frame version ", header.version)};
+		}
+
+	if (header.header_size < sizeof(header) or header.size > data.size()
+			or header.width < 0 or header.height < 0 or header.num_layers < 0
+			or header.band_height <= 0
+			) {
+		throw corrupt("invalid header");
+		}
+
+	// Read the band index and verify that bands are ordered and lie within the frame.
+	std::vector<FrameBand> index (num_bands(header));
+	auto const             metadata_size {header.header_size + index.size() * sizeof(FrameBand)};
+
+	if (metadata_size > header.size) {
+		throw corrupt("truncated band index");
+		}
+
+	std::memcpy(index.data(), data.data() + header.header_size, index.size() * sizeof(FrameBand));
+
+	// Return the end of a band's depth stream.
+	auto data_end = [&](std::size_t const band) {
+		return band + 1 < index.size() ? index[band + 1].color_offset : header.size;
+		};
+
+	// Offsets must increase monotonically from the end of the metadata to the end of the frame.
+	auto previous_offset {metadata_size};
+
+	for (std::size_t band {0}; band < index.size(); ++band) {
+		if ((band == 0 and index[band].color_offset != metadata_size)
+				or index[band].color_offset < previous_offset
+				or index[band].depth_offset < index[band].color_offset
+				or data_end(band) < index[band].depth_offset
+				or data_end(band) > header.size
+				) {
+			throw corrupt("invalid band index");
+			}
+
+		previous_offset = index[band].depth_offset;
+		}
+
+	// Decode bands in parallel.
+	auto const layers        {static_cast<std::size_t>(header.num_layers)};
+	auto const num_fragments {std::size_t(header.width) * std::size_t(header.height) * layers};
+
+	std::vector<std::byte> buffer (num_fragments * (sizeof(Color) + sizeof(Depth)));
+
+	auto const color {std::span{reinterpret_cast<Color*>(buffer.data()), num_fragments}};
+	auto const depth {std::span{
+			reinterpret_cast<Depth*>(buffer.data() + num_fragments * sizeof(Color)),
+			num_fragments
+			}};
+
+	parallel_for(index.size(), 1, num_threads, [&](
+			std::size_t const band_begin,
+			std::size_t const band_end,
+			unsigned
+			) {
+		for (auto band {band_begin}; band < band_end; ++band) {
+			auto const [begin, end] {band_fragments(header, band)};
+			auto const color_data   {data.subspan(
+					index[band].color_offset,
+					index[band].depth_offset - index[band].color_offset
+					)};
+			auto const depth_data   {data.subspan(
+					index[band].depth_offset,
+					data_end(band) - index[band].depth_offset
+					)};
+
+			decode_colors(color_data, color.subspan(begin, end - begin));
+			decode_depths(depth_data, layers, depth.subspan(begin, end - begin));
+			}});
+
+	return {header.width, header.height, header.num_layers, std::move(buffer)};
+	}
+
+} // namespace codec
+
+} // namespace layered_icet
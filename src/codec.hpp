@@ -0,0 +1,66 @@
+#pragma once
+
+#include <span>
+#include <vector>
+
+#include "common.hpp"
+
+
+namespace layered_icet {
+
+/// A lossless codec for layered frames.
+/// Colors are stored as alternating runs of inactive, all-zero fragments and literal fragments.
+/// Depths are predicted from the fragment of the same layer in the previous pixel, and the
+/// differences of their bit patterns are stored as alternating runs of zeros and variable-length
+/// literals, so constant layers and smooth ramps take little space.
+namespace codec {
+
+/// Header of an encoded layered frame file.
+/// The header is followed by an index of row bands, then by the encoded bands, each of which
+/// consists of its color stream followed by its depth stream. Bands are encoded independently, so
+/// they are encoded and decoded in parallel.
+/// All offsets are in bytes relative to the start of the header.
+struct Header {
+	using Magic = FrameHeader::Magic;
+
+	static constexpr Magic         magic_value     {'L', 'I', 'C', 'E', 'T', 'E', 'N', 'C'};
+	static constexpr std::uint32_t current_version {1};
+
+	Magic         magic       {magic_value};
+	std::uint32_t version     {current_version};
+	/// Size of this header, so later versions can extend it.
+	std::uint32_t header_size {sizeof(Header)};
+	std::int32_t  width       {0};
+	std::int32_t  height      {0};
+	std::int32_t  num_layers  {0};
+	/// Number of rows per encoded band.
+	std::int32_t  band_height {0};
+	/// Size of the encoded frame, including this header.
+	std::uint64_t size        {0};
+	};
+
+static_assert(sizeof(Header) % alignof(std::uint64_t) == 0);
+
+/// Default number of rows per encoded band.
+constexpr IceTSizeType default_band_height {64};
+
+/// Return whether a buffer starts with an encoded frame.
+[[nodiscard]] auto is_encoded(std::span<std::byte const> data) noexcept -> bool;
+
+/// Return whether a seekable file continues with an encoded frame, without changing its position.
+[[nodiscard]] auto probe(FILE* in) -> bool;
+
+/// Encode an image in bands of `band_height` rows in parallel on up to `num_threads` threads.
+[[nodiscard]] auto encode(
+		RawImage const& image,
+		unsigned        num_threads = 1,
+		IceTSizeType    band_height = default_band_height
+		) -> std::vector<std::byte>;
+
+/// Decode an encoded frame in parallel on up to `num_threads` threads.
+/// Throws if the data is not a valid encoded frame.
+[[nodiscard]] auto decode(std::span<std::byte const> data, unsigned num_threads = 1) -> RawImage;
+
+} // namespace codec
+
+} // namespace layered_icet
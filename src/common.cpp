@@ -1,8 +1,19 @@
 #include "common.hpp"
+#include "codec.hpp"
+#include "layout.hpp"
+#include "simd.hpp"
 
 #include <algorithm>
+#include <iomanip>
 #include <numeric>
 
+#include <cerrno>
+#include <cstring>
+#include <sys/resource.h>
+#include <sys/stat.h>
+
+#include <IceTDevState.h>
+
 
 namespace layered_icet {
 
@@ -25,16 +36,174 @@ auto error_message(int const error_code) noexcept -> std::string {
 	return msg;
 	}
 
+auto Communicator::split(MPI_Comm const& parent, int const color, int const key) -> Communicator {
+	MPI_Comm com {MPI_COMM_NULL};
+
+	if (auto const error = MPI_Comm_split(parent, color, key, &com)) {
+		throw std::runtime_error{concat("Could not split communicator: ", error_message(error))};
+		}
+
+	return Communicator{std::move(com)};
+	}
+
 } // namespace mpi
 
 
-Context::Context(int* argc, char*** argv)
-	: _mpi {argc, argv}
-	{
-	// Redirect stdout to stderr so IceT's diagnostics do not interfere with result output.
-	stdout_to_stderr();
+namespace posix {
+
+auto MappedFile::map(FILE* const file) noexcept -> MappedFile {
+	struct stat info;
+
+	// Only regular files can be mapped.
+	if (fstat(fileno(file), &info) or not S_ISREG(info.st_mode)) {
+		return {};
+		}
+
+	// Map from the current position, which must be rounded down to a page boundary.
+	auto const position {ftell(file)};
+
+	if (position < 0 or position >= info.st_size) {
+		return {};
+		}
+
+	auto const page_size {static_cast<std::size_t>(sysconf(_SC_PAGESIZE))};
+	auto const offset    {static_cast<std::size_t>(position) % page_size};
+	auto const length    {static_cast<std::size_t>(info.st_size - position) + offset};
+	auto const base      {mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fileno(file), position - offset)};
+
+	if (base == MAP_FAILED) {
+		return {};
+		}
+
+	// The mapping is read front to back, so start reading ahead immediately.
+	madvise(base, length, MADV_SEQUENTIAL);
+	madvise(base, length, MADV_WILLNEED);
+
+	return MappedFile{{static_cast<std::byte*>(base), length, offset}};
+	}
+
+auto write_at(int const fd, std::span<std::byte const> bytes, off_t offset) -> void {
+	while (not bytes.empty()) {
+		auto const written {pwrite(fd, bytes.data(), bytes.size(), offset)};
+
+		if (written < 0) {
+			if (errno == EINTR) {
+				continue;
+				}
+
+			throw std::runtime_error{concat("Error writing to file: ", std::strerror(errno))};
+			}
+
+		bytes   = bytes.subspan(written);
+		offset += written;
+		}}
+
+} // namespace posix
+
+
+namespace memory {
+
+namespace {
+
+std::atomic<std::size_t> image_bytes_current   {0};
+std::atomic<std::size_t> image_bytes_peak      {0};
+std::atomic<std::size_t> icet_state_bytes_peak {0};
+
+/// Raise a peak to at least `value`.
+auto update_peak(std::atomic<std::size_t>& peak, std::size_t const value) noexcept -> void {
+	auto current {peak.load(std::memory_order_relaxed)};
+
+	while (current < value
+			and not peak.compare_exchange_weak(current, value, std::memory_order_relaxed)) {
+		}}
+
+/// Format a number of bytes in MiB.
+auto mib(std::size_t const bytes) -> std::string {
+	return concat(std::fixed, std::setprecision(1), bytes / double(1 << 20), " MiB");
+	}
+
+} // namespace
+
+
+auto rss() noexcept -> std::size_t {
+	auto* const statm {fopen("/proc/self/statm", "r")};
+
+	if (not statm) {
+		return 0;
+		}
+
+	unsigned long size {0}, resident {0};
+	auto const    count {fscanf(statm, "%lu %lu", &size, &resident)};
+	fclose(statm);
+
+	return count == 2 ? resident * static_cast<std::size_t>(sysconf(_SC_PAGESIZE)) : 0;
+	}
+
+auto peak_rss() noexcept -> std::size_t {
+	rusage usage {};
+	getrusage(RUSAGE_SELF, &usage);
+
+	// Linux reports kibibytes.
+	return static_cast<std::size_t>(usage.ru_maxrss) * 1024;
+	}
+
+auto image_bytes() noexcept -> std::size_t {
+	return image_bytes_current.load(std::memory_order_relaxed);
+	}
+
+auto peak_image_bytes() noexcept -> std::size_t {
+	return image_bytes_peak.load(std::memory_order_relaxed);
+	}
+
+auto icet_state_bytes() noexcept -> std::size_t {
+	std::size_t bytes {0};
+
+	// Cover the variables of all ranges, including those of strategies and internal buffers.
+	for (IceTEnum pname {0}; pname < ICET_STATE_SIZE; ++pname) {
+		if (auto const type {icetStateGetType(pname)}; type != ICET_NULL) {
+			bytes += std::size_t(icetStateGetNumEntries(pname)) * icetTypeWidth(type);
+			}}
+
+	return bytes;
+	}
+
+auto record_icet_state_bytes() noexcept -> std::size_t {
+	auto const bytes {icet_state_bytes()};
+	update_peak(icet_state_bytes_peak, bytes);
+	return bytes;
+	}
+
+auto peak_icet_state_bytes() noexcept -> std::size_t {
+	return icet_state_bytes_peak.load(std::memory_order_relaxed);
+	}
 
-	// Basic IceT configuration.
+auto print_summary(std::ostream& out) -> void {
+	out << log_sev_info << "Memory: peak RSS " << mib(peak_rss())
+	    << ", peak image buffers " << mib(peak_image_bytes());
+
+	if (auto const icet_bytes {peak_icet_state_bytes()}) {
+		out << ", peak IceT state " << mib(icet_bytes);
+		}
+
+	out << "\n";
+	}
+
+auto Tracker::set(std::size_t const bytes) noexcept -> void {
+	if (bytes >= _bytes) {
+		auto const total {image_bytes_current.fetch_add(bytes - _bytes, std::memory_order_relaxed)};
+		update_peak(image_bytes_peak, total + bytes - _bytes);
+		}
+	else {
+		image_bytes_current.fetch_sub(_bytes - bytes, std::memory_order_relaxed);
+		}
+
+	_bytes = bytes;
+	}
+
+} // namespace memory
+
+
+auto configure_icet() -> void {
 	icetDiagnostics(ICET_DIAG_FULL);
 
 	icetCompositeMode(ICET_COMPOSITE_MODE_BLEND);
@@ -43,13 +212,37 @@ Context::Context(int* argc, char*** argv)
 	icetSetDepthFormat(ICET_IMAGE_DEPTH_FLOAT);
 	}
 
+
+Group::Group(MPI_Comm const& com)
+	: _com  {com}
+	, _icet {_com}
+	{
+	configure_icet();
+	}
+
+auto Group::activate() const noexcept -> void {
+	icetSetContext(_icet.handle());
+	}
+
+
+Context::Context(int* argc, char*** argv)
+	: _mpi    {argc, argv}
+	// Redirect stdout to stderr so IceT's diagnostics do not interfere with result output.
+	, _stdout {redirect_stdout()}
+	{}
+
 auto Context::stdout_to_stderr() noexcept -> void {
 	if (_stdout == STDOUT_FILENO) {
-		fflush(::stdout);
-		_stdout = dup(STDOUT_FILENO);
-		dup2(STDERR_FILENO, STDOUT_FILENO);
+		_stdout = redirect_stdout();
 		}}
 
+auto Context::redirect_stdout() noexcept -> int {
+	fflush(::stdout);
+	auto const original {dup(STDOUT_FILENO)};
+	dup2(STDERR_FILENO, STDOUT_FILENO);
+	return original;
+	}
+
 auto Context::restore_stdout() noexcept -> void {
 	if (_stdout != STDOUT_FILENO) {
 		fsync(_stdout);
@@ -58,6 +251,11 @@ auto Context::restore_stdout() noexcept -> void {
 		}}
 
 
+auto default_num_threads() noexcept -> unsigned {
+	return std::max(1u, std::thread::hardware_concurrency());
+	}
+
+
 /// Read a given number of bytes from a binary file.
 template <typename T>
 auto read_binary(FILE* in, std::span<T> buffer) -> void {
@@ -68,13 +266,20 @@ auto read_binary(FILE* in, std::span<T> buffer) -> void {
 			throw std::runtime_error{"Could not read requested amount of data"};
 			}}}
 
-[[nodiscard]] auto read_all(FILE* in, std::size_t size_hint) -> std::vector<std::byte> {
-	std::vector<std::byte> buffer (size_hint);
-	std::size_t            size   {0};
+namespace {
+
+/// Read the remaining contents of a binary file into a buffer already holding its first bytes.
+[[nodiscard]] auto read_remaining(
+		FILE* const              in,
+		std::vector<std::byte>&& buffer,
+		std::size_t const        size_hint
+		) -> std::vector<std::byte> {
+	std::size_t size {buffer.size()};
+	buffer.resize(std::max(size_hint, size));
 
 	while (not feof(in)) {
 		if (size == buffer.size()) {
-			buffer.resize(size * 2);
+			buffer.resize(std::max<std::size_t>(size * 2, 256));
 			}
 
 		size += fread(&buffer[size], sizeof(std::byte), buffer.size() - size, in);
@@ -87,6 +292,41 @@ auto read_binary(FILE* in, std::span<T> buffer) -> void {
 	return buffer;
 	}
 
+/// Advance a binary file by a number of bytes, reading them if the file is not seekable.
+auto skip(FILE* const in, std::uint64_t const count) -> void {
+	if (count == 0 or fseek(in, count, SEEK_CUR) == 0) {
+		return;
+		}
+
+	std::vector<std::byte> discarded (count);
+	read_binary(in, std::span{discarded});
+	}
+
+/// Throw if a file's header does not match the given image size, unless the size is 0.
+auto check_size(
+		IceTSizeType const width,
+		IceTSizeType const height,
+		IceTSizeType const file_width,
+		IceTSizeType const file_height
+		) -> void {
+	if ((width != 0 and width != file_width) or (height != 0 and height != file_height)) {
+		throw std::runtime_error{concat(
+				"Expected a ", width, "x", height, " image, but the file contains a ",
+				file_width, "x", file_height, " image"
+				)};
+		}}
+
+auto check_size(IceTSizeType const width, IceTSizeType const height, FrameHeader const& header)
+		-> void {
+	check_size(width, height, header.width, header.height);
+	}
+
+} // namespace
+
+[[nodiscard]] auto read_all(FILE* in, std::size_t size_hint) -> std::vector<std::byte> {
+	return read_remaining(in, {}, size_hint);
+	}
+
 namespace {
 
 // Helper for implementation of `write_image`.
@@ -111,166 +351,2025 @@ auto write_image(IceTSparseImage const image, FILE* const out) -> void {
 	}
 
 
-RawImage::RawImage(
-		IceTSizeType const          width,
-		IceTSizeType const          height,
-		std::span<InputLayer const> layers
-		)
-	: _width        {width}
-	, _height       {height}
-	, _num_layers   {int_cast<IceTSizeType>(layers.size())}
-	, _buffer       {num_fragments() * (sizeof(Color) + sizeof(Depth)), std::byte{0}}
-	, _depth_buffer {reinterpret_cast<Depth*>(_buffer.data() + num_fragments() * sizeof(Color))}
-	{
-	// Store the number of fragments at each pixel of the output image.
-	auto layers_at {std::vector<IceTLayerCount>(num_pixels(), 0)};
-
-	// For each input image:
-	for (auto const& layer : layers) {
-		Png const  png        {layer.path};
-		auto const png_width  {int_cast<IceTSizeType>(png.get_width())};
-		auto const png_height {int_cast<IceTSizeType>(png.get_height())};
-
-		// For each row of the input image:
-		for (IceTSizeType y {0}; y < std::min(height, png_height); ++y) {
-			IceTSizeType x {0};
-
-			// Copy pixels from the input image.
-			for (; x < std::min(width, png_width); ++x) {
-				// Skip empty pixels.
-				auto const& color {reinterpret_cast<Color const&>(png[y][x])};
-				auto const  alpha {color[color::alpha_channel]};
-
-				if (alpha == 0) {
-					continue;
-					}
+auto FrameInfo::describe(
+		IceTSizeType const width,
+		IceTSizeType const height,
+		IceTSizeType const num_layers,
+		IceTSizeType const band_height
+		) -> FrameInfo {
+	FrameInfo info;
+	info.header.width       = width;
+	info.header.height      = height;
+	info.header.num_layers  = num_layers;
+	info.header.band_height = band_height;
 
-				// Copy color, scaled by alpha,
-				auto const pixel_idx {y * width + x};
-				auto const out_idx   {pixel_idx * _num_layers + layers_at[pixel_idx]};
+	if (band_height > 0) {
+		info.bands.resize((height + band_height - 1) / band_height);
+		}
 
-				for (std::size_t i {0}; i < color.size(); ++i) {
-					color_buffer(out_idx)[i] = color[i] * alpha / color::channel_max;
-					}
+	// Sections directly follow the metadata.
+	info.header.color_offset = info.metadata_size();
+	info.header.depth_offset = info.header.color_offset + info.num_fragments() * sizeof(Color);
 
-				color_buffer(out_idx)[color::alpha_channel] = alpha;
+	// Index row bands.
+	for (std::size_t band {0}; band < info.bands.size(); ++band) {
+		info.bands[band] = {
+				info.header.color_offset + band * band_height * width * num_layers * sizeof(Color),
+				info.header.depth_offset + band * band_height * width * num_layers * sizeof(Depth),
+				};
+		}
 
-				// Set depth.
-				_depth_buffer[out_idx] = layer.depth;
+	return info;
+	}
 
-				// Count active fragments.
-				++layers_at[pixel_idx];
-				}}}}
+auto FrameInfo::read(FILE* const in, std::vector<std::byte>& consumed) -> std::optional<FrameInfo> {
+	auto const  start  {ftell(in)};
+	FrameInfo   info   {};
+	auto&       header {info.header};
+	auto const  count  {fread(&header, 1, sizeof(header), in)};
 
-RawImage::RawImage(
-		IceTSizeType const        width,
-		IceTSizeType const        height,
-		std::span<RawImage const> sources
-		)
-	: _width        {width}
-	, _height       {height}
-	, _num_layers   {std::accumulate(
-		sources.begin(),
-		sources.end(),
-		0,
-		[](auto const accum, RawImage const& img) {
-			return accum + img.num_layers();
+	if (ferror(in)) {
+		throw std::runtime_error("Error reading file");
+		}
+
+	// Give back what has been read if the file has no header.
+	if (count < sizeof(header.magic) or header.magic != FrameHeader::magic_value) {
+		if (start >= 0) {
+			fseek(in, start, SEEK_SET);
 			}
-		)}
-	, _buffer       {num_fragments() * (sizeof(Color) + sizeof(Depth)), std::byte{0}}
-	, _depth_buffer {reinterpret_cast<Depth*>(_buffer.data() + num_fragments() * sizeof(Color))}
-	{
-	// Stores all fragments at the current pixel.
-	std::vector<Fragment> frags;
-	frags.reserve(_num_layers);
+		else {
+			auto const bytes {std::as_bytes(std::span{&header, 1}).first(count)};
+			consumed.assign(bytes.begin(), bytes.end());
+			}
+
+		return std::nullopt;
+		}
 
-	// For each pixel:
-	for (IceTSizeType y {0}; y < height; ++y) {
-		for (IceTSizeType x {0}; x < width; ++x) {
-			frags.clear();
+	// Validate the header.
+	if (count < sizeof(header)) {
+		throw std::runtime_error{"Truncated frame header"};
+		}
 
-			// Gather the fragments from all input images.
-			for (auto const& img : sources) {
-				if (x < img.width() and y < img.height()) {
-					for (auto layer {0}; layer < img.num_layers(); ++layer) {
-						auto const idx {(y * img.width() + x) * img.num_layers() + layer};
+	if (header.version > FrameHeader::current_version) {
+		throw std::runtime_error{concat("Unsupported frame file version ", header.version)};
+		}
 
-						// Active fragments must come before inactive ones.
-						if (img.color()[idx][color::alpha_channel] == 0) {
-							break;
-							}
+	if (header.header_size < sizeof(header)) {
+		throw std::runtime_error{"Invalid frame header size"};
+		}
 
-						frags.push_back({img.color()[idx], img.depth()[idx]});
-						}}}
+	if (header.color_format != ICET_IMAGE_COLOR_RGBA_UBYTE
+			or header.depth_format != ICET_IMAGE_DEPTH_FLOAT) {
+		throw std::runtime_error{"Unsupported color or depth format"};
+		}
 
-			// Sort fragments by depth.
-			std::sort(frags.begin(), frags.end(), [](Fragment const& lhs, Fragment const& rhs) {
-					return std::less{}(lhs.depth , rhs.depth);
-					});
+	if (header.width <= 0 or header.height <= 0 or header.num_layers < 0
+			or header.band_height < 0) {
+		throw std::runtime_error{"Invalid image size in frame header"};
+		}
 
-			// Copy fragments to the image buffer in order.
-			auto const pixel {(y * _width + x) * _num_layers};
+	// Skip header fields added by later versions.
+	skip(in, header.header_size - sizeof(header));
 
-			for (IceTLayerCount layer {0}; layer < frags.size(); ++layer) {
-				color_buffer(pixel + layer)  = frags[layer].color;
-				_depth_buffer[pixel + layer] = frags[layer].depth;
-				}}}}
+	// Read the band index.
+	if (header.band_height > 0) {
+		info.bands.resize((header.height + header.band_height - 1) / header.band_height);
+		read_binary(in, std::span{info.bands});
+		}
 
-RawImage::RawImage(IceTSizeType width, IceTSizeType height, FILE* const in)
-	: _width  {width}
-	, _height {height}
-	{
-	auto const layer_size {width * height * (sizeof(Color) + sizeof(Depth))};
+	// Verify that sections follow the metadata and bands lie within their sections.
+	if (header.color_offset < info.metadata_size()
+			or header.depth_offset != header.color_offset + info.num_fragments() * sizeof(Color)) {
+		throw std::runtime_error{"Invalid section offsets in frame header"};
+		}
 
-	// Read data.
-	_buffer = read_all(in, layer_size);
+	auto const expected {describe(header.width, header.height, header.num_layers, header.band_height)};
 
-	// Calculate number of layers and verify size.
-	_num_layers = _buffer.size() / layer_size;
+	for (std::size_t band {0}; band < info.bands.size(); ++band) {
+		auto const row_offset {expected.bands[band].color_offset - expected.header.color_offset};
 
-	if (_buffer.size() % layer_size != 0) {
-		throw std::runtime_error{"Buffer size does not match the expected number of pixels"};
+		if (info.bands[band].color_offset != header.color_offset + row_offset
+				or info.bands[band].depth_offset != header.depth_offset + row_offset) {
+			throw std::runtime_error{concat("Invalid offsets for band ", band, " in frame index")};
+			}}
+
+	return info;
+	}
+
+auto FrameInfo::probe(FILE* const in) -> bool {
+	auto const start {ftell(in)};
+
+	if (start < 0) {
+		throw std::runtime_error{"Cannot probe a file which is not seekable"};
 		}
 
-	// Calculate depth buffer offset.
-	_depth_buffer = reinterpret_cast<Depth*>(_buffer.data() + num_fragments() * sizeof(Color));
+	FrameHeader::Magic magic {};
+	auto const         count {fread(magic.data(), 1, magic.size(), in)};
+	fseek(in, start, SEEK_SET);
+
+	return count == magic.size() and magic == FrameHeader::magic_value;
 	}
 
-RawImage::RawImage(
-		IceTSizeType width,
-		IceTSizeType height,
-		FILE* const  color_file,
-		FILE* const  depth_file
-		)
-	: _width  {width}
-	, _height {height}
-	{
-	auto const layer_size {num_pixels() * sizeof(Color)};
+auto FrameInfo::write(FILE* const out) const -> void {
+	write_binary(std::span<FrameHeader const>{&header, 1}, out);
+	write_binary(std::span<FrameBand const>{bands}, out);
+	}
 
-	// Read color data.
-	_buffer = read_all(color_file, layer_size);
+auto FrameInfo::row_offsets(IceTSizeType const row) const noexcept -> FrameBand {
+	auto const row_size {std::uint64_t{static_cast<std::uint32_t>(header.width)}
+	                     * static_cast<std::uint32_t>(header.num_layers)};
 
-	// Calculate number of layers and verify size.
-	_num_layers = _buffer.size() / layer_size;
+	if (bands.empty()) {
+		return {
+				header.color_offset + row * row_size * sizeof(Color),
+				header.depth_offset + row * row_size * sizeof(Depth),
+				};
+		}
 
-	if (_buffer.size() % layer_size != 0) {
-		throw std::runtime_error{"Buffer size does not match the expected number of pixels"};
+	auto const& band       {bands[row / header.band_height]};
+	auto const  band_start {row % header.band_height * row_size};
+
+	return {
+			band.color_offset + band_start * sizeof(Color),
+			band.depth_offset + band_start * sizeof(Depth),
+			};
+	}
+
+
+namespace {
+
+/// A list of fragments sorted by depth, whose consecutive colors and depths are `TStride` apart.
+template<std::size_t TStride = 1>
+struct FragmentRun {
+	Color const* color {nullptr};
+	Depth const* depth {nullptr};
+	std::size_t  size  {0};
+	};
+
+/// Scratch memory for merging fragment runs.
+/// Intermediate results are contiguous regardless of the stride of the runs merged.
+template<std::size_t TStride = 1>
+struct MergeScratch {
+	std::vector<FragmentRun<TStride>> runs  {};
+	std::vector<Color>                color {};
+	std::vector<Depth>                depth {};
+	std::vector<std::size_t>          tree  {};
+	};
+
+/// Copy the fragments of a run from index `begin` on into an output buffer, whose consecutive
+/// colors and depths are `TOutStride` apart.
+template<std::size_t TOutStride, std::size_t TStride>
+auto copy_run(
+		FragmentRun<TStride> const run,
+		std::size_t const          begin,
+		Color* const               out_color,
+		Depth* const               out_depth
+		) noexcept -> void {
+	if constexpr (TStride == 1 and TOutStride == 1) {
+		std::copy(run.color + begin, run.color + run.size, out_color);
+		std::copy(run.depth + begin, run.depth + run.size, out_depth);
 		}
+	else {
+		for (auto i {begin}; i < run.size; ++i) {
+			out_color[(i - begin) * TOutStride] = run.color[i * TStride];
+			out_depth[(i - begin) * TOutStride] = run.depth[i * TStride];
+			}}}
 
-	// Read depth data.
-	if (not depth_file) return;
+/// Merge two runs into an output buffer, whose consecutive colors and depths are `TOutStride`
+/// apart.
+/// Fragments of `lhs` come first if depths are equal.
+template<std::size_t TOutStride, std::size_t TLhsStride, std::size_t TRhsStride>
+auto merge_two(
+		FragmentRun<TLhsStride> const lhs,
+		FragmentRun<TRhsStride> const rhs,
+		Color* const                  out_color,
+		Depth* const                  out_depth
+		) noexcept -> void {
+	std::size_t i {0};
+	std::size_t j {0};
+
+	// Select the front fragment without branching, which would be unpredictable.
+	while (i < lhs.size and j < rhs.size) {
+		auto const lhs_depth {lhs.depth[i * TLhsStride]};
+		auto const rhs_depth {rhs.depth[j * TRhsStride]};
+		auto const take_rhs  {rhs_depth < lhs_depth};
+
+		auto const out       {(i + j) * TOutStride};
 
-	_buffer.resize(_buffer.size() + num_fragments() * sizeof(Depth));
-	_depth_buffer = reinterpret_cast<Depth*>(_buffer.data() + num_fragments() * sizeof(Color));
-	read_binary(
-			depth_file,
-			std::span<Depth>{_depth_buffer, static_cast<std::size_t>(num_fragments())}
+		out_color[out] = take_rhs ? rhs.color[j * TRhsStride] : lhs.color[i * TLhsStride];
+		out_depth[out] = take_rhs ? rhs_depth : lhs_depth;
+
+		j += take_rhs;
+		i += not take_rhs;
+		}
+
+	// Copy the remainder of either run.
+	copy_run<TOutStride>(
+			lhs,
+			i,
+			out_color + (i + j) * TOutStride,
+			out_depth + (i + j) * TOutStride
+			);
+	copy_run<TOutStride>(
+			rhs,
+			j,
+			out_color + (lhs.size + j) * TOutStride,
+			out_depth + (lhs.size + j) * TOutStride
 			);
 	}
 
-auto RawImage::write(FILE* out) const -> void {
-	write_binary(color(), out);
-	write_binary(depth(), out);
+/// Merge any number of runs into an output buffer using a tree of losers.
+/// The output buffer has the stride of the runs.
+/// Fragments of earlier runs come first if depths are equal.
+template<std::size_t TStride>
+auto merge_tree(
+		std::span<FragmentRun<TStride>> runs,
+		Color*                          out_color,
+		Depth*                          out_depth,
+		std::vector<std::size_t>&       tree
+		) -> void {
+	auto const num_runs {runs.size()};
+
+	// Return whether the front fragment of run `lhs` precedes that of run `rhs`.
+	auto precedes = [&](std::size_t const lhs, std::size_t const rhs) {
+		if (runs[lhs].size == 0) {
+			return false;
+			}
+
+		if (runs[rhs].size == 0) {
+			return true;
+			}
+
+		return runs[lhs].depth[0] < runs[rhs].depth[0]
+		    or (not (runs[rhs].depth[0] < runs[lhs].depth[0]) and lhs < rhs);
+		};
+
+	// Inner nodes `1..num_runs-1` hold the loser of their match, node 0 holds the overall winner.
+	// Leaves are implicitly numbered `num_runs..2*num_runs-1`.
+	tree.resize(num_runs);
+
+	auto play = [&](auto& play, std::size_t const node) -> std::size_t {
+		if (node >= num_runs) {
+			return node - num_runs;
+			}
+
+		auto const lhs {play(play, 2 * node)};
+		auto const rhs {play(play, 2 * node + 1)};
+
+		tree[node] = precedes(lhs, rhs) ? rhs : lhs;
+		return tree[node] == rhs ? lhs : rhs;
+		};
+
+	tree[0] = play(play, 1);
+
+	// Repeatedly output the winner, then replay its path to the root.
+	for (auto winner {tree[0]}; runs[winner].size > 0; winner = tree[0]) {
+		auto& run {runs[winner]};
+
+		*out_color = *run.color;
+		*out_depth = *run.depth;
+		out_color += TStride;
+		out_depth += TStride;
+		run.color += TStride;
+		run.depth += TStride;
+		--run.size;
+
+		for (auto node {(winner + num_runs) / 2}; node > 0; node /= 2) {
+			if (precedes(tree[node], winner)) {
+				std::swap(tree[node], winner);
+				}}
+
+		tree[0] = winner;
+		}}
+
+/// Merge runs into an output buffer of the same stride in order of depth.
+/// Fragments of equal depth are ordered by the index of their run, so results are deterministic.
+template<std::size_t TStride>
+auto merge_runs(
+		std::span<FragmentRun<TStride>> runs,
+		Color* const                    out_color,
+		Depth* const                    out_depth,
+		MergeScratch<TStride>&          scratch
+		) -> void {
+	// Intermediate results of pairwise merges are stored in scratch memory.
+	auto* color {scratch.color.data()};
+	auto* depth {scratch.depth.data()};
+
+	auto allocate = [&](std::size_t const size) {
+		scratch.color.resize(size);
+		scratch.depth.resize(size);
+		color = scratch.color.data();
+		depth = scratch.depth.data();
+		};
+
+	switch (runs.size()) {
+		case 0:
+			break;
+		case 1:
+			copy_run<TStride>(runs[0], 0, out_color, out_depth);
+			break;
+		case 2:
+			merge_two<TStride>(runs[0], runs[1], out_color, out_depth);
+			break;
+		case 3: {
+			auto const first_size {runs[0].size + runs[1].size};
+			allocate(first_size);
+			merge_two<1>(runs[0], runs[1], color, depth);
+			merge_two<TStride>(
+					FragmentRun<>{color, depth, first_size},
+					runs[2],
+					out_color,
+					out_depth
+					);
+			break;
+			}
+		case 4: {
+			auto const first_size  {runs[0].size + runs[1].size};
+			auto const second_size {runs[2].size + runs[3].size};
+			allocate(first_size + second_size);
+			merge_two<1>(runs[0], runs[1], color, depth);
+			merge_two<1>(runs[2], runs[3], color + first_size, depth + first_size);
+			merge_two<TStride>(
+					FragmentRun<>{color, depth, first_size},
+					FragmentRun<>{color + first_size, depth + first_size, second_size},
+					out_color,
+					out_depth
+					);
+			break;
+			}
+		default:
+			merge_tree(runs, out_color, out_depth, scratch.tree);
+			break;
+			}}
+
+/// Merge the fragments at each pixel of `num_sources` images into an image of the given size in
+/// order of depth, in parallel on `num_threads` threads.
+/// `source(idx, x, y)` returns the active fragments of source `idx` at a pixel, and `target(x, y)`
+/// returns the color and depth of the first fragment of a pixel of the result, whose consecutive
+/// fragments are `TStride` apart like those of the sources.
+template<std::size_t TStride>
+auto merge_images(
+		IceTSizeType const width,
+		IceTSizeType const height,
+		std::size_t const  num_sources,
+		auto const&        source,
+		auto const&        target,
+		unsigned const     num_threads
+		) -> void {
+	// Each thread uses its own scratch memory.
+	std::vector<MergeScratch<TStride>> scratch (num_threads);
+
+	// Rows are independent, so blocks of rows are merged in parallel.
+	constexpr std::size_t block_rows {8};
+
+	parallel_for(height, block_rows, num_threads, [&](
+			std::size_t const row_begin,
+			std::size_t const row_end,
+			unsigned const    thread_idx
+			) {
+		auto& runs {scratch[thread_idx].runs};
+		runs.reserve(num_sources);
+
+		auto const y_end {static_cast<IceTSizeType>(row_end)};
+
+		// For each pixel:
+		for (auto y {static_cast<IceTSizeType>(row_begin)}; y < y_end; ++y) {
+			for (IceTSizeType x {0}; x < width; ++x) {
+				runs.clear();
+
+				// Gather the active fragments from all input images.
+				for (std::size_t idx {0}; idx < num_sources; ++idx) {
+					if (auto const run {source(idx, x, y)}; run.size > 0) {
+						runs.push_back(run);
+						}}
+
+				// Merge fragments into the result in order of depth.
+				auto const [color, depth] {target(x, y)};
+				merge_runs(std::span{runs}, color, depth, scratch[thread_idx]);
+				}}});
+	}
+
+} // namespace
+
+
+PngReader::PngReader(char const* const path)
+	: PngReader {path, fopen(path, "rb")}
+	{
+	if (not _file) {
+		throw std::runtime_error{concat("Could not open ", path)};
+		}
+
+	if (not _info) {
+		throw std::runtime_error{concat("Could not allocate PNG decoder for ", path)};
+		}
+
+	png_init_io(_png, _file);
+	png_read_info(_png, _info);
+
+	// Convert any color type and bit depth to 8 bit RGBA.
+	auto const color_type {png_get_color_type(_png, _info)};
+
+	png_set_expand(_png);
+	png_set_strip_16(_png);
+
+	if (color_type == PNG_COLOR_TYPE_GRAY or color_type == PNG_COLOR_TYPE_GRAY_ALPHA) {
+		png_set_gray_to_rgb(_png);
+		}
+
+	if (not (color_type & PNG_COLOR_MASK_ALPHA)
+			and not png_get_valid(_png, _info, PNG_INFO_tRNS)) {
+		png_set_add_alpha(_png, color::channel_max, PNG_FILLER_AFTER);
+		}
+
+	_num_passes = png_set_interlace_handling(_png);
+	png_read_update_info(_png, _info);
+
+	// Rows of interlaced images are refined by every pass, so they must be held entirely.
+	_rows.resize(std::size_t(width()) * (_num_passes > 1 ? height() : 1));
+	}
+
+PngReader::PngReader(char const* const path, FILE* const file) noexcept
+	: _path {path}
+	, _file {file}
+	, _png  {file
+			? png_create_read_struct(PNG_LIBPNG_VER_STRING, this, &raise, &warn)
+			: nullptr
+			}
+	, _info {_png ? png_create_info_struct(_png) : nullptr}
+	{}
+
+PngReader::~PngReader() noexcept {
+	png_destroy_read_struct(&_png, &_info, nullptr);
+
+	if (_file) {
+		fclose(_file);
+		}}
+
+auto PngReader::width() const noexcept -> IceTSizeType {
+	return int_cast<IceTSizeType>(png_get_image_width(_png, _info));
+	}
+
+auto PngReader::height() const noexcept -> IceTSizeType {
+	return int_cast<IceTSizeType>(png_get_image_height(_png, _info));
+	}
+
+auto PngReader::next_row() -> std::span<Color> {
+	assert(_next_row < height());
+
+	auto const row_size {static_cast<std::size_t>(width())};
+
+	// Regular images are read one row at a time into the same buffer.
+	if (_num_passes == 1) {
+		png_read_row(_png, reinterpret_cast<png_bytep>(_rows.data()), nullptr);
+		++_next_row;
+		return _rows;
+		}
+
+	// Interlaced images are read entirely on the first call.
+	if (_next_row == 0) {
+		for (int pass {0}; pass < _num_passes; ++pass) {
+			for (std::size_t y {0}; y < std::size_t(height()); ++y) {
+				png_read_row(_png, reinterpret_cast<png_bytep>(&_rows[y * row_size]), nullptr);
+				}}}
+
+	return std::span{_rows}.subspan(std::size_t(_next_row++) * row_size, row_size);
+	}
+
+auto PngReader::raise(png_structp const png, png_const_charp const msg) -> void {
+	auto const& self {*static_cast<PngReader const*>(png_get_error_ptr(png))};
+	throw std::runtime_error{concat("Could not read ", self._path, ": ", msg)};
+	}
+
+auto PngReader::warn(png_structp, png_const_charp) noexcept -> void {}
+
+
+LayeredPngReader::LayeredPngReader(
+		IceTSizeType const          width,
+		IceTSizeType const          height,
+		std::span<InputLayer const> layers
+		)
+	: _width  {width}
+	, _height {height}
+	, _pngs   (layers.size())
+	{
+	for (std::size_t layer {0}; layer < layers.size(); ++layer) {
+		_pngs[layer].emplace(layers[layer].path);
+		}}
+
+auto LayeredPngReader::next_band(IceTSizeType const num_rows, unsigned const num_threads)
+		-> std::span<Color const> {
+	assert(_next_row + num_rows <= _height);
+
+	auto const num_layers {_pngs.size()};
+	auto const row_size   {std::size_t(_width) * num_layers};
+
+	_band.resize(std::size_t(num_rows) * row_size);
+
+	// Decode each layer on its own thread, storing its fragments at the same index of each pixel,
+	// so threads never write to the same fragment.
+	parallel_for(num_layers, 1, num_threads, [&](
+			std::size_t const layer_begin,
+			std::size_t const layer_end,
+			unsigned
+			) {
+		for (auto layer {layer_begin}; layer < layer_end; ++layer) {
+			auto&      png      {*_pngs[layer]};
+			auto const num_cols {std::min(_width, png.width())};
+
+			for (IceTSizeType y {0}; y < num_rows; ++y) {
+				auto const out_row {&_band[y * row_size + layer]};
+
+				// Rows beyond the input image are empty.
+				std::span<Color> row {};
+
+				if (_next_row + y < png.height()) {
+					row = png.next_row().first(num_cols);
+					simd::premultiply(row);
+					}
+
+				for (IceTSizeType x {0}; x < _width; ++x) {
+					out_row[x * num_layers] = std::size_t(x) < row.size()
+							? row[x]
+							: Color{0, 0, 0, 0};
+					}}}});
+
+	_next_row += num_rows;
+	return _band;
+	}
+
+
+RawImage::RawImage(
+		IceTSizeType const          width,
+		IceTSizeType const          height,
+		std::span<InputLayer const> layers,
+		unsigned const              num_threads
+		)
+	: _width        {width}
+	, _height       {height}
+	, _num_layers   {int_cast<IceTSizeType>(layers.size())}
+	{
+	allocate();
+
+	// Decode layers in parallel, storing the fragments of each layer at the same index in the
+	// fragment list of each pixel, so threads never write to the same fragment.
+	parallel_for(layers.size(), 1, num_threads, [&](
+			std::size_t const layer_begin,
+			std::size_t const layer_end,
+			unsigned
+			) {
+		for (auto layer_idx {layer_begin}; layer_idx < layer_end; ++layer_idx) {
+			auto const& layer {layers[layer_idx]};
+			PngReader   png   {layer.path};
+
+			auto const num_rows {std::min(height, png.height())};
+			auto const num_cols {std::min(width,  png.width())};
+
+			for (IceTSizeType y {0}; y < num_rows; ++y) {
+				// Scale colors by alpha.
+				auto const row {png.next_row().first(num_cols)};
+				simd::premultiply(row);
+
+				// Copy active fragments.
+				for (IceTSizeType x {0}; x < num_cols; ++x) {
+					if (row[x][color::alpha_channel] == 0) {
+						continue;
+						}
+
+					auto const out_idx {(y * width + x) * _num_layers + layer_idx};
+
+					color_buffer(out_idx) = row[x];
+					depth_buffer(out_idx) = layer.depth;
+					}}}});
+
+	// Move active fragments to the front of each pixel's list, maintaining the order of layers.
+	constexpr std::size_t block_rows {8};
+
+	parallel_for(_height, block_rows, num_threads, [&](
+			std::size_t const row_begin,
+			std::size_t const row_end,
+			unsigned
+			) {
+		auto const pixel_begin {row_begin * _width * _num_layers};
+		auto const pixel_end   {row_end   * _width * _num_layers};
+
+		for (auto pixel {pixel_begin}; pixel < pixel_end; pixel += _num_layers) {
+			auto front {pixel};
+
+			for (auto idx {pixel}; idx < pixel + _num_layers; ++idx) {
+				if (color_buffer(idx)[color::alpha_channel] == 0) {
+					continue;
+					}
+
+				if (idx != front) {
+					color_buffer(front) = std::exchange(color_buffer(idx), {0, 0, 0, 0});
+					depth_buffer(front) = std::exchange(depth_buffer(idx), 0);
+					}
+
+				++front;
+				}}});
+	}
+
+RawImage::RawImage(
+		IceTSizeType const        width,
+		IceTSizeType const        height,
+		std::span<RawImage const> sources,
+		unsigned const            num_threads
+		)
+	: _width        {width}
+	, _height       {height}
+	, _num_layers   {std::accumulate(
+		sources.begin(),
+		sources.end(),
+		0,
+		[](auto const accum, RawImage const& img) {
+			return accum + img.num_layers();
+			}
+		)}
+	{
+	allocate();
+
+	merge_images<1>(width, height, sources.size(), [&](
+			std::size_t const  idx,
+			IceTSizeType const x,
+			IceTSizeType const y
+			) -> FragmentRun<> {
+		auto const& img {sources[idx]};
+
+		if (x >= img.width() or y >= img.height()) {
+			return {};
+			}
+
+		auto const start {(y * img.width() + x) * img.num_layers()};
+
+		// Active fragments must come before inactive ones.
+		return {
+				img.color().data() + start,
+				img.depth().data() + start,
+				simd::count_active(img.color().subspan(start, img.num_layers())),
+				};
+		},
+		[&](IceTSizeType const x, IceTSizeType const y) {
+			auto const pixel {(y * _width + x) * _num_layers};
+			return std::pair{&color_buffer(pixel), &depth_buffer(pixel)};
+			},
+		num_threads);
+	}
+
+RawImage::RawImage(
+		IceTSizeType const       width,
+		IceTSizeType const       height,
+		IceTSizeType const       num_layers,
+		std::vector<std::byte>&& buffer
+		)
+	: _width      {width}
+	, _height     {height}
+	, _num_layers {num_layers}
+	, _buffer     {std::move(buffer)}
+	{
+	if (_buffer.size() != std::size_t(num_fragments()) * (sizeof(Color) + sizeof(Depth))) {
+		throw std::runtime_error{"Buffer size does not match image size"};
+		}
+
+	_color_buffer = &color_buffer();
+	_depth_buffer = &depth_buffer();
+	track();
+	}
+
+RawImage::RawImage(IceTSizeType width, IceTSizeType height, FILE* const in)
+	: _width  {width}
+	, _height {height}
+	{
+	std::vector<std::byte> prefix;
+
+	// Self-describing files contain all required information.
+	if (auto const info {FrameInfo::read(in, prefix)}) {
+		check_size(width, height, info->header);
+		load(*info, in);
+		return;
+		}
+
+	load(in, std::move(prefix));
+	}
+
+RawImage::RawImage(
+		IceTSizeType             width,
+		IceTSizeType             height,
+		FILE* const              in,
+		std::vector<std::byte>&& prefix
+		)
+	: _width  {width}
+	, _height {height}
+	{
+	load(in, std::move(prefix));
+	}
+
+RawImage::RawImage(
+		IceTSizeType width,
+		IceTSizeType height,
+		FILE* const  color_file,
+		FILE* const  depth_file
+		)
+	: _width  {width}
+	, _height {height}
+	{
+	std::vector<std::byte> prefix;
+
+	// Self-describing files contain both color and depth data.
+	if (auto const info {FrameInfo::read(color_file, prefix)}) {
+		check_size(width, height, info->header);
+		load(*info, color_file);
+		return;
+		}
+
+	auto const layer_size {num_pixels() * sizeof(Color)};
+	auto const color_data {load_headerless(color_file, std::move(prefix), layer_size)};
+
+	// Encoded files contain both color and depth data, and describe their own size.
+	if (codec::is_encoded(color_data)) {
+		load_encoded(color_data);
+		return;
+		}
+
+	if (width == 0 or height == 0) {
+		throw std::runtime_error{"Missing image size for headerless input"};
+		}
+
+	// Calculate number of layers and verify size.
+	_num_layers = color_data.size() / layer_size;
+
+	if (color_data.size() % layer_size != 0) {
+		throw std::runtime_error{"Buffer size does not match the expected number of pixels"};
+		}
+
+	// Read depth data.
+	if (not depth_file) {
+		_color_buffer = reinterpret_cast<Color const*>(color_data.data());
+		return;
+		}
+
+	auto const depth_size {num_fragments() * sizeof(Depth)};
+	_depth_file = posix::MappedFile::map(depth_file);
+
+	if (_depth_file and _depth_file.bytes().size() < depth_size) {
+		throw std::runtime_error{"Could not read requested amount of data"};
+		}
+
+	// Mappings of misaligned file positions cannot be used as a depth buffer.
+	if (_depth_file and reinterpret_cast<std::uintptr_t>(_depth_file.bytes().data())
+	                    % alignof(Depth) == 0) {
+		_depth_buffer = reinterpret_cast<Depth const*>(_depth_file.bytes().data());
+		}
+	else {
+		_depth_file = {};
+
+		// Append depth data to the color buffer.
+		auto const depth_offset {_buffer.size()};
+		_buffer.resize(depth_offset + depth_size);
+		track();
+		read_binary(depth_file, std::span{_buffer}.subspan(depth_offset));
+		_depth_buffer = reinterpret_cast<Depth const*>(_buffer.data() + depth_offset);
+		}
+
+	// Resizing the buffer may have moved color data.
+	_color_buffer = reinterpret_cast<Color const*>(
+			_color_file ? _color_file.bytes().data() : _buffer.data());
+	}
+
+auto RawImage::load(FrameInfo const& info, FILE* const in) -> void {
+	_width      = info.header.width;
+	_height     = info.header.height;
+	_num_layers = info.header.num_layers;
+
+	// Seek to the color section, which is directly followed by the depth section.
+	skip(in, info.header.color_offset - info.metadata_size());
+
+	auto const size {info.file_size() - info.header.color_offset};
+
+	// Map the file if possible, otherwise read exactly as much data as the header describes.
+	_color_file = posix::MappedFile::map(in);
+
+	if (_color_file and _color_file.bytes().size() < size) {
+		throw std::runtime_error{"File is smaller than described by its header"};
+		}
+
+	if (_color_file and reinterpret_cast<std::uintptr_t>(_color_file.bytes().data())
+	                    % alignof(Depth) != 0) {
+		_color_file = {};
+		}
+
+	if (not _color_file) {
+		_buffer.resize(size);
+		track();
+		read_binary(in, std::span{_buffer});
+		}
+
+	auto const data {_color_file ? _color_file.bytes().data() : _buffer.data()};
+	_color_buffer = reinterpret_cast<Color const*>(data);
+	_depth_buffer = reinterpret_cast<Depth const*>(data + num_fragments() * sizeof(Color));
+	}
+
+auto RawImage::load(FILE* const in, std::vector<std::byte>&& prefix) -> void {
+	auto const layer_size {num_pixels() * (sizeof(Color) + sizeof(Depth))};
+	auto const data       {load_headerless(in, std::move(prefix), layer_size)};
+
+	// Encoded files describe their own size.
+	if (codec::is_encoded(data)) {
+		load_encoded(data);
+		return;
+		}
+
+	if (_width == 0 or _height == 0) {
+		throw std::runtime_error{"Missing image size for headerless input"};
+		}
+
+	// Calculate number of layers and verify size.
+	_num_layers = data.size() / layer_size;
+
+	if (data.size() % layer_size != 0) {
+		throw std::runtime_error{"Buffer size does not match the expected number of pixels"};
+		}
+
+	// Calculate buffer offsets.
+	_color_buffer = reinterpret_cast<Color const*>(data.data());
+	_depth_buffer = reinterpret_cast<Depth const*>(data.data() + num_fragments() * sizeof(Color));
+	}
+
+auto RawImage::load_encoded(std::span<std::byte const> const data) -> void {
+	auto image {codec::decode(data, default_num_threads())};
+	check_size(_width, _height, image.width(), image.height());
+
+	// Release the encoded data before taking over the decoded image.
+	*this = std::move(image);
+	}
+
+auto RawImage::load_headerless(
+		FILE* const              in,
+		std::vector<std::byte>&& prefix,
+		std::size_t const        size_hint
+		) -> std::span<std::byte const> {
+	// Map the file if possible, otherwise read data.
+	// Mappings of misaligned file positions are not used since a depth buffer following the color
+	// buffer would be misaligned as well.
+	_color_file = posix::MappedFile::map(in);
+
+	if (_color_file and reinterpret_cast<std::uintptr_t>(_color_file.bytes().data())
+	                    % alignof(Depth) == 0) {
+		return _color_file.bytes();
+		}
+
+	_color_file = {};
+	_buffer     = read_remaining(in, std::move(prefix), size_hint);
+	track();
+	return _buffer;
+	}
+
+auto RawImage::allocate() -> void {
+	_buffer.assign(num_fragments() * (sizeof(Color) + sizeof(Depth)), std::byte{0});
+	_color_buffer = &color_buffer();
+	_depth_buffer = &depth_buffer();
+	track();
+	}
+
+auto RawImage::write(FILE* out, IceTSizeType const band_height) const -> void {
+	FrameInfo::describe(_width, _height, _num_layers, band_height).write(out);
+	write_binary(color(), out);
+	write_binary(depth(), out);
+	}
+
+
+template<Layout TLayout>
+auto merge(
+		IceTSizeType const                      width,
+		IceTSizeType const                      height,
+		std::span<LayeredBuffer<TLayout> const> sources,
+		unsigned const                          num_threads
+		) -> LayeredBuffer<TLayout> {
+	constexpr auto stride {TLayout::layer_stride};
+
+	LayeredBuffer<TLayout> result {width, height, std::accumulate(
+			sources.begin(),
+			sources.end(),
+			0,
+			[](auto const accum, LayeredBuffer<TLayout> const& img) {
+				return accum + img.num_layers();
+				}
+			)};
+
+	merge_images<stride>(width, height, sources.size(), [&](
+			std::size_t const  idx,
+			IceTSizeType const x,
+			IceTSizeType const y
+			) -> FragmentRun<stride> {
+		auto const& img {sources[idx]};
+
+		if (x >= img.width() or y >= img.height() or img.num_layers() == 0) {
+			return {};
+			}
+
+		auto const  pixel {static_cast<std::size_t>(y * img.width() + x)};
+		auto const* color {&img.color(pixel, 0)};
+
+		// Active fragments must come before inactive ones.
+		return {
+				color,
+				&img.depth(pixel, 0),
+				simd::count_active(color, stride, static_cast<std::size_t>(img.num_layers())),
+				};
+		},
+		[&](IceTSizeType const x, IceTSizeType const y) {
+			auto const pixel {static_cast<std::size_t>(y * width + x)};
+			return std::pair{&result.color(pixel, 0), &result.depth(pixel, 0)};
+			},
+		num_threads);
+
+	return result;
+	}
+
+template auto merge(
+		IceTSizeType,
+		IceTSizeType,
+		std::span<LayeredBuffer<layout::Planar> const>,
+		unsigned
+		) -> LayeredBuffer<layout::Planar>;
+
+template auto merge(
+		IceTSizeType,
+		IceTSizeType,
+		std::span<LayeredBuffer<layout::Interleaved> const>,
+		unsigned
+		) -> LayeredBuffer<layout::Interleaved>;
+
+template auto merge(
+		IceTSizeType,
+		IceTSizeType,
+		std::span<LayeredBuffer<layout::Blocked> const>,
+		unsigned
+		) -> LayeredBuffer<layout::Blocked>;
+
+
+namespace {
+
+/// Number of rows decoded from all layers at once when building a packed image.
+constexpr IceTSizeType csr_band_rows {32};
+
+/// Number of consecutive pixels processed by a thread when building a packed image.
+constexpr std::size_t csr_block_pixels {4096};
+
+} // namespace
+
+template<typename TCount>
+auto CsrImage::allocate(TCount&& count, unsigned const num_threads) -> void {
+	auto const num_pixels {static_cast<std::size_t>(this->num_pixels())};
+
+	// Store the number of fragments of each pixel as the offset of the next one, then accumulate.
+	_offsets.assign(num_pixels + 1, 0);
+
+	parallel_for(num_pixels, csr_block_pixels, num_threads, [&](
+			std::size_t const begin,
+			std::size_t const end,
+			unsigned
+			) {
+		count(begin, end, std::span{_offsets}.subspan(begin + 1, end - begin));
+		});
+
+	std::partial_sum(_offsets.begin(), _offsets.end(), _offsets.begin());
+
+	_color.resize(_offsets.back());
+	_depth.resize(_offsets.back());
+	track();
+	}
+
+auto CsrImage::track() noexcept -> void {
+	_tracker.set(
+			_offsets.capacity() * sizeof(std::size_t)
+			+ _color.capacity() * sizeof(Color)
+			+ _depth.capacity() * sizeof(Depth)
+			);
+	}
+
+CsrImage::CsrImage(
+		IceTSizeType const          width,
+		IceTSizeType const          height,
+		std::span<InputLayer const> layers,
+		unsigned const              num_threads
+		)
+	: _width  {width}
+	, _height {height}
+	{
+	LayeredPngReader reader     {width, height, layers};
+	auto const       num_layers {layers.size()};
+
+	_offsets.reserve(static_cast<std::size_t>(num_pixels()) + 1);
+
+	for (IceTSizeType first_row {0}; first_row < height; first_row += csr_band_rows) {
+		auto const num_rows {std::min(csr_band_rows, height - first_row)};
+		auto const band     {reader.next_band(num_rows, num_threads)};
+
+		// Append each pixel's active fragments in the order of their layers.
+		for (std::size_t pixel {0}; pixel < std::size_t(num_rows) * width; ++pixel) {
+			for (std::size_t layer {0}; layer < num_layers; ++layer) {
+				if (auto const& frag {band[pixel * num_layers + layer]};
+						frag[color::alpha_channel] != 0) {
+					_color.push_back(frag);
+					_depth.push_back(layers[layer].depth);
+					}}
+
+			_offsets.push_back(_color.size());
+			}
+
+		// Count the fragments appended so far, as they grow band by band.
+		track();
+		}}
+
+CsrImage::CsrImage(
+		IceTSizeType const        width,
+		IceTSizeType const        height,
+		std::span<CsrImage const> sources,
+		unsigned const            num_threads
+		)
+	: _width  {width}
+	, _height {height}
+	{
+	// Return the fragments of a source image at the location of a pixel of the result.
+	auto fragments = [&](CsrImage const& img, std::size_t const pixel) -> FragmentRun<> {
+		auto const x {static_cast<IceTSizeType>(pixel % width)};
+		auto const y {static_cast<IceTSizeType>(pixel / width)};
+
+		if (x >= img.width() or y >= img.height()) {
+			return {};
+			}
+
+		auto const idx   {static_cast<std::size_t>(y * img.width() + x)};
+		auto const begin {img._offsets[idx]};
+		auto const end   {img._offsets[idx + 1]};
+
+		return {img._color.data() + begin, img._depth.data() + begin, end - begin};
+		};
+
+	allocate([&](std::size_t const begin, std::size_t const end, std::span<std::size_t> counts) {
+		for (auto pixel {begin}; pixel < end; ++pixel) {
+			for (auto const& img : sources) {
+				counts[pixel - begin] += fragments(img, pixel).size;
+				}}},
+		num_threads);
+
+	// Each thread uses its own scratch memory.
+	std::vector<MergeScratch<>> scratch (num_threads);
+
+	parallel_for(_offsets.size() - 1, csr_block_pixels, num_threads, [&](
+			std::size_t const begin,
+			std::size_t const end,
+			unsigned const    thread_idx
+			) {
+		auto& runs {scratch[thread_idx].runs};
+		runs.reserve(sources.size());
+
+		for (auto pixel {begin}; pixel < end; ++pixel) {
+			runs.clear();
+
+			for (auto const& img : sources) {
+				if (auto const run {fragments(img, pixel)}; run.size > 0) {
+					runs.push_back(run);
+					}}
+
+			merge_runs(
+					std::span{runs},
+					_color.data() + _offsets[pixel],
+					_depth.data() + _offsets[pixel],
+					scratch[thread_idx]
+					);
+			}});
+	}
+
+CsrImage::CsrImage(RawImage const& image, unsigned const num_threads)
+	: _width  {image.width()}
+	, _height {image.height()}
+	{
+	auto const num_layers {static_cast<std::size_t>(image.num_layers())};
+
+	allocate([&](std::size_t const begin, std::size_t const end, std::span<std::size_t> counts) {
+		for (auto pixel {begin}; pixel < end; ++pixel) {
+			counts[pixel - begin] = simd::count_active(
+					image.color().subspan(pixel * num_layers, num_layers)
+					);
+			}},
+		num_threads);
+
+	// Active fragments come first, so each pixel's fragments are copied at once.
+	parallel_for(_offsets.size() - 1, csr_block_pixels, num_threads, [&](
+			std::size_t const begin,
+			std::size_t const end,
+			unsigned
+			) {
+		for (auto pixel {begin}; pixel < end; ++pixel) {
+			auto const in   {pixel * num_layers};
+			auto const out  {_offsets[pixel]};
+			auto const size {_offsets[pixel + 1] - out};
+
+			std::copy_n(image.color().begin() + in, size, _color.begin() + out);
+			std::copy_n(image.depth().begin() + in, size, _depth.begin() + out);
+			}});
+	}
+
+auto CsrImage::to_raw(IceTSizeType num_layers) const -> RawImage {
+	if (num_layers == 0) {
+		num_layers = int_cast<IceTSizeType>(max_fragments());
+		}
+	else if (std::size_t(num_layers) < max_fragments()) {
+		throw std::runtime_error{"Too few layers to hold every fragment"};
+		}
+
+	return {_width, _height, num_layers, [&](
+			IceTSizeType const     pixel,
+			std::span<Color> const color,
+			std::span<Depth> const depth
+			) {
+		auto const begin {_offsets[pixel]};
+		auto const size  {_offsets[pixel + 1] - begin};
+
+		std::copy_n(_color.begin() + begin, size, color.begin());
+		std::copy_n(_depth.begin() + begin, size, depth.begin());
+		}};
+	}
+
+auto CsrImage::max_fragments() const noexcept -> std::size_t {
+	std::size_t result {0};
+
+	for (std::size_t pixel {0}; pixel + 1 < _offsets.size(); ++pixel) {
+		result = std::max(result, _offsets[pixel + 1] - _offsets[pixel]);
+		}
+
+	return result;
+	}
+
+namespace {
+
+/// Read a given number of bytes from a position in a file without moving its file offset.
+auto read_at(int const fd, std::span<std::byte> buffer, off_t offset) -> void {
+	while (not buffer.empty()) {
+		auto const count {pread(fd, buffer.data(), buffer.size(), offset)};
+
+		if (count <= 0) {
+			throw std::runtime_error{"Could not read requested amount of data"};
+			}
+
+		buffer  = buffer.subspan(count);
+		offset += count;
+		}}
+
+} // namespace
+
+RawImageReader::RawImageReader(
+		IceTSizeType const width,
+		IceTSizeType const height,
+		FILE* const        in,
+		bool const         read_depth,
+		IceTSizeType const band_height
+		)
+	: _in          {in}
+	, _start       {ftell(in)}
+	, _read_depth  {read_depth}
+	, _band_height {band_height}
+	{
+	// Images which cannot be streamed must be loaded entirely.
+	auto use_resident = [&](RawImage&& image) {
+		_source   = Source::resident;
+		_resident = std::move(image);
+		_info     = FrameInfo::describe(_resident.width(), _resident.height(), _resident.num_layers());
+		};
+
+	// Without random access, depth data can only be read after all color data.
+	if (_start < 0 and _read_depth) {
+		use_resident(RawImage{width, height, in});
+		return;
+		}
+
+	std::vector<std::byte> prefix;
+
+	if (auto info {FrameInfo::read(in, prefix)}) {
+		check_size(width, height, info->header);
+		_info = std::move(*info);
+
+		// Streams are positioned at the start of the color section.
+		if (_start < 0) {
+			_source = Source::sequential;
+			skip(in, _info.header.color_offset - _info.metadata_size());
+			}
+
+		return;
+		}
+
+	// Headerless streams do not contain enough information to know their number of layers, and
+	// encoded images must be decoded entirely.
+	if (_start < 0 or codec::probe(in)) {
+		use_resident(RawImage{width, height, in, std::move(prefix)});
+		return;
+		}
+
+	if (width == 0 or height == 0) {
+		throw std::runtime_error{"Missing image size for headerless input"};
+		}
+
+	// Determine the number of layers from the file size.
+	struct stat file_info;
+
+	if (fstat(fileno(in), &file_info)) {
+		throw std::runtime_error{"Could not determine the size of the input file"};
+		}
+
+	auto const layer_size {std::uint64_t{static_cast<std::uint32_t>(width * height)}
+	                       * (sizeof(Color) + sizeof(Depth))};
+	auto const data_size  {static_cast<std::uint64_t>(file_info.st_size - _start)};
+
+	if (data_size % layer_size != 0) {
+		throw std::runtime_error{"Buffer size does not match the expected number of pixels"};
+		}
+
+	// Describe the headerless layout, whose sections start at the current position.
+	_info.header.width        = width;
+	_info.header.height       = height;
+	_info.header.num_layers   = data_size / layer_size;
+	_info.header.color_offset = 0;
+	_info.header.depth_offset = _info.num_fragments() * sizeof(Color);
+	}
+
+auto RawImageReader::next() -> RowBand {
+	if (_next_row >= height()) {
+		return {};
+		}
+
+	// Resident images are already in memory.
+	if (_source == Source::resident) {
+		auto const num_rows  {std::min(_band_height, height() - _next_row)};
+		auto const start     {std::size_t(_next_row) * width() * num_layers()};
+		auto const num_frags {std::size_t(num_rows) * width() * num_layers()};
+
+		RowBand const band {
+				_next_row,
+				num_rows,
+				_resident.color().subspan(start, num_frags),
+				_read_depth ? _resident.depth().subspan(start, num_frags) : std::span<Depth const>{},
+				};
+
+		_next_row += num_rows;
+		return band;
+		}
+
+	// Start reading bands in the background on the first call.
+	if (not _thread.joinable()) {
+		_thread = std::jthread{[this, first_row = _next_row](std::stop_token const stop) {
+				read_bands(first_row, stop);
+				}};
+		}
+
+	std::unique_lock lock {_mutex};
+
+	// The band returned last is no longer used, so its buffer can be reused.
+	if (_current.capacity() > 0) {
+		_free.push_back(std::move(_current));
+		}
+
+	// Wait for the next band and take it, which lets the following one be read.
+	_cond.wait(lock, [&]() { return not _ready.empty() or _error; });
+
+	if (_ready.empty()) {
+		std::rethrow_exception(_error);
+		}
+
+	auto const band {_ready.front().band};
+	_current = std::move(_ready.front().buffer);
+	_ready.pop_front();
+	lock.unlock();
+
+	_cond.notify_all();
+	_next_row += band.num_rows;
+	return band;
+	}
+
+auto RawImageReader::rewind() -> void {
+	if (_source == Source::sequential) {
+		throw std::logic_error{"Streamed images cannot be read again"};
+		}
+
+	// Stop reading ahead, keeping the buffers of bands read already for reuse.
+	if (_thread.joinable()) {
+		_thread.request_stop();
+		_thread.join();
+		}
+
+	for (auto& band : _ready) {
+		_free.push_back(std::move(band.buffer));
+		}
+
+	_ready.clear();
+	_error    = {};
+	_next_row = 0;
+	}
+
+auto RawImageReader::read_bands(IceTSizeType first_row, std::stop_token const stop) -> void {
+	while (first_row < height()) {
+		std::vector<std::byte> buffer;
+
+		// Wait until the band read last has been taken.
+		{
+			std::unique_lock lock {_mutex};
+
+			if (not _cond.wait(lock, stop, [&]() { return _ready.size() < read_ahead; })) {
+				return;
+				}
+
+			if (not _free.empty()) {
+				buffer = std::move(_free.back());
+				_free.pop_back();
+				}}
+
+		try {
+			auto const band {read(first_row, buffer)};
+			first_row += band.num_rows;
+
+			std::lock_guard const lock {_mutex};
+			_ready.push_back({band, std::move(buffer)});
+			}
+		catch (...) {
+			std::lock_guard const lock {_mutex};
+			_error = std::current_exception();
+			}
+
+		_cond.notify_all();
+
+		if (_error) {
+			return;
+			}}}
+
+auto RawImageReader::read(IceTSizeType const first_row, std::vector<std::byte>& buffer) -> RowBand {
+	auto const num_rows    {std::min(_band_height, height() - first_row)};
+	auto const num_frags   {std::size_t(num_rows) * width() * num_layers()};
+	auto const color_size  {num_frags * sizeof(Color)};
+	auto const depth_size  {_read_depth ? num_frags * sizeof(Depth) : 0};
+
+	buffer.resize(color_size + depth_size);
+
+	if (_source == Source::sequential) {
+		read_binary(_in, std::span{buffer});
+		}
+	else {
+		auto const offsets {_info.row_offsets(first_row)};
+		auto const bytes   {std::span{buffer}};
+
+		read_at(fileno(_in), bytes.first(color_size), _start + offsets.color_offset);
+
+		if (_read_depth) {
+			read_at(fileno(_in), bytes.subspan(color_size), _start + offsets.depth_offset);
+			}}
+
+	return {
+			first_row,
+			num_rows,
+			{reinterpret_cast<Color const*>(buffer.data()), num_frags},
+			{reinterpret_cast<Depth const*>(buffer.data() + color_size), depth_size / sizeof(Depth)},
+			};
+	}
+
+
+SparseImageWriter::SparseImageWriter(
+		IceTSizeType const width,
+		IceTSizeType const height,
+		FILE* const        out
+		)
+	: _out   {out}
+	, _start {ftell(out)}
+	{
+	// Let IceT fill in the header, leaving room for the empty run it initializes images with.
+	_pending.resize(sparse_header_size + sizeof(RunLengths));
+	icetSparseLayeredImageAssignBuffer(_pending.data(), width, height);
+	_pending.resize(sparse_header_size);
+
+	start_run();
+	}
+
+auto SparseImageWriter::push_inactive(IceTSizeType const count) -> void {
+	// Run lengths are stored before every inactive run.
+	if (_prev_active) {
+		end_run();
+		start_run();
+		_prev_active = false;
+		}
+
+	_run.inactive += count;
+	}
+
+auto SparseImageWriter::push_active(std::span<Color const> color, std::span<Depth const> depth)
+		-> void {
+	append(int_cast<IceTLayerCount>(color.size()));
+
+	for (std::size_t i {0}; i < color.size(); ++i) {
+		append(color[i]);
+		append(depth[i]);
+		}
+
+	// Count active pixels and fragments per run.
+	_run.active      += 1;
+	_run.fragments   += color.size();
+	_prev_active      = true;
+	}
+
+auto SparseImageWriter::finish() -> std::size_t {
+	std::memcpy(_pending.data() + _run_offset, &_run, sizeof(_run));
+
+	auto const size       {_written + _pending.size()};
+	auto const size_field {int_cast<IceTInt32>(size)};
+	auto const size_pos   {sparse_header_size_index * sizeof(IceTInt32)};
+
+	// Store the final image size in the header, which may already have been written.
+	if (_written == 0) {
+		std::memcpy(_pending.data() + size_pos, &size_field, sizeof(size_field));
+		write_binary(std::span<std::byte const>{_pending}, _out);
+		}
+	else {
+		write_binary(std::span<std::byte const>{_pending}, _out);
+		fseek(_out, _start + size_pos, SEEK_SET);
+		write_binary(std::span{&size_field, 1}, _out);
+		fseek(_out, 0, SEEK_END);
+		}
+
+	_written += _pending.size();
+	_pending.clear();
+	fflush(_out);
+	return size;
+	}
+
+auto SparseImageWriter::end_run() -> void {
+	std::memcpy(_pending.data() + _run_offset, &_run, sizeof(_run));
+
+	if (_start >= 0) {
+		write_binary(std::span<std::byte const>{_pending}, _out);
+		_written += _pending.size();
+		_pending.clear();
+		}}
+
+auto SparseImageWriter::start_run() -> void {
+	_run_offset = _pending.size();
+	_run        = {};
+	append(_run);
+	}
+
+
+namespace {
+
+/// Return the header fields of a packaged image, or throw if `data` is too small or its size field
+/// does not match.
+auto image_header(std::span<std::byte const> const data)
+		-> std::array<IceTInt32, sparse_header_size / sizeof(IceTInt32)> {
+	std::array<IceTInt32, sparse_header_size / sizeof(IceTInt32)> header;
+
+	if (data.size() < sizeof(header)) {
+		throw std::runtime_error{"Truncated image header"};
+		}
+
+	std::memcpy(header.data(), data.data(), sizeof(header));
+
+	if (header[sparse_header_size_index] < 0
+			or std::size_t(header[sparse_header_size_index]) != data.size()
+			) {
+		throw std::runtime_error{concat(
+				"Image size ", header[sparse_header_size_index], " does not match ",
+				data.size(), " bytes of data"
+				)};
+		}
+
+	if (header[3] < 0 or header[4] < 0) {
+		throw std::runtime_error{"Invalid image dimensions"};
+		}
+
+	return header;
+	}
+
+/// Return the magic number IceT stores in the header of the images `assign(buffer, 0, 0)` creates.
+template<typename TAssign>
+auto magic_number(TAssign&& assign) -> IceTInt32 {
+	std::array<std::byte, sparse_header_size + sizeof(RunLengths)> buffer {};
+	assign(buffer.data(), 0, 0);
+
+	IceTInt32 magic;
+	std::memcpy(&magic, buffer.data(), sizeof(magic));
+	return magic;
+	}
+
+} // namespace
+
+
+auto unpackage_image(std::span<std::byte> const data) -> IceTImage {
+	auto const header {image_header(data)};
+	auto const color  {static_cast<IceTEnum>(header[1])};
+	auto const depth  {static_cast<IceTEnum>(header[2])};
+
+	if (header[0] != magic_number(icetImageAssignBuffer)) {
+		throw std::runtime_error{"Not a non-layered IceT image"};
+		}
+
+	if ((color != ICET_IMAGE_COLOR_RGBA_UBYTE and color != ICET_IMAGE_COLOR_RGBA_FLOAT
+				and color != ICET_IMAGE_COLOR_NONE)
+			or (depth != ICET_IMAGE_DEPTH_FLOAT and depth != ICET_IMAGE_DEPTH_NONE)
+			) {
+		throw std::runtime_error{"Invalid image format"};
+		}
+
+	if (std::size_t(icetImageBufferSizeType(
+				color,
+				depth,
+				header[dense_header::width_index],
+				header[dense_header::height_index]
+				)) != data.size()
+			) {
+		throw std::runtime_error{"Image size does not match its dimensions"};
+		}
+
+	return icetImageUnpackageFromReceive(data.data());
+	}
+
+auto unpackage_sparse_image(std::span<std::byte> const data) -> IceTSparseImage {
+	auto const header {image_header(data)};
+
+	if (header[0] != magic_number(icetSparseLayeredImageAssignBuffer)) {
+		throw std::runtime_error{"Not a layered sparse IceT image"};
+		}
+
+	if (static_cast<IceTEnum>(header[1]) != ICET_IMAGE_COLOR_RGBA_UBYTE
+			or static_cast<IceTEnum>(header[2]) != ICET_IMAGE_DEPTH_FLOAT
+			) {
+		throw std::runtime_error{"Unsupported sparse image format"};
+		}
+
+	// Walk the runs, which must cover all pixels and end with the data.
+	auto const  num_pixels {std::size_t(header[3]) * std::size_t(header[4])};
+	std::size_t offset     {sparse_header_size};
+	std::size_t pixels     {0};
+
+	auto read = [&]<typename T>(T& value) {
+		if (data.size() - offset < sizeof(value)) {
+			throw std::runtime_error{"Truncated sparse image"};
+			}
+
+		std::memcpy(&value, data.data() + offset, sizeof(value));
+		offset += sizeof(value);
+		};
+
+	while (offset < data.size()) {
+		RunLengths run;
+		read(run);
+
+		if (run.inactive < 0 or run.active < 0
+				or num_pixels - pixels < std::size_t(run.inactive) + std::size_t(run.active)
+				) {
+			throw std::runtime_error{"Invalid run in sparse image"};
+			}
+
+		pixels += std::size_t(run.inactive) + std::size_t(run.active);
+
+		for (IceTSizeType pixel {0}; pixel < run.active; ++pixel) {
+			IceTLayerCount num_fragments;
+			read(num_fragments);
+
+			auto const size {std::size_t(num_fragments) * (sizeof(Color) + sizeof(Depth))};
+
+			if (data.size() - offset < size) {
+				throw std::runtime_error{"Truncated sparse image"};
+				}
+
+			offset += size;
+			}}
+
+	if (pixels != num_pixels) {
+		throw std::runtime_error{"Runs of sparse image do not cover all pixels"};
+		}
+
+	return icetSparseImageUnpackageFromReceive(data.data());
+	}
+
+
+namespace {
+
+/// Add run lengths to others.
+auto add_run_lengths(RunLengths& run, RunLengths const& lengths) noexcept -> void {
+	run.inactive  += lengths.inactive;
+	run.active    += lengths.active;
+	run.fragments += lengths.fragments;
+	}
+
+} // namespace
+
+
+SparseImageCompressor::SparseImageCompressor(RawImage const& image, unsigned const num_threads)
+	: SparseImageCompressor {
+		image.width(),
+		image.height(),
+		image.num_layers(),
+		{image.color(), image.depth()},
+		num_threads,
+		}
+	{}
+
+SparseImageCompressor::SparseImageCompressor(CsrImage const& image, unsigned const num_threads)
+	: SparseImageCompressor {
+		image.width(),
+		image.height(),
+		0,
+		{image.color(), image.depth(), image.offsets()},
+		num_threads,
+		}
+	{}
+
+SparseImageCompressor::SparseImageCompressor(RawImageReader& image, unsigned const num_threads)
+	: _width       {image.width()}
+	, _height      {image.height()}
+	, _num_layers  {image.num_layers()}
+	, _num_threads {num_threads}
+	{
+	// Count the bands of each band read before reading the next one.
+	for (auto band {image.next()}; not band.empty(); band = image.next()) {
+		auto const band_begin {_bands.size()};
+		add_bands(band.first_row, band.num_rows);
+
+		count(band_begin, _bands.size(), {
+				band.color,
+				band.depth,
+				{},
+				static_cast<std::size_t>(band.first_row) * static_cast<std::size_t>(_width),
+				});
+		}
+
+	// Images without rows still consist of a single empty run.
+	if (_bands.empty()) {
+		add_bands(0, 0);
+		}
+
+	locate_bands();
+	}
+
+SparseImageCompressor::SparseImageCompressor(
+		IceTSizeType const width,
+		IceTSizeType const height,
+		IceTSizeType const num_layers,
+		Fragments const    image,
+		unsigned const     num_threads
+		)
+	: _width       {width}
+	, _height      {height}
+	, _num_layers  {num_layers}
+	, _image       {image}
+	, _num_threads {num_threads}
+	{
+	add_bands(0, height);
+	count(0, _bands.size(), _image);
+	locate_bands();
+	}
+
+auto SparseImageCompressor::stats() const noexcept -> SparseImageStats {
+	return _stats;
+	}
+
+auto SparseImageCompressor::write(std::span<std::byte> const out) const -> void {
+	assert(out.size() == _stats.size);
+	write_header(out);
+
+	// Write bands in parallel, each at its own offset.
+	parallel_for(_bands.size(), 1, _num_threads, [&](
+			std::size_t const band_begin,
+			std::size_t const band_end,
+			unsigned
+			) {
+		for (auto band_idx {band_begin}; band_idx < band_end; ++band_idx) {
+			auto const& band {_bands[band_idx]};
+			write_band(band, _image, out.data() + band.offset);
+			}});
+	}
+
+auto SparseImageCompressor::write(FILE* const out) const -> void {
+	alignas(IceTInt32) std::array<std::byte, sparse_header_size + sizeof(RunLengths)> header;
+	write_header(header);
+	write_binary(std::span<std::byte const>{header}.first(sparse_header_size), out);
+
+	// Write as many bands at a time as there are threads.
+	std::vector<std::vector<std::byte>> buffers;
+
+	for (std::size_t band_begin {0}; band_begin < _bands.size(); band_begin += _num_threads) {
+		auto const band_end {std::min<std::size_t>(band_begin + _num_threads, _bands.size())};
+		write_bands(band_begin, band_end, _image, buffers, out);
+		}
+
+	fflush(out);
+	}
+
+auto SparseImageCompressor::write(RawImageReader& image, FILE* const out) const -> void {
+	assert(image.width() == _width and image.height() == _height);
+	image.rewind();
+
+	alignas(IceTInt32) std::array<std::byte, sparse_header_size + sizeof(RunLengths)> header;
+	write_header(header);
+	write_binary(std::span<std::byte const>{header}.first(sparse_header_size), out);
+
+	// Write the bands of each band read, which were added in the same order when counting.
+	std::vector<std::vector<std::byte>> buffers;
+	std::size_t                         band_begin {0};
+
+	for (auto band {image.next()}; not band.empty(); band = image.next()) {
+		auto const num_bands {std::max<std::size_t>(
+				1,
+				(static_cast<std::size_t>(band.num_rows) + band_rows - 1) / band_rows
+				)};
+
+		if (band_begin + num_bands > _bands.size()) {
+			throw std::runtime_error{"Image changed while it was compressed"};
+			}
+
+		write_bands(band_begin, band_begin + num_bands, {
+				band.color,
+				band.depth,
+				{},
+				static_cast<std::size_t>(band.first_row) * static_cast<std::size_t>(_width),
+				}, buffers, out);
+		band_begin += num_bands;
+		}
+
+	// Images without rows consist of a single band without pixels.
+	write_bands(band_begin, _bands.size(), {}, buffers, out);
+	fflush(out);
+	}
+
+auto SparseImageCompressor::add_bands(IceTSizeType const first_row, IceTSizeType const num_rows)
+		-> void {
+	auto const row_size {static_cast<std::size_t>(_width)};
+	auto const end_row  {static_cast<std::size_t>(first_row) + static_cast<std::size_t>(num_rows)};
+	auto       row      {static_cast<std::size_t>(first_row)};
+
+	do {
+		auto const next_row {std::min<std::size_t>(row + band_rows, end_row)};
+
+		_bands.push_back({.begin = row * row_size, .end = next_row * row_size});
+		row = next_row;
+		}
+	while (row < end_row);
+	}
+
+auto SparseImageCompressor::count(
+		std::size_t const band_begin,
+		std::size_t const band_end,
+		Fragments const&  fragments
+		) -> void {
+	parallel_for(band_end - band_begin, 1, _num_threads, [&](
+			std::size_t const begin_offset,
+			std::size_t const end_offset,
+			unsigned
+			) {
+		for (auto idx {begin_offset}; idx < end_offset; ++idx) {
+			auto&      band        {_bands[band_begin + idx]};
+			auto const begin       {band.begin};
+			auto const end         {band.end};
+			auto       prev_active {false};
+			auto       in_lead     {true};
+
+			for (auto pixel {begin}; pixel < end;) {
+				// Skip inactive pixels at once.
+				// A new run starts at each inactive pixel following an active one.
+				auto const num_inactive {inactive_run(fragments, pixel, end)};
+
+				if (num_inactive > 0) {
+					if (prev_active) {
+						++band.inner_runs;
+						in_lead = false;
+						}
+
+					if (in_lead) {
+						band.lead.inactive += static_cast<IceTSizeType>(num_inactive);
+						}
+
+					prev_active  = false;
+					pixel       += num_inactive;
+					continue;
+					}
+
+				auto const num_frags {num_active(fragments, pixel)};
+
+				if (in_lead) {
+					++band.lead.active;
+					band.lead.fragments += num_frags;
+					}
+
+				band.active_pixels += 1;
+				band.fragments     += num_frags;
+				band.data_size     += sizeof(IceTLayerCount)
+				                    + num_frags * (sizeof(Color) + sizeof(Depth));
+				prev_active         = true;
+				++pixel;
+				}
+
+			band.first_active = begin < end and num_active(fragments, begin) > 0;
+			band.last_active  = prev_active;
+			}});
+	}
+
+auto SparseImageCompressor::locate_bands() -> void {
+	// Compute the offset of each band's output.
+	auto offset {sparse_header_size};
+
+	for (std::size_t band_idx {0}; band_idx < _bands.size(); ++band_idx) {
+		auto& band {_bands[band_idx]};
+
+		// The first band always starts a run, others do if they continue an active pixel with an
+		// inactive one.
+		auto const leading_run {band_idx == 0
+				or (not band.first_active and _bands[band_idx - 1].last_active)};
+
+		band.runs   = band.inner_runs + leading_run;
+		band.offset = offset;
+		offset     += band.size();
+
+		_stats.active_pixels += band.active_pixels;
+		_stats.fragments     += band.fragments;
+		_stats.runs          += band.runs;
+		}
+
+	_stats.size = offset;
+
+	// Add the leading pixels of bands without a leading run to the last run of a previous band,
+	// which may cross several bands without runs of their own.
+	RunLengths continued {};
+
+	for (auto band {_bands.rbegin()}; band != _bands.rend(); ++band) {
+		if (band->runs == 0) {
+			add_run_lengths(continued, band->lead);
+			continue;
+			}
+
+		band->tail = continued;
+		continued  = band->runs == band->inner_runs ? band->lead : RunLengths{};
+		}}
+
+auto SparseImageCompressor::write_header(std::span<std::byte> const out) const -> void {
+	assert(out.size() >= sparse_header_size + sizeof(RunLengths));
+	icetSparseLayeredImageAssignBuffer(out.data(), _width, _height);
+
+	auto const size_field {int_cast<IceTInt32>(_stats.size)};
+	std::memcpy(
+			out.data() + sparse_header_size_index * sizeof(IceTInt32),
+			&size_field,
+			sizeof(size_field)
+			);
+	}
+
+auto SparseImageCompressor::write_bands(
+		std::size_t const                    band_begin,
+		std::size_t const                    band_end,
+		Fragments const&                     fragments,
+		std::vector<std::vector<std::byte>>& buffers,
+		FILE* const                          out
+		) const -> void {
+	if (buffers.size() < band_end - band_begin) {
+		buffers.resize(band_end - band_begin);
+		}
+
+	parallel_for(band_end - band_begin, 1, _num_threads, [&](
+			std::size_t const begin_offset,
+			std::size_t const end_offset,
+			unsigned
+			) {
+		for (auto idx {begin_offset}; idx < end_offset; ++idx) {
+			auto const& band {_bands[band_begin + idx]};
+
+			buffers[idx].resize(band.size());
+			write_band(band, fragments, buffers[idx].data());
+			}});
+
+	for (std::size_t idx {0}; idx < band_end - band_begin; ++idx) {
+		write_binary(std::span<std::byte const>{buffers[idx]}, out);
+		}}
+
+auto SparseImageCompressor::write_band(
+		Band const&      band,
+		Fragments const& fragments,
+		std::byte* const out
+		) const -> void {
+	auto*      pos         {out};
+	std::byte* record      {nullptr};
+	RunLengths run         {};
+	auto       prev_active {false};
+
+	auto write = [&](auto const& value) {
+		std::memcpy(pos, &value, sizeof(value));
+		pos += sizeof(value);
+		};
+
+	auto start_run = [&]() {
+		if (record) {
+			std::memcpy(record, &run, sizeof(run));
+			}
+
+		record = pos;
+		run    = {};
+		pos   += sizeof(run);
+		};
+
+	// Pixels preceding the first run of the band are part of a run of a previous band.
+	if (band.runs > band.inner_runs) {
+		start_run();
+		}
+
+	for (auto pixel {band.begin}; pixel < band.end;) {
+		// Skip inactive pixels at once.
+		if (auto const num_inactive {inactive_run(fragments, pixel, band.end)}; num_inactive > 0) {
+			if (prev_active) {
+				start_run();
+				}
+
+			run.inactive += static_cast<IceTSizeType>(num_inactive);
+			prev_active   = false;
+			pixel        += num_inactive;
+			continue;
+			}
+
+		// Copy active fragments.
+		auto const num_frags {num_active(fragments, pixel)};
+		auto const idx       {first_fragment(fragments, pixel)};
+
+		write(int_cast<IceTLayerCount>(num_frags));
+
+		for (auto frag {idx}; frag < idx + num_frags; ++frag) {
+			write(fragments.color[frag]);
+			write(fragments.depth[frag]);
+			}
+
+		run.active    += 1;
+		run.fragments += num_frags;
+		prev_active    = true;
+		++pixel;
+		}
+
+	// The last run continues with the leading pixels of following bands.
+	if (record) {
+		add_run_lengths(run, band.tail);
+		std::memcpy(record, &run, sizeof(run));
+		}
+
+	assert(pos == out + band.size());
+	}
+
+auto SparseImageCompressor::first_fragment(
+		Fragments const&  fragments,
+		std::size_t const pixel
+		) const noexcept -> std::size_t {
+	auto const local {pixel - fragments.first_pixel};
+
+	return fragments.offsets.empty()
+			? local * static_cast<std::size_t>(_num_layers)
+			: fragments.offsets[local] - fragments.offsets.front();
+	}
+
+auto SparseImageCompressor::num_active(
+		Fragments const&  fragments,
+		std::size_t const pixel
+		) const noexcept -> std::size_t {
+	auto const local {pixel - fragments.first_pixel};
+
+	if (not fragments.offsets.empty()) {
+		return fragments.offsets[local + 1] - fragments.offsets[local];
+		}
+
+	auto const num_layers {static_cast<std::size_t>(_num_layers)};
+	return simd::count_active(fragments.color.subspan(local * num_layers, num_layers));
+	}
+
+auto SparseImageCompressor::inactive_run(
+		Fragments const&  fragments,
+		std::size_t const begin,
+		std::size_t const end
+		) const noexcept -> std::size_t {
+	auto const local_begin {begin - fragments.first_pixel};
+	auto const local_end   {end - fragments.first_pixel};
+
+	// Packed pixels are inactive if they start where the next pixel does.
+	if (not fragments.offsets.empty()) {
+		auto pixel {local_begin};
+
+		while (pixel < local_end and fragments.offsets[pixel + 1] == fragments.offsets[pixel]) {
+			++pixel;
+			}
+
+		return pixel - local_begin;
+		}
+
+	auto const num_layers {static_cast<std::size_t>(_num_layers)};
+
+	// Images without layers consist only of inactive pixels.
+	if (num_layers == 0) {
+		return end - begin;
+		}
+
+	auto const num_pixels {local_end - local_begin};
+
+	return simd::inactive_run(
+			fragments.color.subspan(local_begin * num_layers, num_pixels * num_layers),
+			_num_layers
+			);
 	}
 
 } // namespace layered_icet
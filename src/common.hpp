@@ -1,16 +1,25 @@
 #pragma once
 
+#include <algorithm>
 #include <array>
+#include <atomic>
 #include <concepts>
+#include <condition_variable>
 #include <cstdint>
+#include <deque>
 #include <exception>
+#include <future>
 #include <iostream>
 #include <limits>
 #include <memory>
+#include <mutex>
+#include <optional>
 #include <span>
 #include <sstream>
 #include <stdexcept>
 #include <string_view>
+#include <thread>
+#include <sys/mman.h>
 #include <unistd.h>
 #include <utility>
 #include <vector>
@@ -20,6 +29,7 @@
 #include <IceTDevImage.h>
 #include <IceTMPI.h>
 
+#include <png.h>
 #include <png.hpp>
 
 
@@ -158,6 +168,35 @@ struct Environment : Handle<
 
 	};
 
+/// RAII handle for an MPI communicator created by this program.
+class Communicator : public Handle<
+		MPI_Comm,
+		decltype([](MPI_Comm&& com) {
+			if (com != MPI_Comm{} and com != MPI_COMM_NULL) {
+				MPI_Comm_free(&com);
+				}})
+		> {
+public:
+	[[nodiscard]] Communicator() noexcept = default;
+
+	/// Split `parent` into disjoint communicators, one for each `color` given by its processes,
+	/// ordered by `key`.
+	/// Processes passing `MPI_UNDEFINED` as their color receive an empty communicator.
+	/// Collective over `parent`.
+	[[nodiscard]] static auto split(MPI_Comm const& parent, int color, int key) -> Communicator;
+
+	/// Return whether this process is a member of the communicator.
+	[[nodiscard]] explicit operator bool() const noexcept {
+		return _handle != MPI_Comm{} and _handle != MPI_COMM_NULL;
+		}
+
+private:
+	[[nodiscard]] explicit Communicator(MPI_Comm&& com) noexcept
+		: Handle{std::move(com)}
+		{}
+
+	};
+
 } // namespace mpi
 
 
@@ -191,21 +230,212 @@ public:
 } // namespace icet
 
 
+/// Convenience wrappers for POSIX.
+namespace posix {
+
+/// A page-aligned memory mapping together with the offset of the data of interest within it.
+struct MappedRegion {
+	std::byte*  base   {nullptr};
+	std::size_t length {0};
+	std::size_t offset {0};
+
+	[[nodiscard]] constexpr auto operator==(MappedRegion const&) const noexcept -> bool = default;
+	};
+
+/// RAII handle for a read-only memory mapping of a file.
+class MappedFile : public Handle<
+		MappedRegion,
+		decltype([](MappedRegion&& region) {
+			if (region.base) {
+				munmap(region.base, region.length);
+				}})
+		> {
+public:
+	[[nodiscard]] MappedFile() noexcept = default;
+
+	/// Map the remainder of a file, starting at its current position, and advise the kernel that
+	/// it will be read sequentially.
+	/// Returns an empty mapping if the file cannot be mapped, e.g. because it is a pipe.
+	[[nodiscard]] static auto map(FILE* file) noexcept -> MappedFile;
+
+	/// Return whether a file is currently mapped.
+	[[nodiscard]] constexpr explicit operator bool() const noexcept {
+		return _handle.base != nullptr;
+		}
+
+	/// Return the mapped contents of the file.
+	[[nodiscard]] constexpr auto bytes() const noexcept -> std::span<std::byte const> {
+		return {_handle.base + _handle.offset, _handle.length - _handle.offset};
+		}
+
+private:
+	[[nodiscard]] explicit MappedFile(MappedRegion&& region) noexcept
+		: Handle{std::move(region)}
+		{}
+
+	};
+
+/// A file descriptor, which is invalid if negative.
+struct Descriptor {
+	int fd {-1};
+
+	[[nodiscard]] constexpr auto operator==(Descriptor const&) const noexcept -> bool = default;
+	};
+
+/// RAII handle for a file descriptor, such as a socket.
+class FileDescriptor : public Handle<
+		Descriptor,
+		decltype([](Descriptor&& descriptor) {
+			if (descriptor.fd >= 0) {
+				close(descriptor.fd);
+				}})
+		> {
+public:
+	[[nodiscard]] FileDescriptor() noexcept = default;
+
+	/// Take ownership of a file descriptor.
+	[[nodiscard]] explicit FileDescriptor(int const fd) noexcept
+		: Handle{Descriptor{fd}}
+		{}
+
+	/// Return whether the descriptor is valid.
+	[[nodiscard]] constexpr explicit operator bool() const noexcept {
+		return _handle.fd >= 0;
+		}
+
+	[[nodiscard]] constexpr auto fd() const noexcept -> int {
+		return _handle.fd;
+		}
+
+	};
+
+/// Write all of `bytes` at `offset` of file `fd` with `pwrite`, which neither uses nor moves the
+/// file position, so processes can write disjoint parts of a shared file concurrently.
+auto write_at(int fd, std::span<std::byte const> bytes, off_t offset) -> void;
+
+} // namespace posix
+
+
+/// Accounting of memory use, to tell which data is responsible for running out of memory.
+namespace memory {
+
+/// Return the resident set size of this process in bytes, or 0 if it is unknown.
+[[nodiscard]] auto rss() noexcept -> std::size_t;
+
+/// Return the highest resident set size of this process so far in bytes.
+[[nodiscard]] auto peak_rss() noexcept -> std::size_t;
+
+/// Return the number of bytes currently held by image buffers and `UniqueSpan`s.
+/// Memory-mapped files are not included.
+[[nodiscard]] auto image_bytes() noexcept -> std::size_t;
+
+/// Return the highest value of `image_bytes()` so far.
+[[nodiscard]] auto peak_image_bytes() noexcept -> std::size_t;
+
+/// Return the number of bytes of all state variables of the current IceT context, including its
+/// internal image buffers.
+/// Requires a current IceT context.
+[[nodiscard]] auto icet_state_bytes() noexcept -> std::size_t;
+
+/// Return `icet_state_bytes()` and raise `peak_icet_state_bytes()` to it.
+/// Called after IceT operations which allocate buffers, since their state is largest then.
+auto record_icet_state_bytes() noexcept -> std::size_t;
+
+/// Return the highest value recorded by `record_icet_state_bytes()` so far.
+[[nodiscard]] auto peak_icet_state_bytes() noexcept -> std::size_t;
+
+/// Print a summary of peak memory use at info level.
+auto print_summary(std::ostream& out) -> void;
+
+/// Counts a number of bytes towards `image_bytes()` for as long as it exists.
+class Tracker {
+public:
+	[[nodiscard]] Tracker() noexcept = default;
+
+	[[nodiscard]] explicit Tracker(std::size_t const bytes) noexcept {
+		set(bytes);
+		}
+
+	[[nodiscard]] Tracker(Tracker&& other) noexcept
+		: _bytes {std::exchange(other._bytes, 0)}
+		{}
+
+	auto operator=(Tracker&& other) noexcept -> Tracker& {
+		auto const bytes {std::exchange(other._bytes, 0)};
+		set(0);
+		_bytes = bytes;
+		return *this;
+		}
+
+	~Tracker() {
+		set(0);
+		}
+
+	/// Change the number of bytes counted.
+	auto set(std::size_t bytes) noexcept -> void;
+
+private:
+	std::size_t _bytes {0};
+	};
+
+} // namespace memory
+
+
 /// Wraps a main function with pretty printing for exceptions.
+/// Prints a summary of memory use on exit.
 template<typename Fn>
 	requires std::is_invocable_r_v<int, Fn>
 auto try_main(Fn&& fn) -> int {
+	auto result {EXIT_FAILURE};
+
 	try {
-		return fn();
+		result = fn();
 		}
 	catch (std::exception const& error) {
 		std::cerr << log_sev_fatal << error.what() << "\n";
-		return EXIT_FAILURE;
 		}
 	catch (...) {
 		std::cerr << log_sev_fatal << "Unknown error\n";
-		return EXIT_FAILURE;
-		}}
+		}
+
+	memory::print_summary(std::cerr);
+	return result;
+	}
+
+
+/// Apply the basic configuration shared by all tools to the current IceT context.
+auto configure_icet() -> void;
+
+
+/// An IceT context over a group of processes, which is configured by `configure_icet()` and
+/// current after construction.
+class Group {
+public:
+	/// Create a context over the processes of `com`, of which this process must be a member.
+	[[nodiscard]] explicit Group(MPI_Comm const& com);
+
+	Group(Group const&) = delete;
+	auto operator=(Group const&) = delete;
+
+	/// Return the number of processes in the group.
+	[[nodiscard]] auto num_procs() const noexcept -> int {
+		return _com_size;
+		}
+
+	/// Return the rank of this process within the group.
+	[[nodiscard]] auto proc_rank() const noexcept -> int {
+		return _com_rank;
+		}
+
+	/// Make this group's IceT context the current one.
+	auto activate() const noexcept -> void;
+
+private:
+	icet::Communicator _com;
+	icet::Context      _icet;
+	int                _com_size {icetCommSize()};
+	int                _com_rank {icetCommRank()};
+	};
 
 
 /// Provides a basic environment setup for programs using IceT.
@@ -215,12 +445,17 @@ public:
 
 	/// Return the number of processes in the global MPI communicator.
 	[[nodiscard]] auto num_procs() const noexcept -> int {
-		return _com_size;
+		return _world.num_procs();
 		}
 
 	/// Return the rank of this process within the global MPI communicator.
 	[[nodiscard]] auto proc_rank() const noexcept -> int {
-		return _com_rank;
+		return _world.proc_rank();
+		}
+
+	/// Return the group of all processes.
+	[[nodiscard]] auto world() const noexcept -> Group const& {
+		return _world;
 		}
 
 	/// Return a file descriptor referring to `stdout` at the time of construction.
@@ -229,19 +464,20 @@ public:
 		}
 
 	/// Redirect `stdout` to `stderr` so IceT's debug messages do not interfere with output data.
-	/// Called on construction.
+	/// Done on construction, before IceT is configured.
 	auto stdout_to_stderr() noexcept -> void;
 
 	/// Replace `stdout` with its original file.
 	auto restore_stdout() noexcept -> void;
 
 private:
-	mpi::Environment   _mpi;
-	icet::Communicator _com      {MPI_COMM_WORLD};
-	icet::Context      _icet     {_com};
-	int                _com_size {icetCommSize()};
-	int                _com_rank {icetCommRank()};
-	int                _stdout   {STDOUT_FILENO};
+	/// Redirect `stdout` to `stderr` and return a file descriptor referring to its original file.
+	[[nodiscard]] static auto redirect_stdout() noexcept -> int;
+
+	// `stdout` is redirected before `_world` configures IceT, whose diagnostics go to `stdout`.
+	mpi::Environment _mpi;
+	int              _stdout {STDOUT_FILENO};
+	Group            _world  {MPI_COMM_WORLD};
 	};
 
 
@@ -249,9 +485,10 @@ private:
 template<typename TElem>
 class UniqueSpan {
 public:
-	[[nodiscard]] constexpr UniqueSpan(std::size_t length)
-		: _data   {std::make_unique<TElem[]>(length)}
-		, _length {length}
+	[[nodiscard]] UniqueSpan(std::size_t length)
+		: _data    {std::make_unique<TElem[]>(length)}
+		, _length  {length}
+		, _tracker {length * sizeof(TElem)}
 		{}
 
 	[[nodiscard]] constexpr auto data() const noexcept -> TElem* {
@@ -265,9 +502,64 @@ public:
 private:
 	std::unique_ptr<TElem[]> _data;
 	std::size_t              _length;
+	memory::Tracker          _tracker;
 	};
 
 
+/// Return the number of threads to use unless specified otherwise.
+[[nodiscard]] auto default_num_threads() noexcept -> unsigned;
+
+/// Process the indices `[0, count)` in blocks on up to `num_threads` threads, including the calling
+/// one.
+/// Blocks are handed out dynamically. Each call `fn(begin, end, thread_idx)` receives the index of
+/// the thread it runs on, which can be used to select per-thread scratch memory.
+/// Rethrows the first exception thrown by `fn` once all threads have stopped.
+template<typename TFn>
+	requires std::invocable<TFn&, std::size_t, std::size_t, unsigned>
+auto parallel_for(
+		std::size_t const count,
+		std::size_t const block_size,
+		unsigned const    num_threads,
+		TFn&&             fn
+		) -> void {
+	auto const num_blocks {(count + block_size - 1) / block_size};
+
+	std::atomic<std::size_t>        next_block {0};
+	std::vector<std::exception_ptr> errors     (std::clamp<std::size_t>(
+			num_threads,
+			1,
+			std::max<std::size_t>(num_blocks, 1)
+			));
+
+	auto work = [&](unsigned const thread_idx) {
+		try {
+			for (auto block {next_block++}; block < num_blocks; block = next_block++) {
+				fn(block * block_size, std::min(count, (block + 1) * block_size), thread_idx);
+				}}
+		catch (...) {
+			// Stop handing out blocks.
+			errors[thread_idx] = std::current_exception();
+			next_block         = num_blocks;
+			}};
+
+	// Threads are joined at the end of this scope.
+	{
+		std::vector<std::jthread> threads;
+		threads.reserve(errors.size() - 1);
+
+		for (unsigned thread_idx {1}; thread_idx < errors.size(); ++thread_idx) {
+			threads.emplace_back(work, thread_idx);
+			}
+
+		work(0);
+		}
+
+	for (auto const& error : errors) {
+		if (error) {
+			std::rethrow_exception(error);
+			}}}
+
+
 /// Read the entire contents of a binary file into a buffer.
 [[nodiscard]] auto read_all(FILE* in, std::size_t size_hint = 256) -> std::vector<std::byte>;
 
@@ -286,35 +578,239 @@ auto write_image(IceTImage, FILE* out) -> void;
 auto write_image(IceTSparseImage, FILE* out) -> void;
 
 
+/// Header of a self-describing layered frame file.
+/// The header is followed by an optional index of row bands, then by the color and depth sections
+/// in the same layout as in headerless files.
+/// All offsets are in bytes relative to the start of the header.
+struct FrameHeader {
+	using Magic = std::array<char, 8>;
+
+	static constexpr Magic         magic_value     {'L', 'I', 'C', 'E', 'T', 'F', 'R', 'M'};
+	static constexpr std::uint32_t current_version {1};
+
+	Magic         magic        {magic_value};
+	std::uint32_t version      {current_version};
+	/// Size of this header, so later versions can extend it.
+	std::uint32_t header_size  {sizeof(FrameHeader)};
+	std::int32_t  width        {0};
+	std::int32_t  height       {0};
+	std::int32_t  num_layers   {0};
+	std::uint32_t color_format {ICET_IMAGE_COLOR_RGBA_UBYTE};
+	std::uint32_t depth_format {ICET_IMAGE_DEPTH_FLOAT};
+	/// Number of rows per band in the index, or 0 if there is no index.
+	std::int32_t  band_height  {0};
+	std::uint64_t color_offset {0};
+	std::uint64_t depth_offset {0};
+	};
+
+static_assert(sizeof(FrameHeader) % alignof(std::uint64_t) == 0);
+
+/// Index entry for a band of rows in a layered frame file.
+struct FrameBand {
+	std::uint64_t color_offset {0};
+	std::uint64_t depth_offset {0};
+	};
+
+/// Default number of rows per band in the index of written frame files.
+constexpr IceTSizeType default_band_height {64};
+
+/// The metadata of a self-describing layered frame file.
+struct FrameInfo {
+	FrameHeader            header {};
+	std::vector<FrameBand> bands  {};
+
+	/// Describe a frame of the given size, indexed in bands of `band_height` rows if non-zero.
+	[[nodiscard]] static auto describe(
+			IceTSizeType width,
+			IceTSizeType height,
+			IceTSizeType num_layers,
+			IceTSizeType band_height = default_band_height
+			) -> FrameInfo;
+
+	/// Read a header and band index from the current position of a file and validate them.
+	/// If the file does not start with a header, the bytes consumed while looking for one are
+	/// stored in `consumed`, unless the file is seekable, in which case its position is restored.
+	[[nodiscard]] static auto read(FILE* in, std::vector<std::byte>& consumed)
+			-> std::optional<FrameInfo>;
+
+	/// Return whether a seekable file starts with a header, without changing its position.
+	[[nodiscard]] static auto probe(FILE* in) -> bool;
+
+	/// Write header and band index to a binary file.
+	auto write(FILE* out) const -> void;
+
+	[[nodiscard]] constexpr auto num_fragments() const noexcept -> std::uint64_t {
+		return std::uint64_t{static_cast<std::uint32_t>(header.width)}
+		     * static_cast<std::uint32_t>(header.height)
+		     * static_cast<std::uint32_t>(header.num_layers);
+		}
+
+	/// Return the size of the header and band index.
+	[[nodiscard]] constexpr auto metadata_size() const noexcept -> std::uint64_t {
+		return header.header_size + bands.size() * sizeof(FrameBand);
+		}
+
+	/// Return the offset of the first color and depth fragment of a row.
+	/// Uses the band index if present.
+	[[nodiscard]] auto row_offsets(IceTSizeType row) const noexcept -> FrameBand;
+
+	/// Return the total size of the file.
+	[[nodiscard]] constexpr auto file_size() const noexcept -> std::uint64_t {
+		return header.depth_offset + num_fragments() * sizeof(Depth);
+		}
+
+	};
+
+
+/// Reads a PNG file row by row, converted to 8 bit RGBA.
+/// Interlaced images are decoded entirely on the first read, since each pass refines every row.
+class PngReader {
+public:
+	/// Open a file and read its header.
+	[[nodiscard]] explicit PngReader(char const* path);
+
+	PngReader(PngReader const&) = delete;
+	auto operator=(PngReader const&) = delete;
+
+	~PngReader() noexcept;
+
+
+	[[nodiscard]] auto width() const noexcept -> IceTSizeType;
+	[[nodiscard]] auto height() const noexcept -> IceTSizeType;
+
+	/// Return the next row of `width()` colors, which remains valid until the next call.
+	[[nodiscard]] auto next_row() -> std::span<Color>;
+
+private:
+	char const*        _path       {nullptr};
+	FILE*              _file       {nullptr};
+	png_structp        _png        {nullptr};
+	png_infop          _info       {nullptr};
+	int                _num_passes {1};
+	std::vector<Color> _rows       {};
+	IceTSizeType       _next_row   {0};
+
+	/// Allocate decoder state without throwing, so the destructor releases it if reading fails.
+	[[nodiscard]] PngReader(char const* path, FILE* file) noexcept;
+
+	/// Report libpng errors as exceptions.
+	[[noreturn]] static auto raise(png_structp png, png_const_charp msg) -> void;
+
+	/// Ignore libpng warnings.
+	static auto warn(png_structp png, png_const_charp msg) noexcept -> void;
+
+	};
+
+
 /// Defines input required to construct a layer.
 struct InputLayer {
 	char const* path;
 	Depth       depth;
 	};
 
+/// Decodes the layers of an image from PNG files in bands of rows.
+/// Fragments are scaled by their alpha value, and stored in a dense band in which the fragment of
+/// each layer is at the same index of each pixel, so inactive fragments are zero and interleaved
+/// with active ones.
+class LayeredPngReader {
+public:
+	/// Open each layer, which are cropped or padded to `width` by `height` pixels.
+	[[nodiscard]] LayeredPngReader(
+			IceTSizeType                width,
+			IceTSizeType                height,
+			std::span<InputLayer const> layers
+			);
+
+	/// Decode the next `num_rows` rows of each layer in parallel on up to `num_threads` threads and
+	/// return their fragments, which remain valid until the next call.
+	[[nodiscard]] auto next_band(IceTSizeType num_rows, unsigned num_threads = 1)
+			-> std::span<Color const>;
+
+private:
+	IceTSizeType                          _width    {0};
+	IceTSizeType                          _height   {0};
+	IceTSizeType                          _next_row {0};
+	std::vector<std::optional<PngReader>> _pngs     {};
+	std::vector<Color>                    _band     {};
+
+	};
+
 /// A raw layered image.
 /// Can be written to and read from a file.
+/// Images read from regular files are memory-mapped rather than copied, so they are read-only and
+/// can only be moved, not copied.
 class RawImage {
 public:
 	[[nodiscard]] RawImage() noexcept = default;
 
 	/// Build an image by layering PNGs.
 	/// Scales each fragment's color by its alpha value.
+	/// Layers are decoded row by row in parallel on up to `num_threads` threads, and the active
+	/// fragments of each pixel are stored in the order of their layers.
 	[[nodiscard]] RawImage(
 			IceTSizeType                width,
 			IceTSizeType                height,
-			std::span<InputLayer const> layers
+			std::span<InputLayer const> layers,
+			unsigned                    num_threads = 1
 			);
 	/// Merge multiple layered images into a single one.
-	/// The fragment lists of each pixel are merged in order of depth.
+	/// The fragment lists of each pixel, which must be sorted by depth, are merged in order of
+	/// depth. Fragments of equal depth are ordered by the index of their source image.
+	/// Blocks of rows are merged in parallel on up to `num_threads` threads.
 	[[nodiscard]] RawImage(
 			IceTSizeType              width,
 			IceTSizeType              height,
-			std::span<RawImage const> sources
+			std::span<RawImage const> sources,
+			unsigned                  num_threads = 1
+			);
+	/// Build an image by calling `fill(pixel, color, depth)` for each pixel with spans of its
+	/// `num_layers` zero-initialized fragments.
+	template<typename TFill>
+		requires std::invocable<TFill&, IceTSizeType, std::span<Color>, std::span<Depth>>
+	[[nodiscard]] RawImage(
+			IceTSizeType const width,
+			IceTSizeType const height,
+			IceTSizeType const num_layers,
+			TFill&&            fill
+			)
+		: _width      {width}
+		, _height     {height}
+		, _num_layers {num_layers}
+		{
+		allocate();
+
+		auto const layers {static_cast<std::size_t>(num_layers)};
+
+		for (IceTSizeType pixel {0}; pixel < num_pixels(); ++pixel) {
+			fill(
+					pixel,
+					std::span{&color_buffer(pixel * layers), layers},
+					std::span{&depth_buffer(pixel * layers), layers}
+					);
+			}}
+	/// Take ownership of a buffer containing the color buffer followed by the depth buffer, which
+	/// must hold exactly `num_layers` fragments per pixel.
+	[[nodiscard]] RawImage(
+			IceTSizeType             width,
+			IceTSizeType             height,
+			IceTSizeType             num_layers,
+			std::vector<std::byte>&& buffer
 			);
 	/// Read an image from a file containing the color buffer followed by the depth buffer.
+	/// Files starting with a `FrameHeader` describe their own size, in which case `width` and
+	/// `height` may be 0, otherwise they must match.
 	[[nodiscard]] RawImage(IceTSizeType width, IceTSizeType height, FILE* in);
+	/// Read a headerless image from a file containing the color buffer followed by the depth
+	/// buffer, of which the first bytes have already been read into `prefix`.
+	[[nodiscard]] RawImage(
+			IceTSizeType             width,
+			IceTSizeType             height,
+			FILE*                    in,
+			std::vector<std::byte>&& prefix
+			);
 	/// Read an image from separate color and depth buffer files.
+	/// If the color file starts with a `FrameHeader`, it contains the depth buffer as well and
+	/// `depth_file` is ignored.
 	[[nodiscard]] RawImage(
 			IceTSizeType width,
 			IceTSizeType height,
@@ -334,11 +830,8 @@ public:
 		return _num_layers;
 		}
 
-	[[nodiscard]] auto color() const noexcept -> std::span<Color const> {
-		return {
-				reinterpret_cast<Color const*>(_buffer.data()),
-				static_cast<std::size_t>(num_fragments())
-				};
+	[[nodiscard]] constexpr auto color() const noexcept -> std::span<Color const> {
+		return {_color_buffer, static_cast<std::size_t>(num_fragments())};
 		}
 
 	[[nodiscard]] constexpr auto depth() const noexcept -> std::span<Depth const> {
@@ -353,20 +846,465 @@ public:
 		return num_pixels() * _num_layers;
 		}
 
-	/// Write dimensions and fragment data to a binary file.
-	auto write(FILE* out) const -> void;
+	/// Write a `FrameHeader`, band index and fragment data to a binary file.
+	auto write(FILE* out, IceTSizeType band_height = default_band_height) const -> void;
 
 private:
 	IceTSizeType           _width        {0};
 	IceTSizeType           _height       {0};
 	IceTSizeType           _num_layers   {0};
 	std::vector<std::byte> _buffer       {};
-	Depth*                 _depth_buffer {nullptr};
+	posix::MappedFile      _color_file   {};
+	posix::MappedFile      _depth_file   {};
+	Color const*           _color_buffer {nullptr};
+	Depth const*           _depth_buffer {nullptr};
+	memory::Tracker        _tracker      {};
+
+	/// Allocate a zeroed buffer for all fragments and use it for both color and depth.
+	auto allocate() -> void;
+
+	/// Count the buffer towards `memory::image_bytes()` after it changed.
+	auto track() noexcept -> void {
+		_tracker.set(_buffer.capacity());
+		}
+
+	/// Load color and depth sections described by a header from the current position of a file.
+	auto load(FrameInfo const& info, FILE* in) -> void;
+
+	/// Load a headerless image containing both color and depth from a file, of which `prefix`
+	/// has already been read.
+	auto load(FILE* in, std::vector<std::byte>&& prefix) -> void;
+
+	/// Decode an image encoded by `codec::encode`, which must match the expected size if given.
+	auto load_encoded(std::span<std::byte const> data) -> void;
+
+	/// Load a headerless buffer from a file and return its contents, of which `prefix` has
+	/// already been read.
+	[[nodiscard]] auto load_headerless(FILE* in, std::vector<std::byte>&& prefix, std::size_t size_hint)
+			-> std::span<std::byte const>;
 
 	[[nodiscard]] auto color_buffer(std::size_t idx = 0) noexcept -> Color& {
 		return reinterpret_cast<Color*>(_buffer.data())[idx];
 		}
 
+	[[nodiscard]] auto depth_buffer(std::size_t idx = 0) noexcept -> Depth& {
+		return reinterpret_cast<Depth*>(_buffer.data() + num_fragments() * sizeof(Color))[idx];
+		}
+
+	};
+
+
+/// A layered image storing only active fragments, packed pixel by pixel in compressed sparse row
+/// form.
+/// The fragments of pixel `i` are those at indices `offsets()[i]` up to `offsets()[i + 1]` of
+/// `color()` and `depth()`, ordered as in a `RawImage`, so memory use and the time taken to scan
+/// the image depend on the number of active fragments rather than the maximum number of layers.
+class CsrImage {
+public:
+	[[nodiscard]] CsrImage() noexcept = default;
+
+	/// Build an image by layering PNGs like the corresponding `RawImage` constructor, without
+	/// allocating a fragment for each layer of each pixel.
+	/// Bands of rows of all layers are decoded in parallel on up to `num_threads` threads.
+	[[nodiscard]] CsrImage(
+			IceTSizeType                width,
+			IceTSizeType                height,
+			std::span<InputLayer const> layers,
+			unsigned                    num_threads = 1
+			);
+	/// Merge multiple layered images into a single one like the corresponding `RawImage`
+	/// constructor.
+	[[nodiscard]] CsrImage(
+			IceTSizeType              width,
+			IceTSizeType              height,
+			std::span<CsrImage const> sources,
+			unsigned                  num_threads = 1
+			);
+	/// Pack the active fragments of a dense image.
+	[[nodiscard]] explicit CsrImage(RawImage const& image, unsigned num_threads = 1);
+
+	/// Unpack the image into a dense one with `num_layers` fragments per pixel, which must be at
+	/// least `max_fragments()`, or exactly that many if `num_layers` is 0.
+	[[nodiscard]] auto to_raw(IceTSizeType num_layers = 0) const -> RawImage;
+
+	[[nodiscard]] constexpr auto width() const noexcept -> IceTSizeType {
+		return _width;
+		}
+
+	[[nodiscard]] constexpr auto height() const noexcept -> IceTSizeType {
+		return _height;
+		}
+
+	[[nodiscard]] constexpr auto num_pixels() const noexcept -> IceTSizeType {
+		return _width * _height;
+		}
+
+	/// Return the number of active fragments.
+	[[nodiscard]] auto num_fragments() const noexcept -> std::size_t {
+		return _color.size();
+		}
+
+	/// Return the largest number of active fragments of any pixel.
+	[[nodiscard]] auto max_fragments() const noexcept -> std::size_t;
+
+	/// Return the offset of each pixel's fragments, followed by the number of fragments.
+	[[nodiscard]] auto offsets() const noexcept -> std::span<std::size_t const> {
+		return _offsets;
+		}
+
+	[[nodiscard]] auto color() const noexcept -> std::span<Color const> {
+		return _color;
+		}
+
+	[[nodiscard]] auto depth() const noexcept -> std::span<Depth const> {
+		return _depth;
+		}
+
+	/// Return the number of bytes occupied by the offsets and fragments.
+	[[nodiscard]] auto size_bytes() const noexcept -> std::size_t {
+		return _offsets.size() * sizeof(std::size_t)
+		     + _color.size()   * (sizeof(Color) + sizeof(Depth));
+		}
+
+private:
+	IceTSizeType             _width   {0};
+	IceTSizeType             _height  {0};
+	std::vector<std::size_t> _offsets {0};
+	std::vector<Color>       _color   {};
+	std::vector<Depth>       _depth   {};
+	memory::Tracker          _tracker {};
+
+	/// Count the memory allocated for offsets and fragments towards `memory::image_bytes()`.
+	auto track() noexcept -> void;
+
+	/// Set `offsets()` from the number of fragments of each pixel, which
+	/// `count(begin, end, counts)` stores for ranges of pixels in parallel, then allocate the
+	/// fragments.
+	template<typename TCount>
+	auto allocate(TCount&& count, unsigned num_threads) -> void;
+
+	};
+
+
+/// A band of consecutive rows of a layered image.
+struct RowBand {
+	IceTSizeType           first_row {0};
+	IceTSizeType           num_rows  {0};
+	std::span<Color const> color     {};
+	std::span<Depth const> depth     {};
+
+	[[nodiscard]] constexpr auto empty() const noexcept -> bool {
+		return num_rows == 0;
+		}
+
+	};
+
+/// Reads a layered image in bands of rows, so only a bounded amount of data is held in memory.
+/// Seekable files are read band by band by a single background thread, which reads at most one band
+/// ahead of the one being processed.
+/// Other files are streamed as well if depth data is not required and they start with a
+/// `FrameHeader`, otherwise they are read entirely.
+class RawImageReader {
+public:
+	/// Prepare reading an image from a file in the same format as `RawImage` expects.
+	/// If `read_depth` is false, bands do not contain depth data.
+	[[nodiscard]] RawImageReader(
+			IceTSizeType width,
+			IceTSizeType height,
+			FILE*        in,
+			bool         read_depth  = true,
+			IceTSizeType band_height = default_band_height
+			);
+
+	RawImageReader(RawImageReader const&) = delete;
+	auto operator=(RawImageReader const&) = delete;
+
+	[[nodiscard]] constexpr auto width() const noexcept -> IceTSizeType {
+		return _info.header.width;
+		}
+
+	[[nodiscard]] constexpr auto height() const noexcept -> IceTSizeType {
+		return _info.header.height;
+		}
+
+	[[nodiscard]] constexpr auto num_layers() const noexcept -> IceTSizeType {
+		return _info.header.num_layers;
+		}
+
+	/// Return the next band of rows, or an empty band after the last one.
+	/// The returned band remains valid until the next call.
+	[[nodiscard]] auto next() -> RowBand;
+
+	/// Return to the first band, so the image can be read again.
+	/// Streamed images can only be read once, which never happens if depth data is read.
+	auto rewind() -> void;
+
+private:
+	enum class Source : uint8_t {
+		/// Bands are read from arbitrary positions of a seekable file.
+		positional,
+		/// Bands are read in order from a stream.
+		sequential,
+		/// The whole image has been loaded.
+		resident,
+		};
+
+	/// A band read by the background thread, together with the buffer holding its data.
+	struct ReadBand {
+		RowBand                band   {};
+		std::vector<std::byte> buffer {};
+		};
+
+	/// Maximum number of bands read, but not returned yet.
+	static constexpr std::size_t read_ahead {1};
+
+	FILE*                               _in          {nullptr};
+	Source                              _source      {Source::positional};
+	FrameInfo                           _info        {};
+	long                                _start       {0};
+	bool                                _read_depth  {true};
+	IceTSizeType                        _band_height {default_band_height};
+	IceTSizeType                        _next_row    {0};
+	RawImage                            _resident    {};
+	std::mutex                          _mutex       {};
+	std::condition_variable_any         _cond        {};
+	std::deque<ReadBand>                _ready       {};
+	/// Buffers of returned bands, which the background thread reuses.
+	std::vector<std::vector<std::byte>> _free        {};
+	/// Buffer of the band returned last.
+	std::vector<std::byte>              _current     {};
+	std::exception_ptr                  _error       {};
+	/// Declared last, so the thread stops before the state it uses is destroyed.
+	std::jthread                        _thread      {};
+
+	/// Read bands in order starting at a row, until all are read or `stop` is requested.
+	auto read_bands(IceTSizeType first_row, std::stop_token stop) -> void;
+
+	/// Read the band starting at a row into a buffer.
+	[[nodiscard]] auto read(IceTSizeType first_row, std::vector<std::byte>& buffer) -> RowBand;
+
+	};
+
+
+/// Size of the header of an `IceTSparseImage`.
+constexpr std::size_t sparse_header_size       {7 * sizeof(IceTInt32)};
+/// Index of the header field holding the size of an `IceTSparseImage` in bytes.
+constexpr std::size_t sparse_header_size_index {6};
+
+/// Fields of the header of a dense `IceTImage`, in units of `IceTInt32`.
+namespace dense_header {
+
+/// Index of the field holding the width in pixels.
+constexpr std::size_t width_index      {3};
+/// Index of the field holding the height in pixels.
+constexpr std::size_t height_index     {4};
+/// Index of the field holding the maximum number of pixels.
+constexpr std::size_t max_pixels_index {5};
+/// Index of the field holding the size of the image in bytes.
+constexpr std::size_t size_index       {6};
+/// Number of fields.
+constexpr std::size_t num_fields       {7};
+
+} // namespace dense_header
+
+/// A set of run lengths in a layered `IceTSparseImage`.
+struct RunLengths {
+	IceTSizeType inactive  {0};
+	IceTSizeType active    {0};
+	IceTSizeType fragments {0};
+	};
+
+/// Return the non-layered `IceTImage` packaged in `data`, or throw if its header does not
+/// describe such an image of exactly the size of `data`.
+[[nodiscard]] auto unpackage_image(std::span<std::byte> data) -> IceTImage;
+
+/// Return the layered `IceTSparseImage` packaged in `data`, or throw if its header does not
+/// describe such an image of exactly the size of `data`, or its runs do not cover its pixels
+/// within `data`.
+[[nodiscard]] auto unpackage_sparse_image(std::span<std::byte> data) -> IceTSparseImage;
+
+/// Writes a layered `IceTSparseImage` to a binary file pixel by pixel, without allocating the
+/// whole image.
+/// Each run is buffered until the next one starts, since its lengths precede its data.
+/// If the file is not seekable, the whole image is buffered, since its size precedes the runs.
+class SparseImageWriter {
+public:
+	[[nodiscard]] SparseImageWriter(IceTSizeType width, IceTSizeType height, FILE* out);
+
+	/// Append inactive pixels.
+	auto push_inactive(IceTSizeType count = 1) -> void;
+
+	/// Append an active pixel consisting of the given fragments.
+	auto push_active(std::span<Color const> color, std::span<Depth const> depth) -> void;
+
+	/// Write all remaining data, then the final image size, and return that size.
+	auto finish() -> std::size_t;
+
+private:
+	FILE*                  _out         {nullptr};
+	long                   _start       {0};
+	std::vector<std::byte> _pending     {};
+	std::size_t            _written     {0};
+	std::size_t            _run_offset  {0};
+	RunLengths             _run         {};
+	bool                   _prev_active {false};
+
+	/// Append an object's binary representation to the pending data.
+	template<typename T>
+	auto append(T const& value) -> void {
+		auto const bytes {std::as_bytes(std::span{&value, 1})};
+		_pending.insert(_pending.end(), bytes.begin(), bytes.end());
+		}
+
+	/// Store the current run lengths, then write pending data if the file is seekable.
+	auto end_run() -> void;
+
+	/// Leave room for the lengths of a new run.
+	auto start_run() -> void;
+
+	};
+
+
+/// Statistics of a layered `IceTSparseImage`.
+struct SparseImageStats {
+	std::size_t active_pixels {0};
+	std::size_t fragments     {0};
+	std::size_t runs          {0};
+	std::size_t size          {0};
+	};
+
+/// Compresses a layered image into a layered `IceTSparseImage` in parallel.
+/// Active pixels and fragments are first counted per band of rows, which yields the exact offset of
+/// each band's output and the lengths of runs crossing band boundaries. Bands are then written
+/// independently, so the result is identical to compressing serially.
+/// Images read in bands are read once to count and once to write them, so only a bounded number of
+/// bands of either the input or the output are held in memory.
+class SparseImageCompressor {
+public:
+	/// Number of rows of a band, which is counted and written by a single thread.
+	static constexpr IceTSizeType band_rows {16};
+
+	/// Count the contents of each band of an image, which must outlive the compressor.
+	[[nodiscard]] SparseImageCompressor(RawImage const& image, unsigned num_threads = 1);
+	/// Count the contents of each band of a packed image, which must outlive the compressor.
+	[[nodiscard]] SparseImageCompressor(CsrImage const& image, unsigned num_threads = 1);
+	/// Count the contents of each band of an image read in bands, whose height should be a multiple
+	/// of `band_rows`.
+	[[nodiscard]] SparseImageCompressor(RawImageReader& image, unsigned num_threads = 1);
+
+	/// Return statistics of the compressed image, which are known without writing it.
+	[[nodiscard]] auto stats() const noexcept -> SparseImageStats;
+
+	/// Write the compressed image to a buffer of exactly `stats().size` bytes.
+	auto write(std::span<std::byte> out) const -> void;
+
+	/// Write the compressed image to a binary file, a few bands at a time.
+	auto write(FILE* out) const -> void;
+
+	/// Write the compressed image to a binary file, reading the image the compressor was
+	/// constructed from again from its first band.
+	auto write(RawImageReader& image, FILE* out) const -> void;
+
+private:
+	/// Contents of a band of rows.
+	struct Band {
+		/// Range of pixels in the band.
+		std::size_t begin {0};
+		std::size_t end   {0};
+
+		/// Whether the first and last pixel of the band are active.
+		bool first_active {false};
+		bool last_active  {false};
+
+		/// Number of runs starting within the band, not counting one starting at its first pixel.
+		std::size_t inner_runs {0};
+
+		/// Number of runs whose lengths are stored in the band, and the offset of its data.
+		std::size_t runs   {0};
+		std::size_t offset {0};
+
+		/// Lengths of the pixels preceding the band's first run, which continue a previous run.
+		RunLengths lead {};
+		/// Lengths of the pixels of following bands which continue the band's last run.
+		RunLengths tail {};
+
+		std::size_t active_pixels {0};
+		std::size_t fragments     {0};
+		std::size_t data_size     {0};
+
+		/// Return the number of bytes written for the band.
+		[[nodiscard]] constexpr auto size() const noexcept -> std::size_t {
+			return runs * sizeof(RunLengths) + data_size;
+			}
+
+		};
+
+	/// Fragments of consecutive pixels, stored densely with `_num_layers` per pixel, or packed at
+	/// `offsets` if those are not empty.
+	struct Fragments {
+		std::span<Color const>       color       {};
+		std::span<Depth const>       depth       {};
+		std::span<std::size_t const> offsets     {};
+		/// Index of the first pixel in the image.
+		std::size_t                  first_pixel {0};
+		};
+
+	IceTSizeType      _width       {0};
+	IceTSizeType      _height      {0};
+	IceTSizeType      _num_layers  {0};
+	/// Fragments of the whole image, unless it is read in bands.
+	Fragments         _image       {};
+	unsigned          _num_threads {1};
+	std::vector<Band> _bands       {};
+	SparseImageStats  _stats       {};
+
+	[[nodiscard]] SparseImageCompressor(
+			IceTSizeType width,
+			IceTSizeType height,
+			IceTSizeType num_layers,
+			Fragments    image,
+			unsigned     num_threads
+			);
+
+	/// Append the bands covering a range of rows.
+	auto add_bands(IceTSizeType first_row, IceTSizeType num_rows) -> void;
+
+	/// Count the contents of the bands `[band_begin, band_end)` in parallel.
+	auto count(std::size_t band_begin, std::size_t band_end, Fragments const& fragments) -> void;
+
+	/// Compute the offset of each band, the lengths of runs crossing bands, and statistics.
+	auto locate_bands() -> void;
+
+	/// Let IceT fill in the header, which needs room for one run following it.
+	auto write_header(std::span<std::byte> out) const -> void;
+
+	/// Write the bands `[band_begin, band_end)` in parallel into buffers, then to a file in order.
+	auto write_bands(
+			std::size_t                          band_begin,
+			std::size_t                          band_end,
+			Fragments const&                     fragments,
+			std::vector<std::vector<std::byte>>& buffers,
+			FILE*                                out
+			) const -> void;
+
+	/// Write a band to a buffer of `band.size()` bytes.
+	auto write_band(Band const& band, Fragments const& fragments, std::byte* out) const -> void;
+
+	/// Return the index of the first fragment of a pixel.
+	[[nodiscard]] auto first_fragment(Fragments const& fragments, std::size_t pixel) const noexcept
+			-> std::size_t;
+
+	/// Return the number of active fragments at a pixel.
+	[[nodiscard]] auto num_active(Fragments const& fragments, std::size_t pixel) const noexcept
+			-> std::size_t;
+
+	/// Return the number of inactive pixels at the front of the range `[begin, end)`.
+	[[nodiscard]] auto inactive_run(
+			Fragments const& fragments,
+			std::size_t      begin,
+			std::size_t      end
+			) const noexcept -> std::size_t;
+
 	};
 
 } // namespace layered_icet
@@ -1,38 +1,11 @@
 #include "common.hpp"
 
 
-namespace {
-
-/// Helper for writing objects' binary representations in sequence.
-struct BinaryWriter {
-	/// Current position.
-	std::byte* ptr;
-
-	/// Write a value at the current position, advance past it, then return a reference to the
-	/// output.
-	template<typename T>
-	constexpr auto push(T const& value) noexcept -> T& {
-		auto& out {reinterpret_cast<T&>(*ptr)};
-		out  = value;
-		ptr += sizeof(T);
-		return out;
-		}
-
-	};
-
-
-/// A set of run lengths in a layered `IceTSparseImage`.
-struct RunLengths {
-	IceTSizeType inactive  {0};
-	IceTSizeType active    {0};
-	IceTSizeType fragments {0};
-	};
-
-} // namespace
-
-
 /// Compress a layered fragment buffer into a layered `IceTSparseImage`.
-/// Arguments: <width> <height>
+/// With `--stats`, print statistics of the compressed image instead of writing it.
+/// With `--packed`, the whole input is packed into lists of its active fragments, which are then
+/// compressed, instead of compressing the input band by band.
+/// Arguments: [--threads <#threads>] [--stats] [--packed] [<width> <height>]
 auto main(int argc, char* argv[]) -> int {
 	using namespace layered_icet;
 	return try_main([&]() {
@@ -45,92 +18,114 @@ auto main(int argc, char* argv[]) -> int {
 		return EXIT_SUCCESS;
 		}
 
-	// Parse output size.
-	IceTSizeType width, height;
+	// Parse options, then drop them from the arguments.
+	auto num_threads {default_num_threads()};
+	auto stats_only  {false};
+	auto packed      {false};
+
+	for (;;) {
+		if (argc >= 3 and std::string_view{argv[1]} == "--threads") {
+			num_threads = std::max(1, atoi(argv[2]));
+			argv[2]     = argv[0];
+			argv       += 2;
+			argc       -= 2;
+			}
+		else if (argc >= 2 and std::string_view{argv[1]} == "--stats") {
+			stats_only = true;
+			argv[1]    = argv[0];
+			argv       += 1;
+			argc       -= 1;
+			}
+		else if (argc >= 2 and std::string_view{argv[1]} == "--packed") {
+			packed  = true;
+			argv[1] = argv[0];
+			argv   += 1;
+			argc   -= 1;
+			}
+		else {
+			break;
+			}}
+
+	// Parse input size, which is only required for headerless input.
+	IceTSizeType width {0}, height {0};
 
-	if (argc < 3
-			or (width  = atoi(argv[1])) == 0
+	if (argc == 2 or (argc >= 3 and (
+			(width  = atoi(argv[1])) == 0
 			or (height = atoi(argv[2])) == 0
-			) {
-		std::cerr << log_sev_fatal << "Invalid or missing arguments.\n"
-		             "Usage: " << argv[0] << " <width> <height>\n";
+			))) {
+		std::cerr << log_sev_fatal << "Invalid arguments.\n"
+		             "Usage: " << argv[0] << " [--threads <#threads>] [--stats] [--packed] "
+		                                     "[<width> <height>]\n";
 		return EXIT_FAILURE;
 		}
 
-	// Read input.
-	RawImage const in_buffer {width, height, freopen(nullptr, "rb", stdin)};
-
-	// Allocate result image.
-	UniqueSpan<std::byte> const out_buffer {int_cast<std::size_t>(icetSparseLayeredImageBufferSize(
-			in_buffer.width(),
-			in_buffer.height(),
-			in_buffer.num_layers()
-			))};
-	icetSparseLayeredImageAssignBuffer(
-			out_buffer.data(),
-			in_buffer.width(),
-			in_buffer.height()
-			);
-
-	// Compress input layers into a single sparse image.
-	BinaryWriter out               {out_buffer.data() + 7 * sizeof(IceTInt32)};
-	auto*        runlengths        {&out.push<RunLengths>({})};
-	auto         prev_pixel_active {false};
-
-	// For each pixel:
-	for (IceTSizeType pixel_start {0};
-	     pixel_start < in_buffer.num_fragments();
-	     pixel_start += in_buffer.num_layers()
-	     ) {
-		auto const& in_color {in_buffer.color()[pixel_start]};
-
-		// Handle inactive pixels.
-		if (in_color[color::alpha_channel] == 0) {
-			// Run lengths are stored before every inactive run.
-			if (prev_pixel_active) {
-				runlengths        = &out.push(RunLengths{});
-				prev_pixel_active = false;
-				}
-
-			// Count inactive pixels.
-			runlengths->inactive += 1;
-			continue;
+	// Write the compressed image, or report its statistics compared to the dense input.
+	auto finish = [&](
+			SparseImageCompressor const& compressor,
+			auto const&                  write,
+			std::size_t const            num_pixels,
+			std::size_t const            num_layers
+			) {
+		if (not stats_only) {
+			write(fdopen(ctx.stdout(), "wb"));
+			return EXIT_SUCCESS;
 			}
 
-		// Leave room to count the active fragments in this pixel.
-		auto& num_frags {out.push<IceTLayerCount>(1)};
-
-		// Copy the first fragment.
-		out.push(in_color);
-		out.push(in_buffer.depth()[pixel_start]);
-
-		// Process the remaining layers.
-		for (IceTLayerCount layer {1}; layer < in_buffer.num_layers(); ++layer) {
-			auto const& in_color {in_buffer.color()[pixel_start + layer]};
+		auto const stats      {compressor.stats()};
+		auto const dense_size {num_pixels * num_layers * (sizeof(Color) + sizeof(Depth))};
 
-			// Active fragments must come before inactive ones.
-			if (in_color[color::alpha_channel] == 0) {
-				break;
-				}
+		ctx.restore_stdout();
+		std::cout << "pixels:        " << num_pixels << '\n'
+		          << "active pixels: " << stats.active_pixels << '\n'
+		          << "fragments:     " << stats.fragments << '\n'
+		          << "runs:          " << stats.runs << '\n'
+		          << "dense size:    " << dense_size << '\n'
+		          << "sparse size:   " << stats.size << '\n'
+		          << "ratio:         " << static_cast<double>(dense_size) / stats.size << '\n';
+		ctx.stdout_to_stderr();
 
-			// Copy and count active fragments.
-			out.push(in_color);
-			out.push(in_buffer.depth()[pixel_start + layer]);
-			++num_frags;
-			}
-
-		// Count active pixels and fragments per run.
-		runlengths->active    += 1;
-		runlengths->fragments += num_frags;
-		prev_pixel_active      = true;
+		return EXIT_SUCCESS;
+		};
+
+	auto* const in_file {freopen(nullptr, "rb", stdin)};
+
+	if (packed) {
+		// Pack the whole input, keeping only its number of layers.
+		IceTSizeType   num_layers {0};
+		CsrImage const in_image   {[&]() {
+			RawImage const dense_image {width, height, in_file};
+			num_layers = dense_image.num_layers();
+			return CsrImage{dense_image, num_threads};
+			}()};
+
+		SparseImageCompressor const compressor {in_image, num_threads};
+
+		return finish(
+				compressor,
+				[&](FILE* const out) { compressor.write(out); },
+				std::size_t(in_image.num_pixels()),
+				std::size_t(num_layers)
+				);
 		}
 
-	// Store final image size.
-	auto const size {out.ptr - out_buffer.data()};
-	reinterpret_cast<IceTInt32*>(out_buffer.data())[6] = size;
-
-	// Output result image.
-	write_binary(std::as_bytes(out_buffer.span()).subspan(0, size), fdopen(ctx.stdout(), "wb"));
-	return EXIT_SUCCESS;
+	// Read input in bands of rows, as many as there are threads at a time.
+	RawImageReader in_image {
+			width,
+			height,
+			in_file,
+			true,
+			SparseImageCompressor::band_rows * int_cast<IceTSizeType>(num_threads),
+			};
+
+	// Count active pixels and fragments, which determines the exact size of the output, then read
+	// the input again to write it.
+	SparseImageCompressor const compressor {in_image, num_threads};
+
+	return finish(
+			compressor,
+			[&](FILE* const out) { compressor.write(in_image, out); },
+			std::size_t(in_image.width()) * std::size_t(in_image.height()),
+			std::size_t(in_image.num_layers())
+			);
 	});
 	}
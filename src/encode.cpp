@@ -0,0 +1,59 @@
+#include "codec.hpp"
+#include "common.hpp"
+
+
+/// Convert a layered fragment buffer into a losslessly encoded frame, which tools reading layered
+/// images decode transparently.
+/// With `--decode`, convert any input, including encoded frames, into a plain frame file instead.
+/// Arguments: [--threads <#threads>] [--decode] [<width> <height>]
+auto main(int argc, char* argv[]) -> int {
+	using namespace layered_icet;
+	return try_main([&]() {
+
+	// Parse options, then drop them from the arguments.
+	auto num_threads {default_num_threads()};
+	auto decode      {false};
+
+	for (;;) {
+		if (argc >= 3 and std::string_view{argv[1]} == "--threads") {
+			num_threads = std::max(1, atoi(argv[2]));
+			argv[2]     = argv[0];
+			argv       += 2;
+			argc       -= 2;
+			}
+		else if (argc >= 2 and std::string_view{argv[1]} == "--decode") {
+			decode  = true;
+			argv[1] = argv[0];
+			argv   += 1;
+			argc   -= 1;
+			}
+		else {
+			break;
+			}}
+
+	// Parse input size, which is only required for headerless input.
+	IceTSizeType width {0}, height {0};
+
+	if (argc == 2 or (argc >= 3 and (
+			(width  = atoi(argv[1])) == 0
+			or (height = atoi(argv[2])) == 0
+			))) {
+		std::cerr << log_sev_fatal << "Invalid arguments.\n"
+		             "Usage: " << argv[0] << " [--threads <#threads>] [--decode] [<width> <height>]\n";
+		return EXIT_FAILURE;
+		}
+
+	// Read input, which is memory-mapped if possible and decoded if necessary.
+	RawImage const in_image {width, height, freopen(nullptr, "rb", stdin)};
+	auto* const    out_file {freopen(nullptr, "wb", stdout)};
+
+	if (decode) {
+		in_image.write(out_file);
+		}
+	else {
+		write_binary(std::span<std::byte const>{codec::encode(in_image, num_threads)}, out_file);
+		}
+
+	return EXIT_SUCCESS;
+	});
+	}
@@ -0,0 +1,56 @@
+#include "common.hpp"
+#include "synthetic.hpp"
+
+
+/// Generate a synthetic layered frame for one process and write it to stdout as a frame file.
+/// Arguments: [--threads <#threads>] [--frame <frame>] [<generator options>] <width> <height>
+///            <max #layers> [<rank> <#ranks>]
+auto main(int argc, char* argv[]) -> int {
+	using namespace layered_icet;
+	return try_main([&]() {
+
+	// Parse options, then drop them from the arguments.
+	synthetic::Params params;
+	auto              num_threads {default_num_threads()};
+	unsigned          frame       {0};
+
+	for (;;) {
+		if (argc >= 3 and std::string_view{argv[1]} == "--threads") {
+			num_threads = std::max(1, atoi(argv[2]));
+			}
+		else if (argc >= 3 and std::string_view{argv[1]} == "--frame") {
+			frame = std::max(0, atoi(argv[2]));
+			}
+		else if (argc < 3 or not synthetic::parse_option(params, argv[1], argv[2])) {
+			break;
+			}
+
+		argv[2]  = argv[0];
+		argv    += 2;
+		argc    -= 2;
+		}
+
+	// Parse frame size and the process to generate the frame for.
+	int rank {0}, num_ranks {1};
+
+	if ((argc != 4 and argc != 6)
+			or (params.width      = atoi(argv[1])) <= 0
+			or (params.height     = atoi(argv[2])) <= 0
+			or (params.max_layers = atoi(argv[3])) <= 0
+			or (argc == 6 and (
+				(rank      = atoi(argv[4])) < 0
+				or (num_ranks = atoi(argv[5])) <= rank
+				))) {
+		std::cerr << log_sev_fatal << "Invalid arguments.\n"
+		             "Usage: " << argv[0] << " [--threads <#threads>] [--frame <frame>] "
+		          << synthetic::options_usage << " <width> <height> <max #layers> "
+		             "[<rank> <#ranks>]\n";
+		return EXIT_FAILURE;
+		}
+
+	synthetic::generate(params, rank, num_ranks, frame, num_threads)
+			.write(freopen(nullptr, "wb", stdout));
+
+	return EXIT_SUCCESS;
+	});
+	}
@@ -1,15 +1,34 @@
+#include "batch.hpp"
 #include "common.hpp"
-
-#include <strategy-hash.hpp>
-#include <single-image-strategy-hash.hpp>
+#include "strategy.hpp"
+#include "tiles.hpp"
 
 
 /// Use IceT to blend PNG images front to back.
-/// Arguments: <strategy>[/<single-image-strategy>] <width> <height> [<rank>:<image>]...
+/// Arguments: [<batch options>] <strategy>[/<single-image-strategy>] <width> <height>
+///            [<rank>:<image>]...
 auto main(int argc, char* argv[]) -> int {
 	using namespace layered_icet;
 	return try_main([&]() {
 
+	// Parse batch and output options, then drop them from the arguments.
+	batch::Options batch_options;
+
+	for (;;) {
+		if (argc >= 2 and batch::parse_flag(batch_options, argv[1])) {
+			argv[1]  = argv[0];
+			argv    += 1;
+			argc    -= 1;
+			}
+		else if (argc >= 3 and batch::parse_option(batch_options, argv[1], argv[2])) {
+			argv[2]  = argv[0];
+			argv    += 2;
+			argc    -= 2;
+			}
+		else {
+			break;
+			}}
+
 	// Parse output size.
 	IceTSizeType width, height;
 
@@ -18,93 +37,63 @@ auto main(int argc, char* argv[]) -> int {
 			or (height = atoi(argv[3])) == 0
 			) {
 		std::cerr << log_sev_fatal << "Invalid or missing arguments.\n"
-		             "Usage: " << argv[0] << " <strategy>[/<single-image-strategy>] <width> "
-		                                     "<height> [<rank>:<image>]...\n";
+		             "Usage: " << argv[0] << " " << batch::options_usage
+		          << " <strategy>[/<single-image-strategy>] <width> <height> [<rank>:<image>]...\n"
+		             "With --frames, `{}` in file names is replaced by the frame number.\n"
+		             "Results are encoded in the format given by --format or the extension of the "
+		             "output file, otherwise they are written as IceT images.\n"
+		             "With --tiles, each tile is written into the output file by a different "
+		             "process, which requires format ppm, pam, or raw.\n";
 		return EXIT_FAILURE;
 		}
 
 	// Parse strategy.
-	std::string_view const strategy_name {argv[1], std::strcspn(argv[1], "/")};
-	auto const             strategy      {
-			StrategyLut::find(strategy_name.data(), strategy_name.size())};
-
-	if (not strategy) {
-		std::cerr << log_sev_fatal << "Unknown compositing strategy `" << strategy_name << "`.\n";
-		return EXIT_FAILURE;
-		}
-
-	// Parse single image strategy if used.
-	auto single_image_strategy {ICET_SINGLE_IMAGE_STRATEGY_AUTOMATIC};
-
-	if (strategy->uses_single_image_strategy) {
-		if (*strategy_name.end() != '/') {
-			std::cerr << "The selected compositing strategy requires a single image compositing "
-			             "strategy to be specified.\n";
-			return EXIT_FAILURE;
-			}
-
-		std::string_view const si_strategy_name {strategy_name.end() + 1};
-		auto const             si_strategy      {
-				SingleImageStrategyLut::find(si_strategy_name.data(), si_strategy_name.size())};
-
-		if (not si_strategy) {
-			std::cerr << log_sev_fatal << "Unknown single image compositing strategy `"
-			          << si_strategy_name << "`.\n";
-			return EXIT_FAILURE;
-			}
-
-		single_image_strategy = si_strategy->key;
-		}
+	auto const strategy {parse_strategy(argv[1])};
 
 	// IceT setup.
 	Context ctx {&argc, &argv};
 
-	icetStrategy(strategy->key);
-	icetSingleImageStrategy(single_image_strategy);
+	strategy.apply();
 
-	icetResetTiles();
-	icetAddTile(0, 0, width, height, 0);
+	tiles::add(batch_options.tiles, width, height, ctx.num_procs());
 
-	// Parse layers.
-	UniqueSpan<InputLayer> const in_layers  {int_cast<std::size_t>(argc - 4)};
-	std::size_t                  num_layers {0};
+	// Assemble the layers assigned to this rank into a fragment buffer for each frame.
+	auto load = [&](batch::Frame const& frame) {
+		// Parse layers.
+		UniqueSpan<InputLayer> const in_layers  {frame.args.size()};
+		std::size_t                  num_layers {0};
 
-	for (auto argi {4}; argi < argc; ++argi) {
-		char* parse_ptr;
+		for (std::size_t argi {0}; argi < frame.args.size(); ++argi) {
+			auto const* const arg {frame.args[argi].c_str()};
+			char*             parse_ptr;
 
-		// Parse rank.
-		if (std::strtol(argv[argi], &parse_ptr, 10) == ctx.proc_rank()) {
-			if (parse_ptr == argv[argi] or *parse_ptr != ':') {
-				std::cerr << log_sev_error << "Argument " << argv[argi]
-				          << " does not match the expected pattern <rank>:<image>.\n";
-				continue;
-				}
+			// Parse rank.
+			if (std::strtol(arg, &parse_ptr, 10) == ctx.proc_rank()) {
+				if (parse_ptr == arg or *parse_ptr != ':') {
+					std::cerr << log_sev_error << "Argument " << arg
+					          << " does not match the expected pattern <rank>:<image>.\n";
+					continue;
+					}
 
-			// Skip colon.
-			++parse_ptr;
-			in_layers.span()[num_layers] = {parse_ptr, static_cast<float>(argi - 3) / (argc - 3)};
-			++num_layers;
-			}}
+				// Skip colon.
+				++parse_ptr;
+				in_layers.span()[num_layers] = {
+						parse_ptr,
+						static_cast<float>(argi + 1) / (frame.args.size() + 1)
+						};
+				++num_layers;
+				}}
 
-	// Assemble layers assigned to this rank into a fragment buffer.
-	RawImage in_buffer {width, height, in_layers.span().first(num_layers)};
+		return RawImage{width, height, in_layers.span().first(num_layers), default_num_threads()};
+		};
 
 	// Composite fragments from all ranks.
-	std::array<IceTFloat, 4> const background {0, 0, 0, 0};
-	auto const out_image {icetCompositeImageLayered(
-			in_buffer.color().data(),
-			in_buffer.depth().data(),
-			in_buffer.num_layers(),
-			nullptr,
-			nullptr,
-			nullptr,
-			background.data()
-			)};
-
-	// Output result image.
-	if (ctx.proc_rank() == 0) {
-		write_image(out_image, fdopen(ctx.stdout(), "wb"));
-		}
+	batch::run(
+		ctx,
+		batch_options,
+		batch::frames(batch_options, std::span{&argv[4], std::size_t(argc - 4)}),
+		load
+		);
 
 	return EXIT_SUCCESS;
 	});
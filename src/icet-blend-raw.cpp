@@ -1,15 +1,34 @@
+#include "batch.hpp"
 #include "common.hpp"
+#include "strategy.hpp"
+#include "tiles.hpp"
 
-#include <strategy-hash.hpp>
-#include <single-image-strategy-hash.hpp>
 
-
-/// Use IceT to blend PNG images front to back.
-/// Arguments: <strategy>[/<single-image-strategy>] <width> <height> (<color> <depth>)...
+/// Use IceT to blend raw images of all ranks.
+/// Arguments: [<batch options>] <strategy>[/<single-image-strategy>] <width> <height>
+///            (<color> <depth>)...
 auto main(int argc, char* argv[]) -> int {
 	using namespace layered_icet;
 	return try_main([&]() {
 
+	// Parse batch and output options, then drop them from the arguments.
+	batch::Options batch_options;
+
+	for (;;) {
+		if (argc >= 2 and batch::parse_flag(batch_options, argv[1])) {
+			argv[1]  = argv[0];
+			argv    += 1;
+			argc    -= 1;
+			}
+		else if (argc >= 3 and batch::parse_option(batch_options, argv[1], argv[2])) {
+			argv[2]  = argv[0];
+			argv    += 2;
+			argc    -= 2;
+			}
+		else {
+			break;
+			}}
+
 	// Parse output size.
 	IceTSizeType width, height;
 
@@ -18,78 +37,55 @@ auto main(int argc, char* argv[]) -> int {
 			or (height = atoi(argv[3])) == 0
 			) {
 		std::cerr << log_sev_fatal << "Invalid or missing arguments.\n"
-		             "Usage: " << argv[0] << " <strategy>[/<single-image-strategy>] <width> "
-		                                     "<height> (<color> <depth>)...\n";
+		             "Usage: " << argv[0] << " " << batch::options_usage
+		          << " <strategy>[/<single-image-strategy>] <width> <height> (<color> <depth>)...\n"
+		             "With --frames, `{}` in file names is replaced by the frame number.\n"
+		             "Results are encoded in the format given by --format or the extension of the "
+		             "output file, otherwise they are written as IceT images.\n"
+		             "With --tiles, each tile is written into the output file by a different "
+		             "process, which requires format ppm, pam, or raw.\n";
 		return EXIT_FAILURE;
 		}
 
 	// Parse strategy.
-	std::string_view const strategy_name {argv[1], std::strcspn(argv[1], "/")};
-	auto const             strategy      {
-			StrategyLut::find(strategy_name.data(), strategy_name.size())};
+	auto const strategy {parse_strategy(argv[1])};
 
-	if (not strategy) {
-		std::cerr << log_sev_fatal << "Unknown compositing strategy `" << strategy_name << "`.\n";
-		return EXIT_FAILURE;
-		}
+	// IceT setup.
+	Context ctx {&argc, &argv};
 
-	// Parse single image strategy if used.
-	auto single_image_strategy {ICET_SINGLE_IMAGE_STRATEGY_AUTOMATIC};
+	strategy.apply();
 
-	if (strategy->uses_single_image_strategy) {
-		if (*strategy_name.end() != '/') {
-			std::cerr << "The selected compositing strategy requires a single image compositing "
-			             "strategy to be specified.\n";
-			return EXIT_FAILURE;
-			}
+	tiles::add(batch_options.tiles, width, height, ctx.num_procs());
 
-		std::string_view const si_strategy_name {strategy_name.end() + 1};
-		auto const             si_strategy      {
-				SingleImageStrategyLut::find(si_strategy_name.data(), si_strategy_name.size())};
+	// Read the image of this rank for each frame.
+	auto load = [&](batch::Frame const& frame) {
+		using File = std::unique_ptr<FILE, decltype([](FILE* const file) { fclose(file); })>;
 
-		if (not si_strategy) {
-			std::cerr << log_sev_fatal << "Unknown single image compositing strategy `"
-			          << si_strategy_name << "`.\n";
-			return EXIT_FAILURE;
+		if (frame.args.size() < std::size_t(ctx.num_procs()) * 2) {
+			throw std::runtime_error{concat(
+					"Too few input files for frame ", frame.number,
+					", must specify one image per process"
+					)};
 			}
 
-		single_image_strategy = si_strategy->key;
-		}
-
-	// IceT setup.
-	Context ctx {&argc, &argv};
-
-	icetStrategy(strategy->key);
-	icetSingleImageStrategy(single_image_strategy);
+		std::span const files {&frame.args[ctx.proc_rank() * 2], 2};
+		File const      color_file {fopen(files[0].c_str(), "rb")};
+		File const      depth_file {fopen(files[1].c_str(), "rb")};
 
-	icetResetTiles();
-	icetAddTile(0, 0, width, height, 0);
-
-	if (argc < 4 + ctx.num_procs() * 2) {
-		std::cerr << log_sev_fatal << "Too few arguments, must specify one image per process\n";
-		return EXIT_FAILURE;
-		}
+		if (not color_file or not depth_file) {
+			throw std::runtime_error{concat("Could not open ", files[0], " or ", files[1])};
+			}
 
-	// Read image.
-	std::span const files {&argv[4 + ctx.proc_rank() * 2], 2};
-	RawImage const in_image {width, height, fopen(files[0], "rb"), fopen(files[1], "rb")};
+		return RawImage{width, height, color_file.get(), depth_file.get()};
+		};
 
 	// Composite fragments from all ranks.
-	std::array<IceTFloat, 4> const background {0, 0, 0, 0};
-	auto const out_image {icetCompositeImageLayered(
-			in_image.color().data(),
-			in_image.depth().data(),
-			in_image.num_layers(),
-			nullptr,
-			nullptr,
-			nullptr,
-			background.data()
-			)};
-
-	// Output result image.
-	if (ctx.proc_rank() == 0) {
-		write_image(out_image, fdopen(ctx.stdout(), "wb"));
-		}
+	batch::run(
+		ctx,
+		batch_options,
+		batch::frames(batch_options, std::span{&argv[4], std::size_t(argc - 4)}),
+		load
+		);
 
 	return EXIT_SUCCESS;
 	});
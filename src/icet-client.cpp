@@ -0,0 +1,82 @@
+#include <chrono>
+#include <filesystem>
+#include <iomanip>
+
+#include "common.hpp"
+#include "service.hpp"
+
+
+/// Submit a job to `icet-daemon` and write its output to `stdout`.
+/// Jobs `compress`, `decompress` and `to-png` read their input from `stdin` and take the same
+/// arguments as the corresponding one-shot tools, `blend` those of `icet-blend-raw`, and `shutdown`
+/// stops the daemon.
+/// With `--time`, the time the daemon spent on the job and the total latency seen by the client are
+/// printed to `stderr`, for comparison with the startup and run time of the one-shot tool.
+/// Arguments: [--time] <socket> <job> [<argument>...]
+auto main(int argc, char* argv[]) -> int {
+	using namespace layered_icet;
+	using namespace std::string_view_literals;
+	namespace cron = std::chrono;
+	return try_main([&]() {
+
+	using Clock        = cron::steady_clock;
+	using Milliseconds = cron::duration<double, std::milli>;
+
+	auto const start_time {Clock::now()};
+
+	// Parse options.
+	bool const print_time {argc >= 2 and argv[1] == "--time"sv};
+
+	if (print_time) {
+		argv[1]  = argv[0];
+		argv    += 1;
+		argc    -= 1;
+		}
+
+	if (argc < 3) {
+		std::cerr << log_sev_fatal << "Invalid arguments.\n"
+		             "Usage: " << argv[0] << " [--time] <socket> "
+		                                     "blend|compress|decompress|to-png|shutdown "
+		                                     "[<argument>...]\n";
+		return EXIT_FAILURE;
+		}
+
+	// Build the job, reading its input unless it has none.
+	service::Request request;
+	request.args.assign(&argv[2], &argv[argc]);
+
+	// The daemon resolves paths against its own working directory, so make the input files of
+	// `blend`, which follow its strategy and size, absolute.
+	if (request.args[0] == "blend") {
+		for (std::size_t idx {4}; idx < request.args.size(); ++idx) {
+			request.args[idx] = std::filesystem::absolute(request.args[idx]).string();
+			}}
+
+	if (request.args[0] != "blend" and request.args[0] != "shutdown") {
+		request.input = read_all(freopen(nullptr, "rb", stdin));
+		}
+
+	// Submit it and wait for the result.
+	auto const connection {service::connect(argv[1])};
+	service::send(connection, request);
+
+	auto const response {service::decode_response(service::receive(connection))};
+
+	if (not response.success) {
+		std::cerr << log_sev_fatal << response.error << "\n";
+		return EXIT_FAILURE;
+		}
+
+	write_binary(std::span<std::byte const>{response.output}, stdout);
+	fflush(stdout);
+
+	if (print_time) {
+		std::cerr << log_sev_info << std::fixed << std::setprecision(3) << "Job took "
+		          << Milliseconds{cron::nanoseconds{response.job_ns}}.count() << " ms in the "
+		             "daemon, "
+		          << Milliseconds{Clock::now() - start_time}.count() << " ms in total\n";
+		}
+
+	return EXIT_SUCCESS;
+	});
+	}
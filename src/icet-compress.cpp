@@ -2,7 +2,7 @@
 
 
 /// Use IceT to compress a layered fragment buffer into a layered `IceTSparseImage`.
-/// Arguments: <width> <height>
+/// Arguments: [<width> <height>]
 auto main(int argc, char* argv[]) -> int {
 	using namespace layered_icet;
 	return try_main([&]() {
@@ -15,15 +15,15 @@ auto main(int argc, char* argv[]) -> int {
 		return EXIT_SUCCESS;
 		}
 
-	// Parse output size.
-	IceTSizeType width, height;
+	// Parse input size, which is only required for headerless input.
+	IceTSizeType width {0}, height {0};
 
-	if (argc < 3
-			or (width  = atoi(argv[1])) == 0
+	if (argc == 2 or (argc >= 3 and (
+			(width  = atoi(argv[1])) == 0
 			or (height = atoi(argv[2])) == 0
-			) {
-		std::cerr << log_sev_fatal << "Invalid or missing arguments.\n"
-		             "Usage: " << argv[0] << " <width> <height>\n";
+			))) {
+		std::cerr << log_sev_fatal << "Invalid arguments.\n"
+		             "Usage: " << argv[0] << " [<width> <height>]\n";
 		return EXIT_FAILURE;
 		}
 
@@ -49,6 +49,7 @@ auto main(int argc, char* argv[]) -> int {
 
 	// Compress image.
 	icetCompressImage(in_image, out_image);
+	memory::record_icet_state_bytes();
 
 	// Output result image.
 	write_image(out_image, fdopen(ctx.stdout(), "wb"));
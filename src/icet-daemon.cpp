@@ -0,0 +1,363 @@
+#include <chrono>
+#include <cstdio>
+
+#include "common.hpp"
+#include "output.hpp"
+#include "service.hpp"
+#include "strategy.hpp"
+
+
+namespace {
+
+namespace cron = std::chrono;
+using namespace layered_icet;
+
+using File = std::unique_ptr<FILE, decltype([](FILE* const file) { fclose(file); })>;
+
+/// Return the bytes `write(file)` writes to a file.
+template<typename TFn>
+auto capture(TFn&& write) -> std::vector<std::byte> {
+	char*       data {nullptr};
+	std::size_t size {0};
+
+	// Free the buffer only after closing the stream, which completes it.
+	std::unique_ptr<char*, decltype([](char** const ptr) { free(*ptr); })> const owner {&data};
+	File file {open_memstream(&data, &size)};
+
+	if (not file) {
+		throw std::runtime_error{"Could not create output buffer"};
+		}
+
+	write(file.get());
+	file.reset();
+
+	auto const bytes {reinterpret_cast<std::byte const*>(data)};
+	return {bytes, bytes + size};
+	}
+
+/// Open a job's input as a file.
+auto open_input(std::vector<std::byte>& input) -> File {
+	if (input.empty()) {
+		throw std::runtime_error{"Missing input"};
+		}
+
+	File file {fmemopen(input.data(), input.size(), "rb")};
+
+	if (not file) {
+		throw std::runtime_error{"Could not open input"};
+		}
+
+	return file;
+	}
+
+/// Use IceT to blend raw images of all ranks, like `icet-blend-raw`.
+/// Arguments: <strategy>[/<single-image-strategy>] <width> <height> (<color> <depth>)...
+auto blend(Context const& ctx, std::span<std::string const> const args)
+		-> std::vector<std::byte> {
+	IceTSizeType width, height;
+
+	if (args.size() < 3
+			or (width  = atoi(args[1].c_str())) == 0
+			or (height = atoi(args[2].c_str())) == 0
+			) {
+		throw std::runtime_error{
+				"Usage: blend <strategy>[/<single-image-strategy>] <width> <height> "
+				"(<color> <depth>)..."
+				};
+		}
+
+	if (args.size() < 3 + std::size_t(ctx.num_procs()) * 2) {
+		throw std::runtime_error{"Too few arguments, must specify one image per process"};
+		}
+
+	parse_strategy(args[0]).apply();
+
+	icetResetTiles();
+	icetAddTile(0, 0, width, height, 0);
+
+	// Read image, making sure all ranks succeed before compositing.
+	std::optional<RawImage> in_image;
+	std::string             error;
+
+	try {
+		auto const files {args.subspan(3 + ctx.proc_rank() * 2, 2)};
+		File const color_file {fopen(files[0].c_str(), "rb")};
+		File const depth_file {fopen(files[1].c_str(), "rb")};
+
+		if (not color_file or not depth_file) {
+			throw std::runtime_error{concat("Could not open ", files[0], " or ", files[1])};
+			}
+
+		in_image.emplace(width, height, color_file.get(), depth_file.get());
+		}
+	catch (std::exception const& e) {
+		error = e.what();
+		}
+
+	int failed {not in_image};
+	MPI_Allreduce(MPI_IN_PLACE, &failed, 1, MPI_INT, MPI_MAX, MPI_COMM_WORLD);
+
+	if (failed) {
+		throw std::runtime_error{in_image ? "Another rank could not read its image" : error};
+		}
+
+	// Composite fragments from all ranks.
+	std::array<IceTFloat, 4> const background {0, 0, 0, 0};
+	auto const out_image {icetCompositeImageLayered(
+			in_image->color().data(),
+			in_image->depth().data(),
+			in_image->num_layers(),
+			nullptr,
+			nullptr,
+			nullptr,
+			background.data()
+			)};
+	memory::record_icet_state_bytes();
+
+	if (ctx.proc_rank() != 0) {
+		return {};
+		}
+
+	return capture([&](FILE* const out) { write_image(out_image, out); });
+	}
+
+/// Use IceT to compress a layered fragment buffer, like `icet-compress`.
+/// Arguments: [<width> <height>]
+auto compress(std::span<std::string const> const args, std::vector<std::byte>& input)
+		-> std::vector<std::byte> {
+	IceTSizeType width {0}, height {0};
+
+	if (args.size() == 1 or (args.size() >= 2 and (
+			(width  = atoi(args[0].c_str())) == 0
+			or (height = atoi(args[1].c_str())) == 0
+			))) {
+		throw std::runtime_error{"Usage: compress [<width> <height>]"};
+		}
+
+	auto const     in_file   {open_input(input)};
+	RawImage const in_buffer {width, height, in_file.get()};
+
+	auto const in_image {icetGetStatePointerLayeredImage(
+			ICET_RENDER_BUFFER,
+			in_buffer.width(),
+			in_buffer.height(),
+			in_buffer.num_layers(),
+			in_buffer.color().data(),
+			in_buffer.depth().data()
+			)};
+
+	auto out_image {icetGetStateBufferSparseLayeredImage(
+			ICET_SPARSE_TILE_BUFFER,
+			in_buffer.width(),
+			in_buffer.height(),
+			in_buffer.num_layers()
+			)};
+
+	icetCompressImage(in_image, out_image);
+	memory::record_icet_state_bytes();
+
+	return capture([&](FILE* const out) { write_image(out_image, out); });
+	}
+
+/// Use IceT to decompress an `IceTSparseImage`, like `icet-decompress`.
+auto decompress(std::vector<std::byte>& input) -> std::vector<std::byte> {
+	if (input.empty()) {
+		throw std::runtime_error{"Missing input"};
+		}
+
+	auto const in_image  {unpackage_sparse_image(input)};
+	auto const out_image {icetGetStateBufferImage(
+			ICET_RENDER_BUFFER,
+			icetSparseImageGetWidth(in_image),
+			icetSparseImageGetHeight(in_image)
+			)};
+
+	icetDecompressImage(in_image, out_image);
+	memory::record_icet_state_bytes();
+	icetImageAdjustForOutput(out_image);
+
+	return capture([&](FILE* const out) { write_image(out_image, out); });
+	}
+
+/// Convert a non-layered `IceTImage` to PNG or another format, like `icet-to-png`.
+/// Arguments: [<output options>]
+auto to_png(std::span<std::string const> args, std::vector<std::byte>& input)
+		-> std::vector<std::byte> {
+	output::Options options;
+
+	for (; args.size() >= 2 and output::parse_option(options, args[0], args[1].c_str());) {
+		args = args.subspan(2);
+		}
+
+	if (not args.empty()) {
+		throw std::runtime_error{concat("Usage: to-png ", output::options_usage)};
+		}
+
+	if (input.empty()) {
+		throw std::runtime_error{"Missing input"};
+		}
+
+	auto const in_image {unpackage_image(input)};
+
+	return capture([&](FILE* const out) { output::write(in_image, options, out); });
+	}
+
+/// Run a job on this rank, where only rank 0 has its input and returns its output.
+auto run_job(
+		Context const&                  ctx,
+		std::vector<std::string> const& args,
+		std::vector<std::byte>&         input
+		) -> std::vector<std::byte> {
+	if (args.empty()) {
+		throw std::runtime_error{"Missing job"};
+		}
+
+	auto const name   {std::string_view{args[0]}};
+	auto const params {std::span{args}.subspan(1)};
+
+	// Distributed jobs.
+	if (name == "blend") {
+		return blend(ctx, params);
+		}
+	if (name == "shutdown") {
+		return {};
+		}
+
+	// Jobs which are not distributed.
+	if (name != "compress" and name != "decompress" and name != "to-png") {
+		throw std::runtime_error{concat("Unknown job `", name, "`")};
+		}
+
+	if (ctx.proc_rank() != 0) {
+		return {};
+		}
+
+	if (name == "compress") {
+		return compress(params, input);
+		}
+	if (name == "decompress") {
+		return decompress(input);
+		}
+
+	return to_png(params, input);
+	}
+
+} // namespace
+
+
+/// Keep MPI and IceT initialized and run jobs submitted by `icet-client` over a Unix domain socket,
+/// so they do not pay for starting up each time.
+/// Rank 0 accepts jobs one at a time and broadcasts them to all other ranks.
+/// Arguments: <socket>
+auto main(int argc, char* argv[]) -> int {
+	return try_main([&]() {
+
+	// IceT setup.
+	Context ctx {&argc, &argv};
+
+	if (argc != 2) {
+		if (ctx.proc_rank() == 0) {
+			std::cerr << log_sev_fatal << "Invalid arguments.\n"
+			             "Usage: " << argv[0] << " <socket>\n";
+			}
+
+		return EXIT_FAILURE;
+		}
+
+	// Listen for jobs on rank 0, and ensure all ranks stop if that fails.
+	posix::FileDescriptor server;
+	int                   listening {0};
+
+	if (ctx.proc_rank() == 0) {
+		try {
+			server    = service::listen(argv[1]);
+			listening = 1;
+			std::clog << log_sev_info << "Listening on " << argv[1] << "\n";
+			}
+		catch (std::exception const& error) {
+			std::cerr << log_sev_fatal << error.what() << "\n";
+			}}
+
+	MPI_Bcast(&listening, 1, MPI_INT, 0, MPI_COMM_WORLD);
+
+	if (not listening) {
+		return EXIT_FAILURE;
+		}
+
+	for (bool running {true}; running;) {
+		using Clock = cron::steady_clock;
+
+		posix::FileDescriptor  client;
+		service::Request       request;
+		std::vector<std::byte> message;
+		Clock::time_point      start_time;
+
+		// Wait for the next job which can be received in full.
+		if (ctx.proc_rank() == 0) {
+			for (;;) {
+				try {
+					client     = service::accept(server);
+					request    = service::decode_request(service::receive(client));
+					start_time = Clock::now();
+					break;
+					}
+				catch (std::exception const& error) {
+					std::clog << log_sev_warn << "Dropping job: " << error.what() << "\n";
+					}}
+
+			message = service::encode_args(request.args);
+			}
+
+		// Broadcast the job's arguments.
+		std::uint64_t size {message.size()};
+		MPI_Bcast(&size, 1, MPI_UINT64_T, 0, MPI_COMM_WORLD);
+
+		message.resize(size);
+		MPI_Bcast(message.data(), size, MPI_BYTE, 0, MPI_COMM_WORLD);
+
+		auto const args {service::decode_args(message)};
+		running = args.empty() or args[0] != "shutdown";
+
+		// Run the job.
+		service::Response response;
+
+		try {
+			response.output  = run_job(ctx, args, request.input);
+			response.success = true;
+			}
+		catch (std::exception const& error) {
+			response.error = error.what();
+			}
+
+		if (ctx.proc_rank() != 0) {
+			if (not response.success) {
+				std::clog << log_sev_error << "Rank " << ctx.proc_rank() << ": " << response.error
+				          << "\n";
+				}
+
+			continue;
+			}
+
+		// Report the result.
+		response.job_ns = cron::duration_cast<cron::nanoseconds>(Clock::now() - start_time).count();
+
+		std::clog << (response.success ? log_sev_info : log_sev_error) << "Job `"
+		          << (args.empty() ? "" : args[0]) << "` "
+		          << (response.success ? "took " : "failed after ")
+		          << cron::duration<double, std::milli>{cron::nanoseconds{response.job_ns}}.count()
+		          << " ms" << (response.success ? "" : ": " + response.error) << "\n";
+
+		try {
+			service::send(client, response);
+			}
+		catch (std::exception const& error) {
+			std::clog << log_sev_warn << "Could not send result: " << error.what() << "\n";
+			}}
+
+	if (ctx.proc_rank() == 0) {
+		unlink(argv[1]);
+		}
+
+	return EXIT_SUCCESS;
+	});
+	}
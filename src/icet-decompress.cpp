@@ -16,7 +16,7 @@ auto main(int argc, char* argv[]) -> int {
 
 	// Read input image.
 	auto       in_buffer {read_all(freopen(nullptr, "rb", stdin))};
-	auto const in_image  {icetSparseImageUnpackageFromReceive(in_buffer.data())};
+	auto const in_image  {unpackage_sparse_image(in_buffer)};
 
 	// Allocate output image.
 	auto const out_image {icetGetStateBufferImage(
@@ -27,6 +27,7 @@ auto main(int argc, char* argv[]) -> int {
 
 	// Decompress image.
 	icetDecompressImage(in_image, out_image);
+	memory::record_icet_state_bytes();
 
 	// Output result image.
 	icetImageAdjustForOutput(out_image);
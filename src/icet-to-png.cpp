@@ -1,56 +1,83 @@
+#include <chrono>
+#include <iomanip>
+
 #include "common.hpp"
+#include "output.hpp"
 
 
-namespace {
+/// Convert a non-layered `IceTImage` to PNG, or to an uncompressed format with `--format`.
+/// PNG data is filtered and deflated in parallel.
+/// If a PNG file is given, it is converted instead, which decodes PNG output independently of the
+/// encoder.
+/// Arguments: [--format png|ppm|pam|raw|rgba] [--level <0-9>]
+///            [--filter none|sub|up|average|paeth|adaptive] [--threads <#threads>] [<png>]
+auto main(int argc, char* argv[]) -> int {
+	using namespace layered_icet;
+	namespace cron = std::chrono;
+	return try_main([&]() {
 
-using namespace layered_icet;
+	// Parse options, then drop them from the arguments.
+	output::Options options;
 
-/// Adapts a color buffer
-struct IcetToPng : png::generator<PngPixel, IcetToPng> {
-	IceTUByte* data;
+	while (argc >= 3 and output::parse_option(options, argv[1], argv[2])) {
+		argv[2]  = argv[0];
+		argv    += 2;
+		argc    -= 2;
+		}
 
-	[[nodiscard]] IcetToPng(IceTImage image, png::image_info& info)
-		: generator(info)
-		, data {icetImageGetColorub(image)}
-		{}
+	// IceT setup.
+	Context ctx {&argc, &argv};
 
-	auto get_next_row(PngSize row) -> png::byte* {
-		return data + row * get_info().get_width() * 4;
+	// This program is not distributed.
+	if (ctx.proc_rank() != 0) {
+		return EXIT_SUCCESS;
 		}
 
-	};
+	if (argc > 2) {
+		std::cerr << log_sev_fatal << "Invalid arguments.\n"
+		             "Usage: " << argv[0] << " " << output::options_usage << " [<png>]\n";
+		return EXIT_FAILURE;
+		}
 
-} // namespace
+	auto* const out_file {fdopen(ctx.stdout(), "wb")};
 
+	// Convert a PNG file, which libpng decodes.
+	if (argc == 2) {
+		PngReader          in     {argv[1]};
+		std::vector<Color> pixels {};
+		pixels.reserve(std::size_t(in.width()) * std::size_t(in.height()));
 
-/// Convert a non-layered `IceTImage` to PNG.
-auto main(int argc, char* argv[]) -> int {
-	return try_main([&]() {
+		for (IceTSizeType y {0}; y < in.height(); ++y) {
+			auto const row {in.next_row()};
+			pixels.insert(pixels.end(), row.begin(), row.end());
+			}
 
-	// IceT setup.
-	Context ctx {&argc, &argv};
-
-	// This program is not distributed.
-	if (ctx.proc_rank() != 0) {
+		output::write(pixels, in.width(), in.height(), options, out_file);
+		fflush(out_file);
 		return EXIT_SUCCESS;
 		}
 
 	// Read input image.
 	auto       in_buffer {read_all(freopen(nullptr, "rb", stdin))};
-	auto const in_image  {icetImageUnpackageFromReceive(in_buffer.data())};
-
-	// Create PNG metadata.
-	png::image_info info;
-	info.set_width(icetImageGetWidth(in_image));
-	info.set_height(icetImageGetHeight(in_image));
-	info.set_bit_depth(Png::traits::get_bit_depth());
-	info.set_color_type(Png::traits::get_color_type());
-
-	// Write output image to the real stdout, then redirect it to stderr again for IceT's shutdown
-	// message.
-	ctx.restore_stdout();
-	IcetToPng{in_image, info}.write(std::cout);
-	ctx.stdout_to_stderr();
+	auto const in_image  {unpackage_image(in_buffer)};
+
+	// Write output image.
+	using Clock = cron::steady_clock;
+
+	auto const start_time {Clock::now()};
+	auto const size       {output::write(in_image, options, out_file)};
+	fflush(out_file);
+
+	// Report encoding throughput in terms of the size of the input pixels.
+	cron::duration<double> const seconds {Clock::now() - start_time};
+	auto const pixel_bytes {
+			4.0 * icetImageGetWidth(in_image) * icetImageGetHeight(in_image)
+			};
+
+	std::clog << log_sev_info << std::fixed << std::setprecision(3) << "Encoded "
+	          << icetImageGetWidth(in_image) << "x" << icetImageGetHeight(in_image) << " image into "
+	          << size << " bytes in " << seconds.count() * 1000 << " ms ("
+	          << pixel_bytes / seconds.count() / (1 << 20) << " MiB/s)\n";
 
 	return EXIT_SUCCESS;
 	});
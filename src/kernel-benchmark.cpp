@@ -0,0 +1,544 @@
+#include <chrono>
+#include <cstring>
+#include <random>
+
+#include "codec.hpp"
+#include "common.hpp"
+#include "layout.hpp"
+#include "simd.hpp"
+
+
+namespace {
+
+using namespace layered_icet;
+namespace cron = std::chrono;
+
+/// Number of times each measurement is repeated, of which the fastest is reported.
+constexpr int num_reps {5};
+
+/// Return the fastest of several executions of a function in seconds.
+template<typename TFn>
+auto time(TFn&& fn) -> double {
+	using Clock = cron::steady_clock;
+
+	auto best {cron::duration<double>::max()};
+
+	for (int rep {0}; rep < num_reps; ++rep) {
+		auto const start_time {Clock::now()};
+		fn();
+		best = std::min<cron::duration<double>>(best, Clock::now() - start_time);
+		}
+
+	return best.count();
+	}
+
+/// Generate an image with a random number of active fragments per pixel, sorted by depth.
+auto random_image(
+		IceTSizeType const width,
+		IceTSizeType const height,
+		IceTSizeType const num_layers,
+		std::mt19937&      rng
+		) -> RawImage {
+	return {width, height, num_layers, [&](IceTSizeType, std::span<Color> color, std::span<Depth> depth) {
+		auto const num_active {std::uniform_int_distribution<std::size_t>{0, color.size()}(rng)};
+
+		for (std::size_t layer {0}; layer < num_active; ++layer) {
+			color[layer] = {
+					static_cast<color::Channel>(rng()),
+					static_cast<color::Channel>(rng()),
+					static_cast<color::Channel>(rng()),
+					std::uniform_int_distribution<color::Channel>{1, color::channel_max}(rng),
+					};
+			depth[layer] = std::uniform_real_distribution<Depth>{}(rng);
+			}
+
+		std::sort(depth.begin(), depth.begin() + num_active);
+		}};
+	}
+
+/// Return whether two images contain exactly the same fragments.
+auto identical(RawImage const& lhs, RawImage const& rhs) -> bool {
+	return lhs.num_fragments() == rhs.num_fragments()
+	   and std::memcmp(lhs.color().data(), rhs.color().data(), lhs.color().size_bytes()) == 0
+	   and std::memcmp(lhs.depth().data(), rhs.depth().data(), lhs.depth().size_bytes()) == 0;
+	}
+
+/// Measure how merging scales with the number of threads.
+/// Arguments: <width> <height> <#images> <#layers> [<max #threads>]
+auto bench_merge(std::span<char*> args) -> int {
+	IceTSizeType width, height, num_images, num_layers;
+
+	if (args.size() < 4
+			or (width      = atoi(args[0])) <= 0
+			or (height     = atoi(args[1])) <= 0
+			or (num_images = atoi(args[2])) <= 0
+			or (num_layers = atoi(args[3])) <= 0
+			) {
+		std::cerr << log_sev_fatal << "Invalid or missing arguments.\n"
+		             "Usage: merge <width> <height> <#images> <#layers> [<max #threads>]\n";
+		return EXIT_FAILURE;
+		}
+
+	auto const max_threads {args.size() > 4 ? std::max(1, atoi(args[4])) : default_num_threads()};
+
+	// Generate input images.
+	std::mt19937          rng {0};
+	std::vector<RawImage> sources;
+
+	for (IceTSizeType i {0}; i < num_images; ++i) {
+		sources.push_back(random_image(width, height, num_layers, rng));
+		}
+
+	// The serial merge serves as reference for both speed and output.
+	RawImage const reference {width, height, sources, 1};
+
+	std::cout << "threads,seconds,speedup,identical\n";
+
+	double serial_time {0};
+
+	for (unsigned num_threads {1};; num_threads = std::min(num_threads * 2, max_threads)) {
+		RawImage   result;
+		auto const seconds {time([&]() {
+				result = RawImage{width, height, sources, num_threads};
+				})};
+
+		if (num_threads == 1) {
+			serial_time = seconds;
+			}
+
+		std::cout << num_threads << ',' << seconds << ',' << serial_time / seconds << ','
+		          << identical(result, reference) << '\n';
+
+		if (num_threads == max_threads) {
+			break;
+			}}
+
+	return EXIT_SUCCESS;
+	}
+
+/// Compare blending with each supported instruction set.
+/// Arguments: <width> <height> <#layers>
+auto bench_blend(std::span<char*> args) -> int {
+	IceTSizeType width, height, num_layers;
+
+	if (args.size() < 3
+			or (width      = atoi(args[0])) <= 0
+			or (height     = atoi(args[1])) <= 0
+			or (num_layers = atoi(args[2])) <= 0
+			) {
+		std::cerr << log_sev_fatal << "Invalid or missing arguments.\n"
+		             "Usage: blend <width> <height> <#layers>\n";
+		return EXIT_FAILURE;
+		}
+
+	// Generate input image.
+	std::mt19937   rng   {0};
+	RawImage const image {random_image(width, height, num_layers, rng)};
+
+	// The scalar kernel serves as reference for both speed and output.
+	std::vector<Color> reference (std::size_t(width) * height);
+	simd::blend_over(simd::Isa::scalar, image.color(), num_layers, reference);
+
+	std::cout << "isa,seconds,speedup,identical\n";
+
+	double scalar_time {0};
+
+	for (auto isa {simd::Isa::scalar}; isa <= simd::detect(); isa = simd::Isa{int(isa) + 1}) {
+		std::vector<Color> result (reference.size());
+		auto const         seconds {time([&]() {
+				simd::blend_over(isa, image.color(), num_layers, result);
+				})};
+
+		if (isa == simd::Isa::scalar) {
+			scalar_time = seconds;
+			}
+
+		std::cout << simd::name(isa) << ',' << seconds << ',' << scalar_time / seconds << ','
+		          << (result == reference) << '\n';
+		}
+
+	return EXIT_SUCCESS;
+	}
+
+/// Compare scanning for inactive pixels with each supported instruction set.
+/// Arguments: <width> <height> <#layers> <active fraction>
+auto bench_scan(std::span<char*> args) -> int {
+	IceTSizeType width, height, num_layers;
+	double       active_fraction;
+
+	if (args.size() < 4
+			or (width      = atoi(args[0])) <= 0
+			or (height     = atoi(args[1])) <= 0
+			or (num_layers = atoi(args[2])) <= 0
+			or (active_fraction = atof(args[3])) < 0
+			) {
+		std::cerr << log_sev_fatal << "Invalid or missing arguments.\n"
+		             "Usage: scan <width> <height> <#layers> <active fraction>\n";
+		return EXIT_FAILURE;
+		}
+
+	// Generate an input image with the given fraction of pixels being active.
+	std::mt19937   rng   {0};
+	RawImage const image {width, height, num_layers, [&](
+			IceTSizeType,
+			std::span<Color> color,
+			std::span<Depth>
+			) {
+		if (std::bernoulli_distribution{active_fraction}(rng)) {
+			color[0] = {0, 0, 0, color::channel_max};
+			}}};
+
+	// Count inactive pixels by skipping runs of them, each followed by an active pixel.
+	auto count_inactive = [&](simd::Isa const isa) {
+		auto const  colors     {image.color()};
+		auto const  num_pixels {static_cast<std::size_t>(image.num_pixels())};
+		std::size_t count      {0};
+
+		for (std::size_t pixel {0}; pixel < num_pixels; ++pixel) {
+			auto const run {simd::inactive_run(isa, colors.subspan(pixel * num_layers), num_layers)};
+
+			count += run;
+			pixel += run;
+			}
+
+		return count;
+		};
+
+	auto const reference {count_inactive(simd::Isa::scalar)};
+
+	std::cout << "isa,seconds,gb/s,identical\n";
+
+	for (auto isa {simd::Isa::scalar}; isa <= simd::detect(); isa = simd::Isa{int(isa) + 1}) {
+		std::size_t result  {0};
+		auto const  seconds {time([&]() {
+				result = count_inactive(isa);
+				})};
+
+		std::cout << simd::name(isa) << ',' << seconds << ','
+		          << image.color().size_bytes() / seconds / 1e9 << ','
+		          << (result == reference) << '\n';
+		}
+
+	return EXIT_SUCCESS;
+	}
+
+/// Write the active fragments of each pixel to `out` as their number followed by each of their
+/// colors and depths, like the pixel data of a sparse image, and return the number of bytes written.
+/// `out` must be large enough to hold every fragment.
+template<Layout TLayout>
+auto compress_generic(LayeredBuffer<TLayout> const& image, std::span<std::byte> const out)
+		-> std::size_t {
+	auto const num_layers {static_cast<std::size_t>(image.num_layers())};
+	auto       pos        {out.data()};
+
+	for (std::size_t pixel {0}; pixel < std::size_t(image.num_pixels()); ++pixel) {
+		IceTLayerCount num_active {0};
+
+		while (num_active < num_layers
+				and image.color(pixel, num_active)[color::alpha_channel] != 0
+				) {
+			++num_active;
+			}
+
+		pos = std::ranges::copy(std::as_bytes(std::span{&num_active, 1}), pos).out;
+
+		for (std::size_t layer {0}; layer < num_active; ++layer) {
+			auto const& frag_color {image.color(pixel, layer)};
+			auto const& frag_depth {image.depth(pixel, layer)};
+
+			pos = std::ranges::copy(std::as_bytes(std::span{&frag_color, 1}), pos).out;
+			pos = std::ranges::copy(std::as_bytes(std::span{&frag_depth, 1}), pos).out;
+			}}
+
+	return pos - out.data();
+	}
+
+/// Print the time taken by the merge and blend kernels, and a generic compression, on images in a
+/// given layout.
+/// Results are compared to those on planar images.
+template<Layout TLayout>
+auto bench_layout_kernels(
+		std::span<RawImage const>  sources,
+		RawImage const&            merged,
+		std::span<Color const>     blended,
+		std::span<std::byte const> compressed
+		) -> void {
+	auto const num_layers {sources[0].num_layers()};
+
+	std::vector<LayeredBuffer<TLayout>> images;
+
+	for (auto const& source : sources) {
+		images.emplace_back(source);
+		}
+
+	auto print = [&](std::string_view const kernel, double const seconds, bool const identical) {
+		std::cout << num_layers << ',' << TLayout::name << ',' << kernel << ',' << seconds << ','
+		          << identical << '\n';
+		};
+
+	LayeredBuffer<TLayout> merge_result;
+	auto const             merge_seconds {time([&]() {
+			merge_result = merge<TLayout>(merged.width(), merged.height(), images);
+			})};
+
+	print("merge", merge_seconds, identical(merge_result.to_raw(), merged));
+
+	std::vector<std::byte> compress_result (compressed.size());
+	std::size_t            compress_size   {0};
+	auto const             compress_seconds {time([&]() {
+			compress_size = compress_generic(images[0], compress_result);
+			})};
+
+	print("compress", compress_seconds, std::ranges::equal(
+			std::span{compress_result}.first(compress_size),
+			compressed
+			));
+
+	std::vector<Color> blend_result (blended.size());
+	auto const         blend_seconds {time([&]() {
+			simd::blend_over(images[0], blend_result);
+			})};
+
+	print("blend", blend_seconds, std::ranges::equal(blend_result, blended));
+	}
+
+/// Compare fragment buffer layouts for merging, compressing and blending at increasing numbers of
+/// layers.
+/// Arguments: <width> <height> <max #layers>
+auto bench_layout(std::span<char*> args) -> int {
+	IceTSizeType width, height, max_layers;
+
+	if (args.size() < 3
+			or (width      = atoi(args[0])) <= 0
+			or (height     = atoi(args[1])) <= 0
+			or (max_layers = atoi(args[2])) <= 0
+			) {
+		std::cerr << log_sev_fatal << "Invalid or missing arguments.\n"
+		             "Usage: layout <width> <height> <max #layers>\n";
+		return EXIT_FAILURE;
+		}
+
+	std::mt19937 rng {0};
+
+	std::cout << "layers,layout,kernel,seconds,identical\n";
+
+	for (IceTSizeType num_layers {1};; num_layers = std::min(num_layers * 2, max_layers)) {
+		// Generate two input images, of which the first one is compressed and blended.
+		std::vector<RawImage> sources;
+		sources.push_back(random_image(width, height, num_layers, rng));
+		sources.push_back(random_image(width, height, num_layers, rng));
+
+		// Kernels on planar images serve as reference.
+		RawImage const merged {width, height, sources, 1};
+
+		std::vector<Color> blended (std::size_t(width) * height);
+		simd::blend_over(simd::Isa::scalar, sources[0].color(), num_layers, blended);
+
+		std::vector<std::byte> compressed (
+				blended.size() * sizeof(IceTLayerCount)
+				+ sources[0].color().size_bytes()
+				+ sources[0].depth().size_bytes()
+				);
+		compressed.resize(compress_generic(LayeredBuffer<layout::Planar>{sources[0]}, compressed));
+
+		bench_layout_kernels<layout::Planar>     (sources, merged, blended, compressed);
+		bench_layout_kernels<layout::Interleaved>(sources, merged, blended, compressed);
+		bench_layout_kernels<layout::Blocked>    (sources, merged, blended, compressed);
+
+		if (num_layers == max_layers) {
+			break;
+			}}
+
+	return EXIT_SUCCESS;
+	}
+
+/// Compare dense and packed images for merging, compressing and blending, with the number of active
+/// fragments per pixel following a geometric distribution of the given mean.
+/// Arguments: <width> <height> <max #layers> <mean #fragments>
+auto bench_csr(std::span<char*> args) -> int {
+	IceTSizeType width, height, num_layers;
+	double       mean_fragments;
+
+	if (args.size() < 4
+			or (width          = atoi(args[0])) <= 0
+			or (height         = atoi(args[1])) <= 0
+			or (num_layers     = atoi(args[2])) <= 0
+			or (mean_fragments = atof(args[3])) <= 0
+			) {
+		std::cerr << log_sev_fatal << "Invalid or missing arguments.\n"
+		             "Usage: csr <width> <height> <max #layers> <mean #fragments>\n";
+		return EXIT_FAILURE;
+		}
+
+	// Generate two input images.
+	std::mt19937                              rng   {0};
+	std::geometric_distribution<IceTSizeType> count {1 / (1 + mean_fragments)};
+	std::vector<RawImage>                     dense;
+
+	for (int i {0}; i < 2; ++i) {
+		dense.emplace_back(width, height, num_layers, [&](
+				IceTSizeType,
+				std::span<Color> color,
+				std::span<Depth> depth
+				) {
+			auto const num_active {std::min(count(rng), num_layers)};
+
+			for (IceTSizeType layer {0}; layer < num_active; ++layer) {
+				color[layer] = {
+						static_cast<color::Channel>(rng()),
+						static_cast<color::Channel>(rng()),
+						static_cast<color::Channel>(rng()),
+						std::uniform_int_distribution<color::Channel>{1, color::channel_max}(rng),
+						};
+				depth[layer] = std::uniform_real_distribution<Depth>{}(rng);
+				}
+
+			std::sort(depth.begin(), depth.begin() + num_active);
+			});
+		}
+
+	std::vector<CsrImage> packed;
+
+	for (auto const& image : dense) {
+		packed.emplace_back(image);
+		}
+
+	// Time each kernel on dense images.
+	RawImage               dense_merged;
+	std::vector<Color>     dense_blended (std::size_t(width) * height);
+	std::vector<std::byte> dense_compressed;
+
+	auto const dense_merge {time([&]() {
+			dense_merged = RawImage{width, height, dense, 1};
+			})};
+	auto const dense_compress {time([&]() {
+			SparseImageCompressor const compressor {dense[0]};
+			dense_compressed.resize(compressor.stats().size);
+			compressor.write(dense_compressed);
+			})};
+	auto const dense_blend {time([&]() {
+			simd::blend_over(dense[0].color(), num_layers, dense_blended);
+			})};
+
+	// Time each kernel on packed images.
+	CsrImage               packed_merged;
+	std::vector<Color>     packed_blended (dense_blended.size());
+	std::vector<std::byte> packed_compressed;
+
+	auto const packed_merge {time([&]() {
+			packed_merged = CsrImage{width, height, packed, 1};
+			})};
+	auto const packed_compress {time([&]() {
+			SparseImageCompressor const compressor {packed[0]};
+			packed_compressed.resize(compressor.stats().size);
+			compressor.write(packed_compressed);
+			})};
+	auto const packed_blend {time([&]() {
+			simd::blend_over(packed[0].offsets(), packed[0].color(), packed_blended);
+			})};
+
+	auto const dense_size {dense[0].color().size_bytes() + dense[0].depth().size_bytes()};
+
+	std::cout << "format,bytes,merge,compress,blend,identical\n"
+	          << "dense," << dense_size << ',' << dense_merge << ',' << dense_compress << ','
+	          << dense_blend << ",1\n"
+	          << "csr," << packed[0].size_bytes() << ',' << packed_merge << ','
+	          << packed_compress << ',' << packed_blend << ','
+	          << (identical(packed_merged.to_raw(dense_merged.num_layers()), dense_merged)
+	              and packed_compressed == dense_compressed
+	              and packed_blended == dense_blended)
+	          << '\n';
+
+	return EXIT_SUCCESS;
+	}
+
+/// Measure the compression ratio and throughput of the lossless frame codec on frame files.
+/// Throughput is relative to the size of the decoded fragments.
+/// Arguments: [--threads <#threads>] <frame file>...
+auto bench_codec(std::span<char*> args) -> int {
+	auto num_threads {1u};
+
+	if (args.size() >= 2 and std::string_view{args[0]} == "--threads") {
+		num_threads = std::max(1, atoi(args[1]));
+		args        = args.subspan(2);
+		}
+
+	if (args.empty()) {
+		std::cerr << log_sev_fatal << "Missing arguments.\n"
+		             "Usage: codec [--threads <#threads>] <frame file>...\n";
+		return EXIT_FAILURE;
+		}
+
+	std::cout << "file,raw bytes,encoded bytes,ratio,encode gb/s,decode gb/s,identical\n";
+
+	for (auto const path : args) {
+		FILE* const file {fopen(path, "rb")};
+
+		if (not file) {
+			std::cerr << log_sev_fatal << "Could not open " << path << ".\n";
+			return EXIT_FAILURE;
+			}
+
+		RawImage const image {0, 0, file};
+		fclose(file);
+
+		auto const raw_size {image.color().size_bytes() + image.depth().size_bytes()};
+
+		std::vector<std::byte> encoded;
+		auto const             encode_seconds {time([&]() {
+				encoded = codec::encode(image, num_threads);
+				})};
+
+		RawImage   decoded;
+		auto const decode_seconds {time([&]() {
+				decoded = codec::decode(encoded, num_threads);
+				})};
+
+		std::cout << path << ',' << raw_size << ',' << encoded.size() << ','
+		          << static_cast<double>(raw_size) / encoded.size() << ','
+		          << raw_size / encode_seconds / 1e9 << ',' << raw_size / decode_seconds / 1e9 << ','
+		          << identical(decoded, image) << '\n';
+		}
+
+	return EXIT_SUCCESS;
+	}
+
+} // namespace
+
+
+/// Measure the performance of image processing kernels outside of IceT.
+/// Arguments: <kernel> <kernel arguments>...
+auto main(int argc, char* argv[]) -> int {
+	return try_main([&]() {
+
+	std::span const args {argv, static_cast<std::size_t>(argc)};
+
+	if (args.size() >= 2 and std::string_view{args[1]} == "merge") {
+		return bench_merge(args.subspan(2));
+		}
+
+	if (args.size() >= 2 and std::string_view{args[1]} == "blend") {
+		return bench_blend(args.subspan(2));
+		}
+
+	if (args.size() >= 2 and std::string_view{args[1]} == "scan") {
+		return bench_scan(args.subspan(2));
+		}
+
+	if (args.size() >= 2 and std::string_view{args[1]} == "layout") {
+		return bench_layout(args.subspan(2));
+		}
+
+	if (args.size() >= 2 and std::string_view{args[1]} == "csr") {
+		return bench_csr(args.subspan(2));
+		}
+
+	if (args.size() >= 2 and std::string_view{args[1]} == "codec") {
+		return bench_codec(args.subspan(2));
+		}
+
+	std::cerr << log_sev_fatal << "Invalid or missing kernel.\n"
+	             "Usage: " << args[0] << " merge|blend|scan|layout|csr|codec <arguments>...\n";
+	return EXIT_FAILURE;
+	});
+	}
@@ -1,12 +1,76 @@
 #include "common.hpp"
 
 
-/// Assemble PNG files into a single layered fragment buffer.
-/// Arguments: <width> <height> [<image>]...
+namespace {
+
+using namespace layered_icet;
+
+/// Number of rows decoded from all layers at once when writing a sparse image.
+constexpr IceTSizeType sparse_band_height {32};
+
+/// Assemble PNG files directly into a layered `IceTSparseImage`, without a dense fragment buffer.
+/// Layers are decoded in bands of rows, so memory use is bounded by the band size and the number of
+/// active fragments.
+auto write_sparse(
+		IceTSizeType const          width,
+		IceTSizeType const          height,
+		std::span<InputLayer const> layers,
+		FILE* const                 out_file
+		) -> void {
+	auto const num_layers {layers.size()};
+	auto const row_size   {std::size_t(width) * num_layers};
+
+	LayeredPngReader  in  {width, height, layers};
+	SparseImageWriter out {width, height, out_file};
+
+	// Fragments of the current pixel.
+	std::vector<Color> frag_color;
+	std::vector<Depth> frag_depth;
+
+	for (IceTSizeType first_row {0}; first_row < height; first_row += sparse_band_height) {
+		auto const num_rows {std::min(sparse_band_height, height - first_row)};
+		auto const band     {in.next_band(num_rows, default_num_threads())};
+
+		// Append each pixel's active fragments in the order of their layers.
+		for (std::size_t pixel {0}; pixel < num_rows * row_size; pixel += num_layers) {
+			frag_color.clear();
+			frag_depth.clear();
+
+			for (std::size_t layer {0}; layer < num_layers; ++layer) {
+				if (band[pixel + layer][color::alpha_channel] != 0) {
+					frag_color.push_back(band[pixel + layer]);
+					frag_depth.push_back(layers[layer].depth);
+					}}
+
+			if (frag_color.empty()) {
+				out.push_inactive();
+				}
+			else {
+				out.push_active(frag_color, frag_depth);
+				}}}
+
+	out.finish();
+	}
+
+} // namespace
+
+
+/// Assemble PNG files into a single layered frame file.
+/// With `--sparse`, output a layered `IceTSparseImage` like `compress` would, but without
+/// assembling the dense fragment buffer first.
+/// Arguments: [--sparse] <width> <height> [<image>]...
 auto main(int argc, char* argv[]) -> int {
-	using namespace layered_icet;
 	return try_main([&]() {
 
+	// Parse options, then drop them from the arguments.
+	auto const sparse {argc >= 2 and std::string_view{argv[1]} == "--sparse"};
+
+	if (sparse) {
+		argv[1] = argv[0];
+		++argv;
+		--argc;
+		}
+
 	// Parse output size.
 	IceTSizeType width, height;
 
@@ -15,7 +79,7 @@ auto main(int argc, char* argv[]) -> int {
 			or (height = atoi(argv[2])) == 0
 			) {
 		std::cerr << log_sev_fatal << "Invalid or missing arguments.\n"
-		             "Usage: " << argv[0] << " <width> <height> [<image>]...\n";
+		             "Usage: " << argv[0] << " [--sparse] <width> <height> [<image>]...\n";
 		return EXIT_FAILURE;
 		}
 
@@ -26,8 +90,20 @@ auto main(int argc, char* argv[]) -> int {
 		in_layers.span()[i] = {argv[i + 3], static_cast<float>(i) / (argc - 3)};
 		}
 
+	// Write a sparse image, which requires IceT to format its header.
+	if (sparse) {
+		Context ctx {&argc, &argv};
+
+		// This program is not distributed.
+		if (ctx.proc_rank() == 0) {
+			write_sparse(width, height, in_layers.span(), fdopen(ctx.stdout(), "wb"));
+			}
+
+		return EXIT_SUCCESS;
+		}
+
 	// Construct a raw layered image from input images.
-	RawImage const out_buffer {width, height, in_layers.span()};
+	RawImage const out_buffer {width, height, in_layers.span(), default_num_threads()};
 
 	// Output the image.
 	out_buffer.write(freopen(nullptr, "wb", stdout));
@@ -0,0 +1,264 @@
+#pragma once
+
+#include <concepts>
+#include <cstddef>
+#include <string_view>
+#include <vector>
+
+#include "common.hpp"
+
+
+namespace layered_icet {
+
+/// Memory layouts of layered fragment buffers.
+/// Each layout places the color and depth of layer `l` of pixel `p` at index
+/// `p * pixel_stride(num_layers) + l * layer_stride` counted from `color_start` and `depth_start`,
+/// in units of colors, which are as large as depths, so offsets need no division.
+namespace layout {
+
+static_assert(sizeof(Color) == sizeof(Depth));
+
+/// All colors followed by all depths, as IceT expects and `RawImage` stores them.
+struct Planar {
+	static constexpr std::string_view name         {"planar"};
+	static constexpr std::size_t      layer_stride {1};
+
+	[[nodiscard]] static constexpr auto pixel_stride(std::size_t const num_layers) noexcept
+			-> std::size_t {
+		return num_layers;
+		}
+
+	[[nodiscard]] static constexpr auto color_start(std::size_t, std::size_t) noexcept
+			-> std::size_t {
+		return 0;
+		}
+
+	[[nodiscard]] static constexpr auto depth_start(
+			std::size_t const num_pixels,
+			std::size_t const num_layers
+			) noexcept -> std::size_t {
+		return num_pixels * num_layers;
+		}
+
+	};
+
+/// Each color directly followed by its depth, as a `Fragment`.
+struct Interleaved {
+	static_assert(sizeof(Fragment) == sizeof(Color) + sizeof(Depth));
+	static_assert(offsetof(Fragment, color) == 0 and offsetof(Fragment, depth) == sizeof(Color));
+
+	static constexpr std::string_view name         {"interleaved"};
+	static constexpr std::size_t      layer_stride {2};
+
+	[[nodiscard]] static constexpr auto pixel_stride(std::size_t const num_layers) noexcept
+			-> std::size_t {
+		return 2 * num_layers;
+		}
+
+	[[nodiscard]] static constexpr auto color_start(std::size_t, std::size_t) noexcept
+			-> std::size_t {
+		return 0;
+		}
+
+	[[nodiscard]] static constexpr auto depth_start(std::size_t, std::size_t) noexcept
+			-> std::size_t {
+		return 1;
+		}
+
+	};
+
+/// The colors of each pixel followed by its depths, so each pixel occupies one contiguous block.
+struct Blocked {
+	static constexpr std::string_view name         {"blocked"};
+	static constexpr std::size_t      layer_stride {1};
+
+	[[nodiscard]] static constexpr auto pixel_stride(std::size_t const num_layers) noexcept
+			-> std::size_t {
+		return 2 * num_layers;
+		}
+
+	[[nodiscard]] static constexpr auto color_start(std::size_t, std::size_t) noexcept
+			-> std::size_t {
+		return 0;
+		}
+
+	[[nodiscard]] static constexpr auto depth_start(std::size_t, std::size_t const num_layers)
+			noexcept -> std::size_t {
+		return num_layers;
+		}
+
+	};
+
+} // namespace layout
+
+
+/// A policy placing the colors and depths of a layered image in memory.
+/// Arguments of the start functions are the number of pixels and the number of layers.
+template<typename TLayout>
+concept Layout = requires (std::size_t const size) {
+	{TLayout::name}                     -> std::convertible_to<std::string_view>;
+	{TLayout::layer_stride}             -> std::convertible_to<std::size_t>;
+	{TLayout::pixel_stride(size)}       -> std::same_as<std::size_t>;
+	{TLayout::color_start(size, size)}  -> std::same_as<std::size_t>;
+	{TLayout::depth_start(size, size)}  -> std::same_as<std::size_t>;
+	};
+
+
+/// A dense layered image whose fragments are stored in a layout chosen at compile time.
+/// Planar images convert to and from `RawImage` by handing over their buffer, other layouts are
+/// only converted explicitly, fragment by fragment.
+template<Layout TLayout>
+class LayeredBuffer {
+public:
+	using LayoutType = TLayout;
+
+	[[nodiscard]] LayeredBuffer() noexcept = default;
+
+	/// Allocate an image of `num_layers` inactive fragments per pixel.
+	/// Inactive fragments are zero, including their depth, as in `RawImage`.
+	[[nodiscard]] LayeredBuffer(
+			IceTSizeType const width,
+			IceTSizeType const height,
+			IceTSizeType const num_layers
+			)
+		: _width      {width}
+		, _height     {height}
+		, _num_layers {num_layers}
+		, _buffer     (std::size_t(num_fragments()) * (sizeof(Color) + sizeof(Depth)))
+		{}
+
+	/// Convert an image from the planar layout.
+	[[nodiscard]] explicit LayeredBuffer(RawImage const& image)
+		: LayeredBuffer{image.width(), image.height(), image.num_layers()}
+		{
+		if constexpr (std::same_as<TLayout, layout::Planar>) {
+			auto const out {std::ranges::copy(std::as_bytes(image.color()), _buffer.begin()).out};
+			std::ranges::copy(std::as_bytes(image.depth()), out);
+			}
+		else {
+			auto const layers {static_cast<std::size_t>(_num_layers)};
+
+			for (std::size_t pixel {0}; pixel < std::size_t(num_pixels()); ++pixel) {
+				for (std::size_t layer {0}; layer < layers; ++layer) {
+					color(pixel, layer) = image.color()[pixel * layers + layer];
+					depth(pixel, layer) = image.depth()[pixel * layers + layer];
+					}}}}
+
+	/// Convert the image to the planar layout.
+	/// Planar images hand over their buffer, leaving this image empty.
+	[[nodiscard]] auto to_raw() && -> RawImage {
+		if constexpr (std::same_as<TLayout, layout::Planar>) {
+			auto const width  {std::exchange(_width,      0)};
+			auto const height {std::exchange(_height,     0)};
+			auto const layers {std::exchange(_num_layers, 0)};
+			return {width, height, layers, std::move(_buffer)};
+			}
+		else {
+			return to_raw();
+			}}
+
+	/// Copy the image into the planar layout.
+	[[nodiscard]] auto to_raw() const& -> RawImage {
+		auto const layers {static_cast<std::size_t>(_num_layers)};
+
+		return {_width, _height, _num_layers, [&](
+				IceTSizeType const     pixel,
+				std::span<Color> const out_color,
+				std::span<Depth> const out_depth
+				) {
+			for (std::size_t layer {0}; layer < layers; ++layer) {
+				out_color[layer] = color(pixel, layer);
+				out_depth[layer] = depth(pixel, layer);
+				}}};
+		}
+
+	[[nodiscard]] constexpr auto width() const noexcept -> IceTSizeType {
+		return _width;
+		}
+
+	[[nodiscard]] constexpr auto height() const noexcept -> IceTSizeType {
+		return _height;
+		}
+
+	[[nodiscard]] constexpr auto num_layers() const noexcept -> IceTSizeType {
+		return _num_layers;
+		}
+
+	[[nodiscard]] constexpr auto num_pixels() const noexcept -> IceTSizeType {
+		return _width * _height;
+		}
+
+	[[nodiscard]] constexpr auto num_fragments() const noexcept -> IceTSizeType {
+		return num_pixels() * _num_layers;
+		}
+
+	/// Return the number of colors or depths between the first fragments of consecutive pixels.
+	[[nodiscard]] constexpr auto pixel_stride() const noexcept -> std::size_t {
+		return TLayout::pixel_stride(static_cast<std::size_t>(_num_layers));
+		}
+
+	/// Return the color of the first fragment, from which the others are strided.
+	[[nodiscard]] auto colors() noexcept -> Color* {
+		return reinterpret_cast<Color*>(_buffer.data()) + TLayout::color_start(
+				static_cast<std::size_t>(num_pixels()),
+				static_cast<std::size_t>(_num_layers)
+				);
+		}
+
+	[[nodiscard]] auto colors() const noexcept -> Color const* {
+		return const_cast<LayeredBuffer&>(*this).colors();
+		}
+
+	/// Return the depth of the first fragment, from which the others are strided.
+	[[nodiscard]] auto depths() noexcept -> Depth* {
+		return reinterpret_cast<Depth*>(_buffer.data()) + TLayout::depth_start(
+				static_cast<std::size_t>(num_pixels()),
+				static_cast<std::size_t>(_num_layers)
+				);
+		}
+
+	[[nodiscard]] auto depths() const noexcept -> Depth const* {
+		return const_cast<LayeredBuffer&>(*this).depths();
+		}
+
+	/// Return the color of a layer of a pixel.
+	[[nodiscard]] auto color(std::size_t const pixel, std::size_t const layer) noexcept -> Color& {
+		return colors()[pixel * pixel_stride() + layer * TLayout::layer_stride];
+		}
+
+	[[nodiscard]] auto color(std::size_t const pixel, std::size_t const layer) const noexcept
+			-> Color const& {
+		return colors()[pixel * pixel_stride() + layer * TLayout::layer_stride];
+		}
+
+	/// Return the depth of a layer of a pixel.
+	[[nodiscard]] auto depth(std::size_t const pixel, std::size_t const layer) noexcept -> Depth& {
+		return depths()[pixel * pixel_stride() + layer * TLayout::layer_stride];
+		}
+
+	[[nodiscard]] auto depth(std::size_t const pixel, std::size_t const layer) const noexcept
+			-> Depth const& {
+		return depths()[pixel * pixel_stride() + layer * TLayout::layer_stride];
+		}
+
+private:
+	IceTSizeType           _width      {0};
+	IceTSizeType           _height     {0};
+	IceTSizeType           _num_layers {0};
+	std::vector<std::byte> _buffer     {};
+
+	};
+
+
+/// Merge images into one of the given size like the merging `RawImage` constructor, with the same
+/// kernel, keeping their layout.
+/// Defined for the layouts of namespace `layout`.
+template<Layout TLayout>
+[[nodiscard]] auto merge(
+		IceTSizeType                            width,
+		IceTSizeType                            height,
+		std::span<LayeredBuffer<TLayout> const> sources,
+		unsigned                                num_threads = 1
+		) -> LayeredBuffer<TLayout>;
+
+} // namespace layered_icet
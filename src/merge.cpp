@@ -3,11 +3,35 @@
 
 /// Combine multiple raw layered fragments buffers into one by merging the fragments lists at each
 /// pixel in order.
-/// Arguments: <width> <height> [<color> <depth>]...
+/// Each input is either a self-describing frame file or a pair of headerless color and depth files.
+/// With `--packed`, inputs are packed into lists of their active fragments before merging, and the
+/// result has as many layers as its pixel with the most fragments.
+/// Arguments: [--threads <#threads>] [--packed] <width> <height> [<frame> | <color> <depth>]...
 auto main(int argc, char* argv[]) -> int {
 	using namespace layered_icet;
 	return try_main([&]() {
 
+	// Parse options, then drop them from the arguments.
+	auto num_threads {default_num_threads()};
+	auto packed      {false};
+
+	for (;;) {
+		if (argc >= 3 and std::string_view{argv[1]} == "--threads") {
+			num_threads = std::max(1, atoi(argv[2]));
+			argv[2]     = argv[0];
+			argv       += 2;
+			argc       -= 2;
+			}
+		else if (argc >= 2 and std::string_view{argv[1]} == "--packed") {
+			packed  = true;
+			argv[1] = argv[0];
+			argv   += 1;
+			argc   -= 1;
+			}
+		else {
+			break;
+			}}
+
 	// Parse output size.
 	IceTSizeType width, height;
 
@@ -16,25 +40,59 @@ auto main(int argc, char* argv[]) -> int {
 			or (height = atoi(argv[2])) == 0
 			) {
 		std::cerr << log_sev_fatal << "Invalid or missing arguments.\n"
-		             "Usage: " << argv[0] << " <width> <height> [<color> <depth>]...\n";
+		             "Usage: " << argv[0] << " [--threads <#threads>] [--packed] <width> <height> "
+		                                     "[<frame> | <color> <depth>]...\n";
 		return EXIT_FAILURE;
 		}
 
-	// Read input images.
-	auto const            num_images {int_cast<std::size_t>(argc - 3) / 2};
+	// Read input images, packing each one right away if requested.
 	std::vector<RawImage> in_buffers;
-	in_buffers.reserve(num_images);
+	std::vector<CsrImage> packed_buffers;
+
+	auto open = [&](int const argi) {
+		if (argi >= argc) {
+			throw std::runtime_error{concat("Missing depth file for ", argv[argi - 1])};
+			}
+
+		if (auto* const file {fopen(argv[argi], "rb")}) {
+			return file;
+			}
+
+		throw std::runtime_error{concat("Could not open ", argv[argi])};
+		};
+
+	auto read = [&](int& argi) {
+		auto* const file {open(argi)};
+
+		// Frame files may be smaller than the output image.
+		if (FrameInfo::probe(file)) {
+			return RawImage{0, 0, file};
+			}
+
+		return RawImage{width, height, file, open(++argi)};
+		};
+
+	for (auto argi {3}; argi < argc; ++argi) {
+		if (packed) {
+			packed_buffers.emplace_back(read(argi), num_threads);
+			}
+		else {
+			in_buffers.push_back(read(argi));
+			}}
+
+	auto* const out_file {freopen(nullptr, "wb", stdout)};
 
-	for (std::size_t i {0}; i < num_images; ++i) {
-		std::span const files {&argv[3 + 2*i], 2};
-		in_buffers.emplace_back(width, height, fopen(files[0], "rb"), fopen(files[1], "rb"));
+	// Merge fragment lists, then unpack only as many layers as needed.
+	if (packed) {
+		CsrImage{width, height, packed_buffers, num_threads}.to_raw().write(out_file);
+		return EXIT_SUCCESS;
 		}
 
 	// Merge images.
-	RawImage out_buffer {width, height, in_buffers};
+	RawImage out_buffer {width, height, in_buffers, num_threads};
 
 	// Output result image.
-	out_buffer.write(freopen(nullptr, "wb", stdout));
+	out_buffer.write(out_file);
 	return EXIT_SUCCESS;
 	});
 	}
@@ -0,0 +1,542 @@
+#include "output.hpp"
+
+#include <cstring>
+
+#include <fcntl.h>
+#include <zlib.h>
+
+
+namespace layered_icet {
+
+namespace output {
+
+namespace {
+
+/// Number of uncompressed bytes deflated as an independent chunk, as in pigz.
+constexpr std::size_t chunk_bytes {128 * 1024};
+
+/// Size of the window of deflate, which is primed with the end of the previous chunk so splitting
+/// the data barely affects the compression ratio.
+constexpr std::size_t window_bytes {32 * 1024};
+
+/// Number of rows filtered as a block by one thread.
+constexpr std::size_t block_rows {16};
+
+using Byte = std::uint8_t;
+
+/// Return the predictor of the Paeth filter.
+constexpr auto paeth(int const left, int const up, int const up_left) noexcept -> int {
+	auto const estimate     {left + up - up_left};
+	auto const dist_left    {std::abs(estimate - left)};
+	auto const dist_up      {std::abs(estimate - up)};
+	auto const dist_up_left {std::abs(estimate - up_left)};
+
+	if (dist_left <= dist_up and dist_left <= dist_up_left) {
+		return left;
+		}
+
+	return dist_up <= dist_up_left ? up : up_left;
+	}
+
+/// Filter a row of pixels, where `prev` is the previous row, or zeros for the first row.
+auto filter_row(
+		Filter const                filter,
+		std::span<Byte const> const row,
+		std::span<Byte const> const prev,
+		std::span<Byte> const       out
+		) noexcept -> void {
+	constexpr std::size_t bpp {sizeof(Color)};
+
+	for (std::size_t idx {0}; idx < row.size(); ++idx) {
+		int const left    {idx >= bpp ? row[idx - bpp] : 0};
+		int const up      {prev[idx]};
+		int const up_left {idx >= bpp ? prev[idx - bpp] : 0};
+
+		int predictor {0};
+
+		switch (filter) {
+			case Filter::none:
+			case Filter::adaptive:
+				break;
+			case Filter::sub:
+				predictor = left;
+				break;
+			case Filter::up:
+				predictor = up;
+				break;
+			case Filter::average:
+				predictor = (left + up) / 2;
+				break;
+			case Filter::paeth:
+				predictor = paeth(left, up, up_left);
+				break;
+			}
+
+		out[idx] = static_cast<Byte>(row[idx] - predictor);
+		}}
+
+/// Return the sum of the absolute values of filtered bytes interpreted as signed, which estimates
+/// how well they compress.
+auto filter_cost(std::span<Byte const> const filtered) noexcept -> std::uint64_t {
+	std::uint64_t cost {0};
+
+	for (auto const byte : filtered) {
+		cost += std::abs(static_cast<std::int8_t>(byte));
+		}
+
+	return cost;
+	}
+
+/// Return a value in big-endian byte order, as used by PNG.
+constexpr auto big_endian(std::uint32_t const value) noexcept -> std::array<std::byte, 4> {
+	return {
+		std::byte(value >> 24),
+		std::byte(value >> 16),
+		std::byte(value >>  8),
+		std::byte(value),
+		};
+	}
+
+/// Write a PNG chunk and return its size in bytes.
+auto write_chunk(std::string_view const type, std::span<std::byte const> const data, FILE* out)
+		-> std::size_t {
+	auto const type_bytes {std::as_bytes(std::span{type})};
+
+	// Passing a null pointer to zlib's checksums resets them, so skip empty data.
+	auto crc {crc32(0, nullptr, 0)};
+	crc = crc32(crc, reinterpret_cast<Bytef const*>(type_bytes.data()), type_bytes.size());
+
+	if (not data.empty()) {
+		crc = crc32(crc, reinterpret_cast<Bytef const*>(data.data()), data.size());
+		}
+
+	write_binary(std::span<std::byte const>{big_endian(data.size())}, out);
+	write_binary(type_bytes, out);
+	write_binary(data, out);
+	write_binary(std::span<std::byte const>{big_endian(crc)}, out);
+
+	return 12 + data.size();
+	}
+
+auto write_png(
+		std::span<Color const> const pixels,
+		IceTSizeType const           width,
+		IceTSizeType const           height,
+		Options const&               options,
+		FILE* const                  out
+		) -> std::size_t {
+	auto const row_bytes      {std::size_t(width) * sizeof(Color)};
+	auto const filtered_bytes {row_bytes + 1};
+	auto const num_rows       {std::size_t(height)};
+	auto const source         {std::span{reinterpret_cast<Byte const*>(pixels.data()),
+	                                     num_rows * row_bytes}};
+
+	// Filter rows in parallel, each preceded by its filter type.
+	UniqueSpan<Byte> const  filtered {num_rows * filtered_bytes};
+	std::vector<Byte> const zeros    (row_bytes);
+
+	parallel_for(num_rows, block_rows, options.num_threads, [&](
+			std::size_t const row_begin,
+			std::size_t const row_end,
+			unsigned
+			) {
+		std::vector<Byte> candidate (options.filter == Filter::adaptive ? row_bytes : 0);
+
+		for (auto row {row_begin}; row < row_end; ++row) {
+			auto const in   {source.subspan(row * row_bytes, row_bytes)};
+			auto const prev {row > 0 ? source.subspan((row - 1) * row_bytes, row_bytes)
+			                         : std::span{zeros}};
+			auto const dest {filtered.span().subspan(row * filtered_bytes, filtered_bytes)};
+
+			if (options.filter != Filter::adaptive) {
+				dest[0] = static_cast<Byte>(options.filter);
+				filter_row(options.filter, in, prev, dest.subspan(1));
+				continue;
+				}
+
+			// Choose the cheapest filter.
+			auto best_cost {std::numeric_limits<std::uint64_t>::max()};
+
+			for (auto const filter : {
+					Filter::none, Filter::sub, Filter::up, Filter::average, Filter::paeth
+					}) {
+				filter_row(filter, in, prev, candidate);
+
+				if (auto const cost {filter_cost(candidate)}; cost < best_cost) {
+					best_cost = cost;
+					dest[0]   = static_cast<Byte>(filter);
+					std::copy(candidate.begin(), candidate.end(), dest.begin() + 1);
+					}}}});
+
+	// Deflate chunks of whole rows independently in parallel. Every chunk but the last ends on a
+	// byte boundary without marking the end of the stream, so they can be concatenated.
+	auto const data           {filtered.span()};
+	auto const rows_per_chunk {std::max<std::size_t>(chunk_bytes / filtered_bytes, 1)};
+	auto const num_chunks     {std::max<std::size_t>(
+			(num_rows + rows_per_chunk - 1) / rows_per_chunk, 1
+			)};
+
+	std::vector<std::vector<std::byte>> chunks   (num_chunks);
+	std::vector<uLong>                  adler32s (num_chunks);
+
+	parallel_for(num_chunks, 1, options.num_threads, [&](
+			std::size_t const chunk_begin,
+			std::size_t const chunk_end,
+			unsigned
+			) {
+		for (auto chunk {chunk_begin}; chunk < chunk_end; ++chunk) {
+			auto const begin {std::min(chunk * rows_per_chunk * filtered_bytes, data.size())};
+			auto const end   {std::min(begin + rows_per_chunk * filtered_bytes, data.size())};
+			auto const input {data.subspan(begin, end - begin)};
+			auto const last  {chunk + 1 == num_chunks};
+
+			z_stream stream {};
+
+			if (deflateInit2(
+					&stream,
+					options.level,
+					Z_DEFLATED,
+					-15,
+					8,
+					options.filter == Filter::none ? Z_DEFAULT_STRATEGY : Z_FILTERED
+					) != Z_OK) {
+				throw std::runtime_error{"Could not initialize deflate"};
+				}
+
+			// Prime the window with the end of the previous chunk.
+			if (begin > 0) {
+				auto const dict_size {std::min(begin, window_bytes)};
+				deflateSetDictionary(&stream, data.data() + begin - dict_size, dict_size);
+				}
+
+			// The bound does not account for the empty block ending a flush.
+			auto& compressed {chunks[chunk]};
+			compressed.resize(deflateBound(&stream, input.size()) + 16);
+
+			stream.next_in   = const_cast<Bytef*>(input.data());
+			stream.avail_in  = input.size();
+			stream.next_out  = reinterpret_cast<Bytef*>(compressed.data());
+			stream.avail_out = compressed.size();
+
+			auto const result {deflate(&stream, last ? Z_FINISH : Z_SYNC_FLUSH)};
+			compressed.resize(stream.total_out);
+			deflateEnd(&stream);
+
+			if (result != (last ? Z_STREAM_END : Z_OK) or stream.avail_in != 0) {
+				throw std::runtime_error{"Could not deflate image data"};
+				}
+
+			adler32s[chunk] = adler32(adler32(0, nullptr, 0), input.data(), input.size());
+			}});
+
+	// Combine the checksums of all chunks.
+	auto checksum {adler32(0, nullptr, 0)};
+
+	for (std::size_t chunk {0}; chunk < num_chunks; ++chunk) {
+		auto const begin {std::min(chunk * rows_per_chunk * filtered_bytes, data.size())};
+		auto const end   {std::min(begin + rows_per_chunk * filtered_bytes, data.size())};
+		checksum = adler32_combine(checksum, adler32s[chunk], end - begin);
+		}
+
+	// Wrap the deflate stream in a zlib header, whose check bits make it a multiple of 31, and
+	// trailer.
+	auto const level_bits {
+			options.level < 2 ? 0
+			: options.level < 6 ? 1
+			: options.level == 6 ? 2
+			: 3
+			};
+	auto const cmf        {0x78};
+	auto const flg        {(level_bits << 6) + 31 - (cmf * 256 + (level_bits << 6)) % 31};
+
+	chunks.front().insert(chunks.front().begin(), {std::byte(cmf), std::byte(flg)});
+	auto const trailer {big_endian(checksum)};
+	chunks.back().insert(chunks.back().end(), trailer.begin(), trailer.end());
+
+	// Write the file, with one data chunk per compressed chunk.
+	constexpr std::array signature {
+		std::byte{0x89}, std::byte{'P'}, std::byte{'N'}, std::byte{'G'},
+		std::byte{'\r'}, std::byte{'\n'}, std::byte{0x1A}, std::byte{'\n'},
+		};
+
+	std::array<std::byte, 13> header {};
+	std::ranges::copy(big_endian(width), header.begin());
+	std::ranges::copy(big_endian(height), header.begin() + 4);
+	header[8] = std::byte{8};
+	header[9] = std::byte{6};
+
+	write_binary(std::span<std::byte const>{signature}, out);
+
+	auto size {signature.size() + write_chunk("IHDR", header, out)};
+
+	for (auto const& chunk : chunks) {
+		size += write_chunk("IDAT", chunk, out);
+		}
+
+	return size + write_chunk("IEND", {}, out);
+	}
+
+/// Write pixels without compression, following a header and dropping alpha unless `alpha` is set.
+auto write_uncompressed(
+		std::string_view const       header,
+		std::span<Color const> const pixels,
+		IceTSizeType const           width,
+		bool const                   alpha,
+		FILE* const                  out
+		) -> std::size_t {
+	write_binary(std::as_bytes(std::span{header}), out);
+
+	if (alpha) {
+		write_binary(pixels, out);
+		return header.size() + pixels.size_bytes();
+		}
+
+	// Convert row by row.
+	std::vector<std::array<color::Channel, 3>> row (width);
+
+	for (std::size_t begin {0}; begin < pixels.size(); begin += width) {
+		for (std::size_t x {0}; x < row.size(); ++x) {
+			std::copy_n(pixels[begin + x].begin(), 3, row[x].begin());
+			}
+
+		write_binary(std::span<std::array<color::Channel, 3> const>{row}, out);
+		}
+
+	return header.size() + pixels.size() * 3;
+	}
+
+/// Return the header of an uncompressed image, which precedes its pixels, so each pixel is stored
+/// at a fixed offset.
+auto header(Format const format, IceTSizeType const width, IceTSizeType const height)
+		-> std::string {
+	switch (format) {
+		case Format::png:
+			break;
+		case Format::ppm:
+			return concat("P6\n", width, " ", height, "\n255\n");
+		case Format::pam:
+			return concat(
+					"P7\nWIDTH ", width, "\nHEIGHT ", height,
+					"\nDEPTH 4\nMAXVAL 255\nTUPLTYPE RGB_ALPHA\nENDHDR\n"
+					);
+		case Format::raw: {
+			RawHeader header;
+			header.width  = width;
+			header.height = height;
+
+			return {reinterpret_cast<char const*>(&header), sizeof(header)};
+			}
+		case Format::rgba:
+			return {};
+			}
+
+	throw std::runtime_error{"PNG images cannot be written in parts, use ppm, pam, raw, or rgba"};
+	}
+
+/// Write the pixels of `region`, stored row by row, to their places in the uncompressed pixels of
+/// an image `width` pixels wide, which start at `offset` of file `fd` and have an alpha channel if
+/// `alpha` is set.
+/// Returns the number of bytes written.
+auto write_region(
+		std::span<Color const> const pixels,
+		Region const&                region,
+		IceTSizeType const           width,
+		bool const                   alpha,
+		off_t const                  offset,
+		int const                    fd
+		) -> std::size_t {
+	if (pixels.size() != std::size_t(region.width) * std::size_t(region.height)) {
+		throw std::runtime_error{"Region size does not match number of pixels"};
+		}
+
+	auto const pixel_bytes {alpha ? sizeof(Color) : 3};
+	auto const row_offset  = [&](IceTInt const y) {
+		return offset + off_t((std::size_t(y) * width + region.x) * pixel_bytes);
+		};
+
+	// Rows spanning the whole image are contiguous in the file.
+	if (alpha and region.x == 0 and region.width == width) {
+		posix::write_at(fd, std::as_bytes(pixels), row_offset(region.y));
+		return pixels.size_bytes();
+		}
+
+	// Otherwise write row by row, dropping alpha if needed.
+	std::vector<std::array<color::Channel, 3>> rgb_row (alpha ? 0 : region.width);
+
+	for (IceTSizeType row {0}; row < region.height; ++row) {
+		auto const in {pixels.subspan(std::size_t(row) * region.width, region.width)};
+
+		if (alpha) {
+			posix::write_at(fd, std::as_bytes(in), row_offset(region.y + row));
+			continue;
+			}
+
+		for (std::size_t x {0}; x < rgb_row.size(); ++x) {
+			std::copy_n(in[x].begin(), 3, rgb_row[x].begin());
+			}
+
+		posix::write_at(fd, std::as_bytes(std::span{rgb_row}), row_offset(region.y + row));
+		}
+
+	return pixels.size() * pixel_bytes;
+	}
+
+} // namespace
+
+
+auto parse_format(std::string_view const name) -> Format {
+	if (name == "png") {
+		return Format::png;
+		}
+	if (name == "ppm") {
+		return Format::ppm;
+		}
+	if (name == "pam") {
+		return Format::pam;
+		}
+	if (name == "raw") {
+		return Format::raw;
+		}
+	if (name == "rgba") {
+		return Format::rgba;
+		}
+
+	throw std::runtime_error{concat(
+			"Unknown image format `", name, "`. Must be either 'png', 'ppm', 'pam', 'raw', or "
+			"'rgba'."
+			)};
+	}
+
+auto format_of(std::string_view const path) noexcept -> std::optional<Format> {
+	auto const extension {path.substr(std::min(path.rfind('.'), path.size()))};
+
+	if (extension == ".png") {
+		return Format::png;
+		}
+	if (extension == ".ppm") {
+		return Format::ppm;
+		}
+	if (extension == ".pam") {
+		return Format::pam;
+		}
+	if (extension == ".raw") {
+		return Format::raw;
+		}
+
+	return std::nullopt;
+	}
+
+auto parse_filter(std::string_view const name) -> Filter {
+	constexpr std::array<std::string_view, 6> names {
+			"none", "sub", "up", "average", "paeth", "adaptive"
+			};
+
+	if (auto const match {std::ranges::find(names, name)}; match != names.end()) {
+		return static_cast<Filter>(match - names.begin());
+		}
+
+	throw std::runtime_error{concat(
+			"Unknown PNG filter `", name,
+			"`. Must be either 'none', 'sub', 'up', 'average', 'paeth', or 'adaptive'."
+			)};
+	}
+
+auto parse_option(Options& options, std::string_view const option, char const* const value)
+		-> bool {
+	if (option == "--format") {
+		options.format = parse_format(value);
+		}
+	else if (option == "--level") {
+		options.level = std::clamp(atoi(value), 0, 9);
+		}
+	else if (option == "--filter") {
+		options.filter = parse_filter(value);
+		}
+	else if (option == "--threads") {
+		options.num_threads = std::max(1, atoi(value));
+		}
+	else {
+		return false;
+		}
+
+	return true;
+	}
+
+auto write(
+		std::span<Color const> const pixels,
+		IceTSizeType const           width,
+		IceTSizeType const           height,
+		Options const&               options,
+		FILE* const                  out
+		) -> std::size_t {
+	if (pixels.size() != std::size_t(width) * std::size_t(height)) {
+		throw std::runtime_error{"Image size does not match number of pixels"};
+		}
+
+	if (options.format == Format::png) {
+		return write_png(pixels, width, height, options, out);
+		}
+
+	return write_uncompressed(
+			header(options.format, width, height),
+			pixels,
+			width,
+			options.format != Format::ppm,
+			out
+			);
+	}
+
+auto write(IceTImage const image, Options const& options, FILE* const out) -> std::size_t {
+	auto const width  {icetImageGetWidth(image)};
+	auto const height {icetImageGetHeight(image)};
+
+	return write(
+			std::span{
+				reinterpret_cast<Color const*>(icetImageGetColorcub(image)),
+				std::size_t(width) * std::size_t(height)
+				},
+			width,
+			height,
+			options,
+			out
+			);
+	}
+
+auto write_tile(
+		std::string const&           path,
+		Format const                 format,
+		Tile const&                  tile,
+		std::span<Color const> const pixels
+		) -> std::size_t {
+	auto const image_header {header(format, tile.image_width, tile.image_height)};
+	auto const alpha        {format != Format::ppm};
+
+	posix::FileDescriptor const file {open(path.c_str(), O_WRONLY | O_CREAT, 0666)};
+
+	if (not file) {
+		throw std::runtime_error{concat("Could not open ", path)};
+		}
+
+	// The process of the first tile writes the header and sizes the file, which only cuts off the
+	// data of a previous file, never pixels other processes have written already.
+	if (tile.index == 0) {
+		auto const size {
+				image_header.size()
+				+ std::size_t(tile.image_width) * std::size_t(tile.image_height)
+				* (alpha ? sizeof(Color) : 3)
+				};
+
+		posix::write_at(file.fd(), std::as_bytes(std::span{image_header}), 0);
+
+		if (ftruncate(file.fd(), off_t(size)) != 0) {
+			throw std::runtime_error{concat("Could not resize ", path)};
+			}}
+
+	return (tile.index == 0 ? image_header.size() : 0) + write_region(
+			pixels, tile.region, tile.image_width, alpha, off_t(image_header.size()), file.fd()
+			);
+	}
+
+} // namespace output
+
+} // namespace layered_icet
@@ -0,0 +1,138 @@
+#pragma once
+
+#include <cstdint>
+#include <optional>
+#include <span>
+#include <string>
+#include <string_view>
+
+#include "common.hpp"
+
+
+namespace layered_icet {
+
+/// Encoding of composited, non-layered images for output.
+namespace output {
+
+/// File format of an output image.
+enum class Format : uint8_t {
+	/// PNG, deflated in independent chunks of rows in parallel.
+	png,
+	/// Binary PPM, which drops the alpha channel.
+	ppm,
+	/// PAM with an RGB_ALPHA tuple type.
+	pam,
+	/// A `RawHeader` followed by the RGBA pixels.
+	raw,
+	/// The RGBA pixels without a header.
+	rgba,
+	};
+
+/// PNG filter applied to each row before compression, where the values of all but `adaptive`
+/// are the filter types stored in the image.
+enum class Filter : uint8_t {
+	none,
+	sub,
+	up,
+	average,
+	paeth,
+	/// Choose the filter of each row which minimizes the sum of absolute differences, like libpng.
+	adaptive,
+	};
+
+/// Options of encoding an image.
+struct Options {
+	Format   format      {Format::png};
+	/// zlib compression level from 0, which stores the data uncompressed, to 9.
+	int      level       {6};
+	Filter   filter      {Filter::adaptive};
+	/// Number of threads filtering and compressing rows.
+	unsigned num_threads {default_num_threads()};
+	};
+
+/// Header of a raw output image.
+struct RawHeader {
+	using Magic = FrameHeader::Magic;
+
+	static constexpr Magic         magic_value     {'L', 'I', 'C', 'E', 'T', 'I', 'M', 'G'};
+	static constexpr std::uint32_t current_version {1};
+
+	Magic         magic       {magic_value};
+	std::uint32_t version     {current_version};
+	/// Size of this header, so later versions can extend it.
+	std::uint32_t header_size {sizeof(RawHeader)};
+	std::int32_t  width       {0};
+	std::int32_t  height      {0};
+	};
+
+/// A rectangle of pixels within an image, such as a tile.
+struct Region {
+	IceTInt      x      {0};
+	IceTInt      y      {0};
+	IceTSizeType width  {0};
+	IceTSizeType height {0};
+	};
+
+/// A tile of an image, which one of several processes writes.
+struct Tile {
+	/// Index of the tile, in the order tiles were added.
+	int          index        {0};
+	/// Number of tiles of the image.
+	int          count        {1};
+	/// Pixels of the tile within the image.
+	Region       region       {};
+	/// Size of the image covered by all tiles.
+	IceTSizeType image_width  {0};
+	IceTSizeType image_height {0};
+	};
+
+/// Return the format with the given name, or throw if there is none.
+[[nodiscard]] auto parse_format(std::string_view name) -> Format;
+
+/// Return the format implied by the extension of a file name, if any.
+[[nodiscard]] auto format_of(std::string_view path) noexcept -> std::optional<Format>;
+
+/// Return the filter with the given name, or throw if there is none.
+[[nodiscard]] auto parse_filter(std::string_view name) -> Filter;
+
+/// Parse a command line option `--format`, `--level`, `--filter` or `--threads` with the given
+/// value into `options`.
+/// Returns false if `option` is not one of these options.
+[[nodiscard]] auto parse_option(Options& options, std::string_view option, char const* value)
+		-> bool;
+
+/// Usage of the options accepted by `parse_option`.
+constexpr std::string_view options_usage {
+		"[--format png|ppm|pam|raw|rgba] [--level <0-9>] "
+		"[--filter none|sub|up|average|paeth|adaptive] [--threads <#threads>]"
+		};
+
+/// Write an image of `width` by `height` RGBA pixels, stored row by row.
+/// Returns the number of bytes written.
+auto write(
+		std::span<Color const> pixels,
+		IceTSizeType           width,
+		IceTSizeType           height,
+		Options const&         options,
+		FILE*                  out
+		) -> std::size_t;
+
+/// Write the colors of a non-layered `IceTImage`.
+auto write(IceTImage image, Options const& options, FILE* out) -> std::size_t;
+
+/// Write the pixels of a tile, stored row by row, to their places in the file at `path`, which
+/// holds the whole image in an uncompressed `format` and is written by the processes of all other
+/// tiles concurrently.
+/// The process of the first tile also writes the header.
+/// Returns the number of bytes written.
+/// Throws for PNG, which cannot be written in parts.
+auto write_tile(
+		std::string const&     path,
+		Format                 format,
+		Tile const&            tile,
+		std::span<Color const> pixels
+		) -> std::size_t;
+
+} // namespace output
+
+} // namespace layered_icet
@@ -0,0 +1,317 @@
+#include "service.hpp"
+
+#include <cerrno>
+#include <cstring>
+
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <sys/un.h>
+
+
+namespace layered_icet {
+
+namespace service {
+
+namespace {
+
+/// Append a field holding `bytes` to a message.
+auto append(std::vector<std::byte>& message, std::span<std::byte const> const bytes) -> void {
+	std::uint64_t const length {bytes.size()};
+	auto const          header {std::as_bytes(std::span{&length, 1})};
+
+	message.insert(message.end(), header.begin(), header.end());
+	message.insert(message.end(), bytes.begin(), bytes.end());
+	}
+
+auto append(std::vector<std::byte>& message, std::string_view const text) -> void {
+	append(message, std::as_bytes(std::span{text}));
+	}
+
+auto append(std::vector<std::byte>& message, std::uint64_t const value) -> void {
+	append(message, std::as_bytes(std::span{&value, 1}));
+	}
+
+/// Reads the fields of a message in order.
+class Fields {
+public:
+	[[nodiscard]] explicit Fields(std::span<std::byte const> const message) noexcept
+		: _remaining {message}
+		{}
+
+	/// Return the next field, or throw if the message ends prematurely.
+	auto next() -> std::span<std::byte const> {
+		std::uint64_t length;
+
+		if (_remaining.size() < sizeof(length)) {
+			throw std::runtime_error{"Truncated message"};
+			}
+
+		std::memcpy(&length, _remaining.data(), sizeof(length));
+		_remaining = _remaining.subspan(sizeof(length));
+
+		if (_remaining.size() < length) {
+			throw std::runtime_error{"Truncated message"};
+			}
+
+		auto const field {_remaining.first(length)};
+		_remaining = _remaining.subspan(length);
+		return field;
+		}
+
+	auto next_string() -> std::string {
+		auto const field {next()};
+		return {reinterpret_cast<char const*>(field.data()), field.size()};
+		}
+
+	/// Return the number of bytes not read yet.
+	[[nodiscard]] auto remaining() const noexcept -> std::size_t {
+		return _remaining.size();
+		}
+
+	auto next_value() -> std::uint64_t {
+		auto const field {next()};
+		std::uint64_t value;
+
+		if (field.size() != sizeof(value)) {
+			throw std::runtime_error{"Malformed message"};
+			}
+
+		std::memcpy(&value, field.data(), sizeof(value));
+		return value;
+		}
+
+private:
+	std::span<std::byte const> _remaining;
+
+	};
+
+/// Return the address of the socket at `path`.
+auto socket_address(std::string_view const path) -> sockaddr_un {
+	sockaddr_un address {};
+	address.sun_family = AF_UNIX;
+
+	if (path.size() >= sizeof(address.sun_path)) {
+		throw std::runtime_error{concat("Socket path too long: ", path)};
+		}
+
+	path.copy(address.sun_path, path.size());
+	return address;
+	}
+
+/// Return a message describing the last error of a system call.
+auto system_error(std::string_view const action) -> std::runtime_error {
+	return std::runtime_error{concat(action, ": ", std::strerror(errno))};
+	}
+
+/// Send the concatenation of `parts` over a connection without copying them.
+auto send_parts(
+		posix::FileDescriptor const&                      connection,
+		std::span<std::span<std::byte const> const> const parts
+		) -> void {
+	std::vector<iovec> buffers;
+
+	for (auto const part : parts) {
+		if (not part.empty()) {
+			buffers.push_back({const_cast<std::byte*>(part.data()), part.size()});
+			}}
+
+	for (std::size_t first {0}; first < buffers.size();) {
+		msghdr header {};
+		header.msg_iov    = buffers.data() + first;
+		header.msg_iovlen = buffers.size() - first;
+
+		auto const sent {sendmsg(connection.fd(), &header, MSG_NOSIGNAL)};
+
+		if (sent < 0) {
+			if (errno == EINTR) {
+				continue;
+				}
+
+			throw system_error("Could not send message");
+			}
+
+		// Skip the buffers sent completely, then the sent part of the next one.
+		auto remaining {static_cast<std::size_t>(sent)};
+
+		for (; first < buffers.size() and remaining >= buffers[first].iov_len; ++first) {
+			remaining -= buffers[first].iov_len;
+			}
+
+		if (first < buffers.size()) {
+			buffers[first].iov_base = static_cast<std::byte*>(buffers[first].iov_base) + remaining;
+			buffers[first].iov_len -= remaining;
+			}}}
+
+/// Send a message consisting of `prefix` followed by a field holding `payload`, without copying
+/// the payload.
+auto send_with_payload(
+		posix::FileDescriptor const&     connection,
+		std::vector<std::byte> const&    prefix,
+		std::span<std::byte const> const payload
+		) -> void {
+	std::uint64_t const payload_length {payload.size()};
+	std::uint64_t const message_length {prefix.size() + sizeof(payload_length) + payload.size()};
+
+	std::span<std::byte const> const parts[] {
+			std::as_bytes(std::span{&message_length, 1}),
+			prefix,
+			std::as_bytes(std::span{&payload_length, 1}),
+			payload,
+			};
+
+	send_parts(connection, parts);
+	}
+
+} // namespace
+
+
+auto encode_args(std::vector<std::string> const& args) -> std::vector<std::byte> {
+	std::vector<std::byte> message;
+	append(message, std::uint64_t{args.size()});
+
+	for (auto const& arg : args) {
+		append(message, arg);
+		}
+
+	return message;
+	}
+
+auto decode_args(std::span<std::byte const> const message) -> std::vector<std::string> {
+	Fields     fields   {message};
+	auto const num_args {fields.next_value()};
+
+	// Each argument takes at least the length of its field, so larger counts are malformed and
+	// must not be allocated.
+	if (num_args > fields.remaining() / sizeof(std::uint64_t)) {
+		throw std::runtime_error{"Malformed message"};
+		}
+
+	std::vector<std::string> args (num_args);
+
+	for (auto& arg : args) {
+		arg = fields.next_string();
+		}
+
+	return args;
+	}
+
+auto decode_request(std::span<std::byte const> const message) -> Request {
+	Fields fields {message};
+	Request request;
+
+	request.args = decode_args(fields.next());
+
+	auto const input {fields.next()};
+	request.input.assign(input.begin(), input.end());
+
+	return request;
+	}
+
+auto decode_response(std::span<std::byte const> const message) -> Response {
+	Fields fields {message};
+	Response response;
+
+	response.success = fields.next_value() != 0;
+	response.job_ns  = fields.next_value();
+	response.error   = fields.next_string();
+
+	auto const output {fields.next()};
+	response.output.assign(output.begin(), output.end());
+
+	return response;
+	}
+
+
+auto listen(std::string_view const path) -> posix::FileDescriptor {
+	auto const address {socket_address(path)};
+	posix::FileDescriptor socket {::socket(AF_UNIX, SOCK_STREAM, 0)};
+
+	if (not socket) {
+		throw system_error("Could not create socket");
+		}
+
+	// Replace the socket file left behind by a previous daemon.
+	unlink(address.sun_path);
+
+	if (bind(socket.fd(), reinterpret_cast<sockaddr const*>(&address), sizeof(address))
+			or ::listen(socket.fd(), SOMAXCONN)) {
+		throw system_error(concat("Could not listen on ", path));
+		}
+
+	return socket;
+	}
+
+auto accept(posix::FileDescriptor const& socket) -> posix::FileDescriptor {
+	posix::FileDescriptor connection {::accept(socket.fd(), nullptr, nullptr)};
+
+	if (not connection) {
+		throw system_error("Could not accept connection");
+		}
+
+	return connection;
+	}
+
+auto connect(std::string_view const path) -> posix::FileDescriptor {
+	auto const address {socket_address(path)};
+	posix::FileDescriptor socket {::socket(AF_UNIX, SOCK_STREAM, 0)};
+
+	if (not socket) {
+		throw system_error("Could not create socket");
+		}
+
+	if (::connect(socket.fd(), reinterpret_cast<sockaddr const*>(&address), sizeof(address))) {
+		throw system_error(concat("Could not connect to ", path));
+		}
+
+	return socket;
+	}
+
+auto send(posix::FileDescriptor const& connection, std::span<std::byte const> const message)
+		-> void {
+	std::uint64_t const length {message.size()};
+
+	std::span<std::byte const> const parts[] {std::as_bytes(std::span{&length, 1}), message};
+	send_parts(connection, parts);
+	}
+
+auto send(posix::FileDescriptor const& connection, Request const& request) -> void {
+	std::vector<std::byte> prefix;
+	append(prefix, encode_args(request.args));
+	send_with_payload(connection, prefix, request.input);
+	}
+
+auto send(posix::FileDescriptor const& connection, Response const& response) -> void {
+	std::vector<std::byte> prefix;
+	append(prefix, std::uint64_t{response.success});
+	append(prefix, response.job_ns);
+	append(prefix, response.error);
+	send_with_payload(connection, prefix, response.output);
+	}
+
+auto receive(posix::FileDescriptor const& connection) -> std::vector<std::byte> {
+	// Read exactly `buffer.size()` bytes.
+	auto read_exactly = [&](std::span<std::byte> buffer) {
+		while (not buffer.empty()) {
+			auto const received {::recv(connection.fd(), buffer.data(), buffer.size(), 0)};
+
+			if (received == 0) {
+				throw std::runtime_error{"Connection closed"};
+				}
+			if (received < 0 and errno != EINTR) {
+				throw system_error("Could not receive message");
+				}
+
+			buffer = buffer.subspan(std::max<ssize_t>(received, 0));
+			}};
+
+	std::uint64_t length;
+	read_exactly(std::as_writable_bytes(std::span{&length, 1}));
+
+	std::vector<std::byte> message (length);
+	read_exactly(message);
+	return message;
+	}
+
+} // namespace service
+
+} // namespace layered_icet
@@ -0,0 +1,70 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "common.hpp"
+
+
+namespace layered_icet {
+
+/// Protocol between `icet-daemon`, which keeps MPI and IceT initialized across jobs, and
+/// `icet-client`, which submits jobs to it over a Unix domain socket.
+/// Every message is a sequence of fields, each of which is a 64 bit length followed by as many
+/// bytes, and is itself sent as a single field.
+namespace service {
+
+/// A job submitted to the daemon.
+struct Request {
+	/// Name of the job followed by its arguments, as for the corresponding one-shot tool.
+	std::vector<std::string> args  {};
+	/// Data the one-shot tool would read from `stdin`, which is only available to rank 0.
+	std::vector<std::byte>   input {};
+	};
+
+/// The result of a job.
+struct Response {
+	bool                   success {false};
+	/// Time the daemon spent on the job in nanoseconds, from receiving it to sending the result.
+	std::uint64_t          job_ns  {0};
+	/// Description of the error if the job failed.
+	std::string            error   {};
+	/// Data the one-shot tool would write to `stdout`.
+	std::vector<std::byte> output  {};
+	};
+
+/// Encode a job's arguments, which are broadcast to all ranks, without its input.
+[[nodiscard]] auto encode_args(std::vector<std::string> const& args) -> std::vector<std::byte>;
+/// Decode a job's arguments encoded by `encode_args`.
+[[nodiscard]] auto decode_args(std::span<std::byte const> message) -> std::vector<std::string>;
+
+[[nodiscard]] auto decode_request(std::span<std::byte const> message) -> Request;
+[[nodiscard]] auto decode_response(std::span<std::byte const> message) -> Response;
+
+/// Create a socket at `path` accepting connections, replacing any existing socket file.
+[[nodiscard]] auto listen(std::string_view path) -> posix::FileDescriptor;
+
+/// Wait for and accept the next connection to a listening socket.
+[[nodiscard]] auto accept(posix::FileDescriptor const& socket) -> posix::FileDescriptor;
+
+/// Connect to the socket at `path`.
+[[nodiscard]] auto connect(std::string_view path) -> posix::FileDescriptor;
+
+/// Send a message over a connection.
+auto send(posix::FileDescriptor const& connection, std::span<std::byte const> message) -> void;
+
+/// Send a job as a message decoded by `decode_request`, without copying its input.
+auto send(posix::FileDescriptor const& connection, Request const& request) -> void;
+
+/// Send the result of a job as a message decoded by `decode_response`, without copying its
+/// output.
+auto send(posix::FileDescriptor const& connection, Response const& response) -> void;
+
+/// Receive a message sent by `send`.
+[[nodiscard]] auto receive(posix::FileDescriptor const& connection) -> std::vector<std::byte>;
+
+} // namespace service
+
+} // namespace layered_icet
@@ -0,0 +1,809 @@
+#include "simd.hpp"
+
+#include <bit>
+#include <climits>
+
+#if defined(__x86_64__) or defined(__i386__)
+	#define LAYERED_ICET_X86
+	#include <immintrin.h>
+	#endif
+
+
+namespace layered_icet {
+
+namespace simd {
+
+namespace {
+
+/// Return the most capable supported instruction set, detecting it only once.
+[[nodiscard]] auto supported() noexcept -> Isa {
+	static Isa const isa {detect()};
+	return isa;
+	}
+
+
+/// Blend pixels `[begin, end)` without vector instructions.
+/// The color of layer `l` of pixel `p` is `in[p * pixel_stride + l * layer_stride]`.
+auto blend_over_scalar(
+		Color const*      in,
+		std::size_t const num_layers,
+		std::size_t const layer_stride,
+		std::size_t const pixel_stride,
+		Color*            out,
+		std::size_t const begin,
+		std::size_t const end
+		) noexcept -> void {
+	in  += begin * pixel_stride;
+	out += begin;
+
+	for (auto pixel {begin}; pixel < end; ++pixel, in += pixel_stride, ++out) {
+		Color result {0, 0, 0, 0};
+
+		// Iterate fragments back to front.
+		for (auto layer {num_layers}; layer-- > 0;) {
+			auto const in_color     {in[layer * layer_stride]};
+			auto const transparency {color::channel_max - in_color[color::alpha_channel]};
+
+			// Blend color using the over-operator.
+			for (std::size_t i {0}; i < in_color.size(); ++i) {
+				result[i] = result[i] * transparency / color::channel_max + in_color[i];
+				}}
+
+		*out = result;
+		}}
+
+/// Premultiply colors `[begin, end)` without vector instructions.
+auto premultiply_scalar(Color* colors, std::size_t const begin, std::size_t const end) noexcept
+		-> void {
+	for (auto idx {begin}; idx < end; ++idx) {
+		auto&      color {colors[idx]};
+		auto const alpha {color[color::alpha_channel]};
+
+		for (std::size_t i {0}; i < color::alpha_channel; ++i) {
+			color[i] = color[i] * alpha / color::channel_max;
+			}}}
+
+
+/// Return the index of the first of `count` colors, `stride` colors apart, whose alpha channel is
+/// non-zero if `active` and zero otherwise, starting the search at `begin`.
+/// Returns `count` if there is none.
+auto find_scalar(
+		Color const*      colors,
+		std::size_t const stride,
+		std::size_t const begin,
+		std::size_t const count,
+		bool const        active
+		) noexcept -> std::size_t {
+	for (auto idx {begin}; idx < count; ++idx) {
+		if ((colors[idx * stride][color::alpha_channel] != 0) == active) {
+			return idx;
+			}}
+
+	return count;
+	}
+
+
+#ifdef LAYERED_ICET_X86
+
+// Vector kernels hold one color per 32 bit lane.
+// Products of two channels are formed in 16 bit lanes, where `x / 255 == (x * 0x8081) >> 23` holds
+// for every `x`, and sums wrap around in 8 bit lanes, so results match the scalar kernels exactly.
+static_assert(color::channel_max == 255);
+
+constexpr short div_255_multiplier {static_cast<short>(0x8081)};
+constexpr int   div_255_shift      {7};
+
+/// Shuffle control which broadcasts the alpha channel of each color in a 128 bit lane.
+#define LAYERED_ICET_ALPHA_SHUFFLE 3, 3, 3, 3, 7, 7, 7, 7, 11, 11, 11, 11, 15, 15, 15, 15
+
+/// Mask of the alpha channel of each color.
+constexpr int alpha_mask {static_cast<int>(0xFF000000)};
+
+/// Load a color as a 32 bit integer.
+[[nodiscard]] inline auto load(Color const& color) noexcept -> int {
+	return std::bit_cast<int>(color);
+	}
+
+
+/// Return `lhs * rhs / 255` for each channel.
+__attribute__((target("sse4.1")))
+inline auto scale_sse4_1(__m128i const lhs, __m128i const rhs) noexcept -> __m128i {
+	auto const zero       {_mm_setzero_si128()};
+	auto const multiplier {_mm_set1_epi16(div_255_multiplier)};
+
+	auto const lo {_mm_mullo_epi16(_mm_unpacklo_epi8(lhs, zero), _mm_unpacklo_epi8(rhs, zero))};
+	auto const hi {_mm_mullo_epi16(_mm_unpackhi_epi8(lhs, zero), _mm_unpackhi_epi8(rhs, zero))};
+
+	return _mm_packus_epi16(
+			_mm_srli_epi16(_mm_mulhi_epu16(lo, multiplier), div_255_shift),
+			_mm_srli_epi16(_mm_mulhi_epu16(hi, multiplier), div_255_shift)
+			);
+	}
+
+/// Return the alpha channel of each color in all of its channels.
+__attribute__((target("sse4.1")))
+inline auto alpha_sse4_1(__m128i const colors) noexcept -> __m128i {
+	return _mm_shuffle_epi8(colors, _mm_setr_epi8(LAYERED_ICET_ALPHA_SHUFFLE));
+	}
+
+/// Blend as many pixels as fit into whole vectors, returning their number.
+__attribute__((target("sse4.1")))
+auto blend_over_sse4_1(
+		Color const*      in,
+		std::size_t const num_layers,
+		std::size_t const layer_stride,
+		std::size_t const pixel_stride,
+		Color*            out,
+		std::size_t const num_pixels
+		) noexcept -> std::size_t {
+	constexpr std::size_t num_lanes {4};
+
+	auto const max {_mm_set1_epi8(static_cast<char>(color::channel_max))};
+
+	std::size_t pixel {0};
+
+	for (; pixel + num_lanes <= num_pixels; pixel += num_lanes) {
+		auto const* const frags  {in + pixel * pixel_stride};
+		auto              result {_mm_setzero_si128()};
+
+		// Iterate fragments back to front.
+		for (auto layer {num_layers}; layer-- > 0;) {
+			auto const* const first    {frags + layer * layer_stride};
+			auto const        in_color {_mm_setr_epi32(
+					load(first[0]),
+					load(first[pixel_stride]),
+					load(first[2 * pixel_stride]),
+					load(first[3 * pixel_stride])
+					)};
+
+			result = _mm_add_epi8(in_color, scale_sse4_1(
+					result,
+					_mm_sub_epi8(max, alpha_sse4_1(in_color))
+					));
+			}
+
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(out + pixel), result);
+		}
+
+	return pixel;
+	}
+
+/// Premultiply as many colors as fit into whole vectors, returning their number.
+__attribute__((target("sse4.1")))
+auto premultiply_sse4_1(Color* colors, std::size_t const num_colors) noexcept -> std::size_t {
+	constexpr std::size_t num_lanes {4};
+
+	// Alpha is scaled by the maximum, so it remains unchanged.
+	auto const mask {_mm_set1_epi32(alpha_mask)};
+
+	std::size_t idx {0};
+
+	for (; idx + num_lanes <= num_colors; idx += num_lanes) {
+		auto* const ptr    {reinterpret_cast<__m128i*>(colors + idx)};
+		auto const  color  {_mm_loadu_si128(ptr)};
+
+		_mm_storeu_si128(ptr, scale_sse4_1(color, _mm_or_si128(alpha_sse4_1(color), mask)));
+		}
+
+	return idx;
+	}
+
+
+/// Return `lhs * rhs / 255` for each channel.
+/// Unpacking and packing both operate within 128 bit lanes, so channels keep their order.
+__attribute__((target("avx2")))
+inline auto scale_avx2(__m256i const lhs, __m256i const rhs) noexcept -> __m256i {
+	auto const zero       {_mm256_setzero_si256()};
+	auto const multiplier {_mm256_set1_epi16(div_255_multiplier)};
+
+	auto const lo {_mm256_mullo_epi16(
+			_mm256_unpacklo_epi8(lhs, zero),
+			_mm256_unpacklo_epi8(rhs, zero)
+			)};
+	auto const hi {_mm256_mullo_epi16(
+			_mm256_unpackhi_epi8(lhs, zero),
+			_mm256_unpackhi_epi8(rhs, zero)
+			)};
+
+	return _mm256_packus_epi16(
+			_mm256_srli_epi16(_mm256_mulhi_epu16(lo, multiplier), div_255_shift),
+			_mm256_srli_epi16(_mm256_mulhi_epu16(hi, multiplier), div_255_shift)
+			);
+	}
+
+/// Return the alpha channel of each color in all of its channels.
+__attribute__((target("avx2")))
+inline auto alpha_avx2(__m256i const colors) noexcept -> __m256i {
+	return _mm256_shuffle_epi8(colors, _mm256_setr_epi8(
+			LAYERED_ICET_ALPHA_SHUFFLE,
+			LAYERED_ICET_ALPHA_SHUFFLE
+			));
+	}
+
+/// Blend as many pixels as fit into whole vectors, returning their number.
+__attribute__((target("avx2")))
+auto blend_over_avx2(
+		Color const*      in,
+		std::size_t const num_layers,
+		std::size_t const layer_stride,
+		std::size_t const pixel_stride,
+		Color*            out,
+		std::size_t const num_pixels
+		) noexcept -> std::size_t {
+	constexpr std::size_t num_lanes {8};
+
+	auto const max {_mm256_set1_epi8(static_cast<char>(color::channel_max))};
+
+	// Offsets of each lane's fragments, in colors.
+	auto const offsets {_mm256_mullo_epi32(
+			_mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7),
+			_mm256_set1_epi32(static_cast<int>(pixel_stride))
+			)};
+
+	std::size_t pixel {0};
+
+	for (; pixel + num_lanes <= num_pixels; pixel += num_lanes) {
+		auto const* const frags  {reinterpret_cast<int const*>(in + pixel * pixel_stride)};
+		auto              result {_mm256_setzero_si256()};
+
+		// Iterate fragments back to front.
+		// Pixels one color apart are contiguous, otherwise fragments are gathered.
+		for (auto layer {num_layers}; layer-- > 0;) {
+			auto const in_color {pixel_stride == 1
+					? _mm256_loadu_si256(reinterpret_cast<__m256i const*>(frags))
+					: _mm256_i32gather_epi32(frags + layer * layer_stride, offsets, sizeof(Color))
+					};
+
+			result = _mm256_add_epi8(in_color, scale_avx2(
+					result,
+					_mm256_sub_epi8(max, alpha_avx2(in_color))
+					));
+			}
+
+		_mm256_storeu_si256(reinterpret_cast<__m256i*>(out + pixel), result);
+		}
+
+	return pixel;
+	}
+
+/// Premultiply as many colors as fit into whole vectors, returning their number.
+__attribute__((target("avx2")))
+auto premultiply_avx2(Color* colors, std::size_t const num_colors) noexcept -> std::size_t {
+	constexpr std::size_t num_lanes {8};
+
+	// Alpha is scaled by the maximum, so it remains unchanged.
+	auto const mask {_mm256_set1_epi32(alpha_mask)};
+
+	std::size_t idx {0};
+
+	for (; idx + num_lanes <= num_colors; idx += num_lanes) {
+		auto* const ptr   {reinterpret_cast<__m256i*>(colors + idx)};
+		auto const  color {_mm256_loadu_si256(ptr)};
+
+		_mm256_storeu_si256(ptr, scale_avx2(color, _mm256_or_si256(alpha_avx2(color), mask)));
+		}
+
+	return idx;
+	}
+
+
+/// Return `lhs * rhs / 255` for each channel.
+/// Unpacking and packing both operate within 128 bit lanes, so channels keep their order.
+__attribute__((target("avx512f,avx512bw")))
+inline auto scale_avx512(__m512i const lhs, __m512i const rhs) noexcept -> __m512i {
+	auto const zero       {_mm512_setzero_si512()};
+	auto const multiplier {_mm512_set1_epi16(div_255_multiplier)};
+
+	auto const lo {_mm512_mullo_epi16(
+			_mm512_unpacklo_epi8(lhs, zero),
+			_mm512_unpacklo_epi8(rhs, zero)
+			)};
+	auto const hi {_mm512_mullo_epi16(
+			_mm512_unpackhi_epi8(lhs, zero),
+			_mm512_unpackhi_epi8(rhs, zero)
+			)};
+
+	return _mm512_packus_epi16(
+			_mm512_srli_epi16(_mm512_mulhi_epu16(lo, multiplier), div_255_shift),
+			_mm512_srli_epi16(_mm512_mulhi_epu16(hi, multiplier), div_255_shift)
+			);
+	}
+
+/// Return the alpha channel of each color in all of its channels.
+__attribute__((target("avx512f,avx512bw")))
+inline auto alpha_avx512(__m512i const colors) noexcept -> __m512i {
+	return _mm512_shuffle_epi8(colors, _mm512_broadcast_i32x4(
+			_mm_setr_epi8(LAYERED_ICET_ALPHA_SHUFFLE)
+			));
+	}
+
+/// Blend as many pixels as fit into whole vectors, returning their number.
+__attribute__((target("avx512f,avx512bw")))
+auto blend_over_avx512(
+		Color const*      in,
+		std::size_t const num_layers,
+		std::size_t const layer_stride,
+		std::size_t const pixel_stride,
+		Color*            out,
+		std::size_t const num_pixels
+		) noexcept -> std::size_t {
+	constexpr std::size_t num_lanes {16};
+
+	auto const max {_mm512_set1_epi8(static_cast<char>(color::channel_max))};
+
+	// Offsets of each lane's fragments, in colors.
+	auto const offsets {_mm512_mullo_epi32(
+			_mm512_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15),
+			_mm512_set1_epi32(static_cast<int>(pixel_stride))
+			)};
+
+	std::size_t pixel {0};
+
+	for (; pixel + num_lanes <= num_pixels; pixel += num_lanes) {
+		auto const* const frags  {reinterpret_cast<int const*>(in + pixel * pixel_stride)};
+		auto              result {_mm512_setzero_si512()};
+
+		// Iterate fragments back to front.
+		// Pixels one color apart are contiguous, otherwise fragments are gathered.
+		for (auto layer {num_layers}; layer-- > 0;) {
+			auto const in_color {pixel_stride == 1
+					? _mm512_loadu_si512(frags)
+					: _mm512_i32gather_epi32(offsets, frags + layer * layer_stride, sizeof(Color))
+					};
+
+			result = _mm512_add_epi8(in_color, scale_avx512(
+					result,
+					_mm512_sub_epi8(max, alpha_avx512(in_color))
+					));
+			}
+
+		_mm512_storeu_si512(out + pixel, result);
+		}
+
+	return pixel;
+	}
+
+/// Premultiply as many colors as fit into whole vectors, returning their number.
+__attribute__((target("avx512f,avx512bw")))
+auto premultiply_avx512(Color* colors, std::size_t const num_colors) noexcept -> std::size_t {
+	constexpr std::size_t num_lanes {16};
+
+	// Alpha is scaled by the maximum, so it remains unchanged.
+	auto const mask {_mm512_set1_epi32(alpha_mask)};
+
+	std::size_t idx {0};
+
+	for (; idx + num_lanes <= num_colors; idx += num_lanes) {
+		auto* const ptr   {colors + idx};
+		auto const  color {_mm512_loadu_si512(ptr)};
+
+		_mm512_storeu_si512(ptr, scale_avx512(color, _mm512_or_si512(alpha_avx512(color), mask)));
+		}
+
+	return idx;
+	}
+
+/// Find a color like `find_scalar`, examining as many colors as fit into whole vectors.
+/// Returns the index of the color found, or the number of colors examined.
+__attribute__((target("sse4.1")))
+auto find_sse4_1(
+		Color const*      colors,
+		std::size_t const stride,
+		std::size_t const count,
+		bool const        active
+		) noexcept -> std::size_t {
+	constexpr std::size_t num_lanes {4};
+
+	auto const mask {_mm_set1_epi32(alpha_mask)};
+	auto const flip {active ? 0b1111 : 0};
+
+	std::size_t idx {0};
+
+	for (; idx + num_lanes <= count; idx += num_lanes) {
+		auto const* const first  {colors + idx * stride};
+		auto const        values {stride == 1
+				? _mm_loadu_si128(reinterpret_cast<__m128i const*>(first))
+				: _mm_setr_epi32(
+					load(first[0]),
+					load(first[stride]),
+					load(first[2 * stride]),
+					load(first[3 * stride])
+					)
+				};
+
+		// Flag lanes with a zero alpha channel, or the opposite when looking for active ones.
+		auto const found {flip ^ _mm_movemask_ps(_mm_castsi128_ps(_mm_cmpeq_epi32(
+				_mm_and_si128(values, mask),
+				_mm_setzero_si128()
+				)))};
+
+		if (found) {
+			return idx + std::countr_zero(static_cast<unsigned>(found));
+			}}
+
+	return idx;
+	}
+
+/// Find a color like `find_scalar`, examining as many colors as fit into whole vectors.
+/// Returns the index of the color found, or the number of colors examined.
+__attribute__((target("avx2")))
+auto find_avx2(
+		Color const*      colors,
+		std::size_t const stride,
+		std::size_t const count,
+		bool const        active
+		) noexcept -> std::size_t {
+	constexpr std::size_t num_lanes {8};
+
+	auto const mask    {_mm256_set1_epi32(alpha_mask)};
+	auto const flip    {active ? 0xFF : 0};
+	auto const offsets {_mm256_mullo_epi32(
+			_mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7),
+			_mm256_set1_epi32(static_cast<int>(stride))
+			)};
+
+	std::size_t idx {0};
+
+	for (; idx + num_lanes <= count; idx += num_lanes) {
+		auto const* const first  {reinterpret_cast<int const*>(colors + idx * stride)};
+		auto const        values {stride == 1
+				? _mm256_loadu_si256(reinterpret_cast<__m256i const*>(first))
+				: _mm256_i32gather_epi32(first, offsets, sizeof(Color))
+				};
+
+		// Flag lanes with a zero alpha channel, or the opposite when looking for active ones.
+		auto const found {flip ^ _mm256_movemask_ps(_mm256_castsi256_ps(_mm256_cmpeq_epi32(
+				_mm256_and_si256(values, mask),
+				_mm256_setzero_si256()
+				)))};
+
+		if (found) {
+			return idx + std::countr_zero(static_cast<unsigned>(found));
+			}}
+
+	return idx;
+	}
+
+/// Find a color like `find_scalar`, examining as many colors as fit into whole vectors.
+/// Returns the index of the color found, or the number of colors examined.
+__attribute__((target("avx512f,avx512bw")))
+auto find_avx512(
+		Color const*      colors,
+		std::size_t const stride,
+		std::size_t const count,
+		bool const        active
+		) noexcept -> std::size_t {
+	constexpr std::size_t num_lanes {16};
+
+	auto const mask    {_mm512_set1_epi32(alpha_mask)};
+	auto const flip    {active ? 0 : 0xFFFF};
+	auto const offsets {_mm512_mullo_epi32(
+			_mm512_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15),
+			_mm512_set1_epi32(static_cast<int>(stride))
+			)};
+
+	std::size_t idx {0};
+
+	for (; idx + num_lanes <= count; idx += num_lanes) {
+		auto const* const first  {colors + idx * stride};
+		auto const        values {stride == 1
+				? _mm512_loadu_si512(first)
+				: _mm512_i32gather_epi32(offsets, first, sizeof(Color))
+				};
+
+		// Flag lanes with a non-zero alpha channel, or the opposite when looking for inactive ones.
+		auto const found {flip ^ _mm512_test_epi32_mask(values, mask)};
+
+		if (found) {
+			return idx + std::countr_zero(static_cast<unsigned>(found));
+			}}
+
+	return idx;
+	}
+
+#undef LAYERED_ICET_ALPHA_SHUFFLE
+
+#endif // LAYERED_ICET_X86
+
+
+/// Find a color like `find_scalar`, using the given instruction set.
+auto find(
+		[[maybe_unused]] Isa       isa,
+		Color const* const         colors,
+		std::size_t const          stride,
+		std::size_t const          count,
+		bool const                 active
+		) noexcept -> std::size_t {
+	std::size_t done {0};
+
+	#ifdef LAYERED_ICET_X86
+		// Offsets of gathered colors must fit into 32 bit lanes.
+		if (stride > INT_MAX / 16) {
+			isa = std::min(isa, Isa::sse4_1);
+			}
+
+		switch (isa) {
+			case Isa::scalar:
+				break;
+			case Isa::sse4_1:
+				done = find_sse4_1(colors, stride, count, active);
+				break;
+			case Isa::avx2:
+				done = find_avx2(colors, stride, count, active);
+				break;
+			case Isa::avx512:
+				done = find_avx512(colors, stride, count, active);
+				break;
+				}
+		#endif
+
+	// Examine remaining colors which do not fill a vector.
+	return find_scalar(colors, stride, done, count, active);
+	}
+
+/// Blend pixels like the strided `blend_over`, without skipping inactive ones.
+auto blend_dense(
+		[[maybe_unused]] Isa       isa,
+		Color const* const         in,
+		std::size_t const          num_layers,
+		std::size_t const          layer_stride,
+		std::size_t const          pixel_stride,
+		Color* const               out,
+		std::size_t const          num_pixels
+		) noexcept -> void {
+	std::size_t done {0};
+
+	#ifdef LAYERED_ICET_X86
+		// Offsets of gathered colors must fit into 32 bit lanes.
+		if (pixel_stride > INT_MAX / 16) {
+			isa = std::min(isa, Isa::sse4_1);
+			}
+
+		switch (isa) {
+			case Isa::scalar:
+				break;
+			case Isa::sse4_1:
+				done = blend_over_sse4_1(
+						in, num_layers, layer_stride, pixel_stride, out, num_pixels
+						);
+				break;
+			case Isa::avx2:
+				done = blend_over_avx2(
+						in, num_layers, layer_stride, pixel_stride, out, num_pixels
+						);
+				break;
+			case Isa::avx512:
+				done = blend_over_avx512(
+						in, num_layers, layer_stride, pixel_stride, out, num_pixels
+						);
+				break;
+				}
+		#endif
+
+	// Blend remaining pixels which do not fill a vector.
+	blend_over_scalar(in, num_layers, layer_stride, pixel_stride, out, done, num_pixels);
+	}
+
+} // namespace
+
+
+auto detect() noexcept -> Isa {
+	#ifdef LAYERED_ICET_X86
+		// Vector registers are only usable if the operating system preserves them, which is checked
+		// as well.
+		if (__builtin_cpu_supports("avx512f") and __builtin_cpu_supports("avx512bw")) {
+			return Isa::avx512;
+			}
+
+		if (__builtin_cpu_supports("avx2")) {
+			return Isa::avx2;
+			}
+
+		if (__builtin_cpu_supports("sse4.1")) {
+			return Isa::sse4_1;
+			}
+		#endif
+
+	return Isa::scalar;
+	}
+
+auto name(Isa const isa) noexcept -> std::string_view {
+	switch (isa) {
+		case Isa::scalar: return "scalar";
+		case Isa::sse4_1: return "sse4.1";
+		case Isa::avx2:   return "avx2";
+		case Isa::avx512: return "avx512";
+		}
+
+	return "unknown";
+	}
+
+
+auto blend_over(
+		std::span<Color const> const in,
+		IceTSizeType const           num_layers,
+		std::span<Color> const       out
+		) noexcept -> void {
+	blend_over(supported(), in, num_layers, out);
+	}
+
+auto blend_over(
+		Isa const                    isa,
+		std::span<Color const> const in,
+		IceTSizeType const           num_layers,
+		std::span<Color> const       out
+		) noexcept -> void {
+	auto const layers {static_cast<std::size_t>(num_layers)};
+
+	assert(in.size() == out.size() * layers);
+	blend_over(isa, in.data(), num_layers, 1, layers, out);
+	}
+
+auto blend_over(
+		Color const* const     in,
+		IceTSizeType const     num_layers,
+		std::size_t const      layer_stride,
+		std::size_t const      pixel_stride,
+		std::span<Color> const out
+		) noexcept -> void {
+	blend_over(supported(), in, num_layers, layer_stride, pixel_stride, out);
+	}
+
+auto blend_over(
+		Isa const              isa,
+		Color const* const     in,
+		IceTSizeType const     num_layers,
+		std::size_t const      layer_stride,
+		std::size_t const      pixel_stride,
+		std::span<Color> const out
+		) noexcept -> void {
+	auto const layers {static_cast<std::size_t>(num_layers)};
+
+	if (layers == 0) {
+		std::fill(out.begin(), out.end(), Color{0, 0, 0, 0});
+		return;
+		}
+
+	// Pixels whose first fragment is inactive are transparent, since active fragments come first
+	// and inactive ones are zero.
+	// Long runs of them are skipped, while short ones are cheaper to blend along with their
+	// neighbors.
+	constexpr std::size_t min_skipped_run {16};
+
+	auto const count {out.size()};
+
+	for (std::size_t pixel {0}; pixel < count;) {
+		std::size_t blend_end {pixel};
+		std::size_t skip_end  {pixel};
+
+		do {
+			blend_end = skip_end + find(
+					isa, in + skip_end * pixel_stride, pixel_stride, count - skip_end, false
+					);
+			skip_end  = blend_end + find(
+					isa, in + blend_end * pixel_stride, pixel_stride, count - blend_end, true
+					);
+			}
+		while (skip_end - blend_end < min_skipped_run and skip_end < count);
+
+		blend_dense(
+				isa,
+				in + pixel * pixel_stride,
+				layers,
+				layer_stride,
+				pixel_stride,
+				out.data() + pixel,
+				blend_end - pixel
+				);
+		std::fill(out.begin() + blend_end, out.begin() + skip_end, Color{0, 0, 0, 0});
+		pixel = skip_end;
+		}}
+
+auto blend_over(
+		std::span<std::size_t const> const offsets,
+		std::span<Color const> const       in,
+		std::span<Color> const             out
+		) noexcept -> void {
+	blend_over(supported(), offsets, in, out);
+	}
+
+auto blend_over(
+		Isa const                          isa,
+		std::span<std::size_t const> const offsets,
+		std::span<Color const> const       in,
+		std::span<Color> const             out
+		) noexcept -> void {
+	assert(offsets.size() == out.size() + 1 and offsets.back() <= in.size());
+
+	for (std::size_t pixel {0}; pixel < out.size();) {
+		auto const num_layers {offsets[pixel + 1] - offsets[pixel]};
+		auto       end        {pixel + 1};
+
+		// Consecutive pixels with the same number of fragments are laid out like a dense image.
+		while (end < out.size() and offsets[end + 1] - offsets[end] == num_layers) {
+			++end;
+			}
+
+		if (num_layers == 0) {
+			std::fill(out.begin() + pixel, out.begin() + end, Color{0, 0, 0, 0});
+			}
+		else {
+			blend_dense(
+					isa,
+					in.data() + offsets[pixel],
+					num_layers,
+					1,
+					num_layers,
+					out.data() + pixel,
+					end - pixel
+					);
+			}
+
+		pixel = end;
+		}}
+
+auto premultiply(std::span<Color> const colors) noexcept -> void {
+	premultiply(supported(), colors);
+	}
+
+auto premultiply([[maybe_unused]] Isa const isa, std::span<Color> const colors) noexcept -> void {
+	std::size_t done {0};
+
+	#ifdef LAYERED_ICET_X86
+		switch (isa) {
+			case Isa::scalar:
+				break;
+			case Isa::sse4_1:
+				done = premultiply_sse4_1(colors.data(), colors.size());
+				break;
+			case Isa::avx2:
+				done = premultiply_avx2(colors.data(), colors.size());
+				break;
+			case Isa::avx512:
+				done = premultiply_avx512(colors.data(), colors.size());
+				break;
+				}
+		#endif
+
+	// Premultiply remaining colors which do not fill a vector.
+	premultiply_scalar(colors.data(), done, colors.size());
+	}
+
+
+auto count_active(std::span<Color const> const fragments) noexcept -> std::size_t {
+	return count_active(fragments.data(), 1, fragments.size());
+	}
+
+auto count_active(Color const* const fragments, std::size_t const stride, std::size_t const count)
+		noexcept -> std::size_t {
+	return find(supported(), fragments, stride, count, false);
+	}
+
+auto inactive_run(std::span<Color const> const colors, IceTSizeType const num_layers) noexcept
+		-> std::size_t {
+	return inactive_run(supported(), colors, num_layers);
+	}
+
+auto inactive_run(
+		Isa const                    isa,
+		std::span<Color const> const colors,
+		IceTSizeType const           num_layers
+		) noexcept -> std::size_t {
+	auto const layers {static_cast<std::size_t>(num_layers)};
+
+	assert(layers > 0 and colors.size() % layers == 0);
+	return find(isa, colors.data(), layers, colors.size() / layers, true);
+	}
+
+auto active_run(std::span<Color const> const colors, IceTSizeType const num_layers) noexcept
+		-> std::size_t {
+	auto const layers {static_cast<std::size_t>(num_layers)};
+
+	assert(layers > 0 and colors.size() % layers == 0);
+	return find(supported(), colors.data(), layers, colors.size() / layers, false);
+	}
+
+} // namespace simd
+
+} // namespace layered_icet
+
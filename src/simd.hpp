@@ -0,0 +1,129 @@
+#pragma once
+
+#include <span>
+#include <string_view>
+
+#include "common.hpp"
+#include "layout.hpp"
+
+
+namespace layered_icet {
+
+/// Vectorized image processing kernels, dispatched at runtime to the best supported instruction
+/// set.
+namespace simd {
+
+/// Instruction set extensions kernels may be implemented with, from least to most capable.
+enum class Isa {
+	scalar,
+	sse4_1,
+	avx2,
+	avx512,
+	};
+
+/// Return the most capable instruction set supported by the executing CPU.
+[[nodiscard]] auto detect() noexcept -> Isa;
+
+/// Return the name of an instruction set.
+[[nodiscard]] auto name(Isa isa) noexcept -> std::string_view;
+
+
+/// Blend the fragments of each pixel, back to front, onto a black background using the
+/// over-operator.
+/// `in` holds `num_layers` fragments for each of the pixels in `out`.
+/// Each channel is blended as `out * (max - alpha) / max + in`, truncated to a channel, so results
+/// are identical regardless of the instruction set used.
+/// Active fragments must come first and inactive ones must be zero, so runs of pixels whose first
+/// fragment is inactive can be skipped.
+auto blend_over(std::span<Color const> in, IceTSizeType num_layers, std::span<Color> out) noexcept
+		-> void;
+
+/// Like `blend_over`, but use the given instruction set, which must be supported.
+auto blend_over(Isa isa, std::span<Color const> in, IceTSizeType num_layers, std::span<Color> out)
+		noexcept -> void;
+
+/// Blend the fragments of an image in any layout like `blend_over`, where the color of layer `l`
+/// of pixel `p` is `in[p * pixel_stride + l * layer_stride]`.
+auto blend_over(
+		Color const*     in,
+		IceTSizeType     num_layers,
+		std::size_t      layer_stride,
+		std::size_t      pixel_stride,
+		std::span<Color> out
+		) noexcept -> void;
+
+/// Like the strided `blend_over`, but use the given instruction set, which must be supported.
+auto blend_over(
+		Isa              isa,
+		Color const*     in,
+		IceTSizeType     num_layers,
+		std::size_t      layer_stride,
+		std::size_t      pixel_stride,
+		std::span<Color> out
+		) noexcept -> void;
+
+/// Blend an image in the layout of its buffer like `blend_over`.
+template<Layout TLayout>
+auto blend_over(LayeredBuffer<TLayout> const& in, std::span<Color> const out) noexcept -> void {
+	assert(out.size() == std::size_t(in.num_pixels()));
+	blend_over(in.colors(), in.num_layers(), TLayout::layer_stride, in.pixel_stride(), out);
+	}
+
+/// Like the layered buffer `blend_over`, but use the given instruction set, which must be
+/// supported.
+template<Layout TLayout>
+auto blend_over(Isa const isa, LayeredBuffer<TLayout> const& in, std::span<Color> const out)
+		noexcept -> void {
+	assert(out.size() == std::size_t(in.num_pixels()));
+	blend_over(isa, in.colors(), in.num_layers(), TLayout::layer_stride, in.pixel_stride(), out);
+	}
+
+/// Blend packed fragment lists like `blend_over`, where the fragments of pixel `i` of `out` are
+/// those at indices `offsets[i]` up to `offsets[i + 1]` of `in`.
+auto blend_over(
+		std::span<std::size_t const> offsets,
+		std::span<Color const>       in,
+		std::span<Color>             out
+		) noexcept -> void;
+
+/// Like the packed `blend_over`, but use the given instruction set, which must be supported.
+auto blend_over(
+		Isa                          isa,
+		std::span<std::size_t const> offsets,
+		std::span<Color const>       in,
+		std::span<Color>             out
+		) noexcept -> void;
+
+
+/// Scale the color channels of each color by its alpha channel, as `color * alpha / max`.
+auto premultiply(std::span<Color> colors) noexcept -> void;
+
+/// Like `premultiply`, but use the given instruction set, which must be supported.
+auto premultiply(Isa isa, std::span<Color> colors) noexcept -> void;
+
+
+/// Return the number of active fragments at the front of a fragment list.
+[[nodiscard]] auto count_active(std::span<Color const> fragments) noexcept -> std::size_t;
+
+/// Like `count_active`, but for a list of `count` fragments `stride` colors apart.
+[[nodiscard]] auto count_active(Color const* fragments, std::size_t stride, std::size_t count)
+		noexcept -> std::size_t;
+
+/// Return the number of inactive pixels at the front of `colors`, which holds `num_layers`
+/// fragments per pixel.
+/// Since active fragments come first, only the first fragment of each pixel is examined.
+[[nodiscard]] auto inactive_run(std::span<Color const> colors, IceTSizeType num_layers) noexcept
+		-> std::size_t;
+
+/// Like `inactive_run`, but use the given instruction set, which must be supported.
+[[nodiscard]] auto inactive_run(Isa isa, std::span<Color const> colors, IceTSizeType num_layers)
+		noexcept -> std::size_t;
+
+/// Return the number of active pixels at the front of `colors`, which holds `num_layers`
+/// fragments per pixel.
+[[nodiscard]] auto active_run(std::span<Color const> colors, IceTSizeType num_layers) noexcept
+		-> std::size_t;
+
+} // namespace simd
+
+} // namespace layered_icet
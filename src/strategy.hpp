@@ -0,0 +1,73 @@
+#pragma once
+
+#include <cstring>
+#include <string_view>
+
+#include "common.hpp"
+
+#include <strategy-hash.hpp>
+#include <single-image-strategy-hash.hpp>
+
+
+namespace layered_icet {
+
+/// A compositing strategy together with the single image compositing strategy it uses.
+struct Strategy {
+	/// Name as given on the command line.
+	std::string_view name                  {};
+	IceTEnum         strategy              {ICET_STRATEGY_SEQUENTIAL};
+	IceTEnum         single_image_strategy {ICET_SINGLE_IMAGE_STRATEGY_AUTOMATIC};
+
+	/// Make this the strategy of the current IceT context.
+	auto apply() const -> void {
+		icetStrategy(strategy);
+		icetSingleImageStrategy(single_image_strategy);
+		}
+
+	};
+
+/// Parse a strategy of the form `<strategy>[/<single-image-strategy>]`, where the single image
+/// strategy is required if and only if the strategy uses one.
+/// Since the generated lookup tables are not inline, this header may only be included by a single
+/// translation unit of each program.
+[[nodiscard]] inline auto parse_strategy(std::string_view const name) -> Strategy {
+	Strategy result {name};
+
+	// Parse strategy.
+	auto const             separator     {name.find('/')};
+	std::string_view const strategy_name {name.substr(0, separator)};
+	auto const             strategy      {
+			StrategyLut::find(strategy_name.data(), strategy_name.size())};
+
+	if (not strategy) {
+		throw std::runtime_error{concat("Unknown compositing strategy `", strategy_name, "`.")};
+		}
+
+	result.strategy = strategy->key;
+
+	// Parse single image strategy if used.
+	if (strategy->uses_single_image_strategy) {
+		if (separator == std::string_view::npos) {
+			throw std::runtime_error{concat(
+					"The compositing strategy `", strategy_name, "` requires a single image "
+					"compositing strategy to be specified."
+					)};
+			}
+
+		std::string_view const si_strategy_name {name.substr(separator + 1)};
+		auto const             si_strategy      {
+				SingleImageStrategyLut::find(si_strategy_name.data(), si_strategy_name.size())};
+
+		if (not si_strategy) {
+			throw std::runtime_error{concat(
+					"Unknown single image compositing strategy `", si_strategy_name, "`."
+					)};
+			}
+
+		result.single_image_strategy = si_strategy->key;
+		}
+
+	return result;
+	}
+
+} // namespace layered_icet
@@ -0,0 +1,198 @@
+#include "synthetic.hpp"
+
+#include <cmath>
+#include <random>
+
+
+namespace layered_icet {
+
+namespace synthetic {
+
+namespace {
+
+/// Side length of the square tiles of pixels which are covered or not as a whole.
+constexpr IceTSizeType tile_size {16};
+
+/// Number of rows generated as a block by one thread.
+constexpr std::size_t block_rows {16};
+
+/// Mix bits of a value, so that similar inputs yield unrelated outputs.
+constexpr auto mix(std::uint64_t value) noexcept -> std::uint64_t {
+	value += 0x9E3779B97F4A7C15;
+	value  = (value ^ (value >> 30)) * 0xBF58476D1CE4E5B9;
+	value  = (value ^ (value >> 27)) * 0x94D049BB133111EB;
+	return value ^ (value >> 31);
+	}
+
+/// Combine values into a single seed.
+template<std::integral... TValues>
+constexpr auto hash(std::uint64_t const seed, TValues const... values) noexcept -> std::uint64_t {
+	auto result {mix(seed)};
+	((result = mix(result ^ static_cast<std::uint64_t>(values))), ...);
+	return result;
+	}
+
+/// Map a hash to a uniformly distributed value in `[0, 1)`.
+constexpr auto unit(std::uint64_t const hash) noexcept -> double {
+	return static_cast<double>(hash >> 11) * 0x1p-53;
+	}
+
+/// Parse a fraction in `[0, 1]`, or throw.
+auto parse_fraction(std::string_view const option, char const* const value) -> double {
+	auto const fraction {atof(value)};
+
+	if (not (fraction >= 0 and fraction <= 1)) {
+		throw std::runtime_error{concat("The value of ", option, " must be in [0, 1].")};
+		}
+
+	return fraction;
+	}
+
+} // namespace
+
+
+auto parse_distribution(std::string_view const name) -> Distribution {
+	if (name == "constant") {
+		return Distribution::constant;
+		}
+	if (name == "uniform") {
+		return Distribution::uniform;
+		}
+	if (name == "geometric") {
+		return Distribution::geometric;
+		}
+
+	throw std::runtime_error{concat(
+			"Unknown fragment count distribution `", name,
+			"`. Must be either 'constant', 'uniform', or 'geometric'."
+			)};
+	}
+
+auto parse_option(Params& params, std::string_view const option, char const* const value) -> bool {
+	if (option == "--fragments") {
+		params.mean_fragments = std::max(1.0, atof(value));
+		}
+	else if (option == "--distribution") {
+		params.distribution = parse_distribution(value);
+		}
+	else if (option == "--coverage") {
+		params.coverage = parse_fraction(option, value);
+		}
+	else if (option == "--overlap") {
+		params.overlap = parse_fraction(option, value);
+		}
+	else if (option == "--seed") {
+		params.seed = std::strtoull(value, nullptr, 10);
+		}
+	else {
+		return false;
+		}
+
+	return true;
+	}
+
+auto generate(
+		Params const&  params,
+		int const      rank,
+		int const      num_ranks,
+		unsigned const frame,
+		unsigned const num_threads
+		) -> RawImage {
+	if (params.width < 0 or params.height < 0 or params.max_layers < 1) {
+		throw std::runtime_error{"Invalid size of synthetic frame"};
+		}
+
+	auto const layers        {static_cast<std::size_t>(params.max_layers)};
+	auto const row_size      {std::size_t(params.width) * layers};
+	auto const num_fragments {row_size * std::size_t(params.height)};
+
+	// Each rank's fragments lie within a slab of depth, whose width grows with the overlap from an
+	// equal share of the depth range to all of it.
+	auto const slab_width {params.overlap + (1 - params.overlap) / std::max(num_ranks, 1)};
+	auto const slab_start {num_ranks > 1 ? rank * (1 - slab_width) / (num_ranks - 1) : 0.0};
+
+	// Each rank is drawn in its own hue.
+	auto const hue {unit(hash(params.seed, rank)) * 6};
+
+	auto channel = [&](double const offset) {
+		return std::clamp(std::abs(std::fmod(hue + offset, 6.0) - 3) - 1, 0.0, 1.0);
+		};
+
+	std::array const rank_color {channel(0), channel(4), channel(2)};
+
+	// Generate rows in parallel, each of which is seeded independently, so the result does not
+	// depend on how rows are distributed across threads.
+	std::vector<std::byte> buffer (num_fragments * (sizeof(Color) + sizeof(Depth)));
+
+	auto const colors {std::span{reinterpret_cast<Color*>(buffer.data()), num_fragments}};
+	auto const depths {std::span{
+			reinterpret_cast<Depth*>(buffer.data() + num_fragments * sizeof(Color)),
+			num_fragments
+			}};
+
+	parallel_for(std::size_t(params.height), block_rows, num_threads, [&](
+			std::size_t const row_begin,
+			std::size_t const row_end,
+			unsigned
+			) {
+		auto const max_uniform {std::lround(2 * params.mean_fragments - 1)};
+
+		std::uniform_int_distribution<long>      uniform   {1, std::max(1l, max_uniform)};
+		std::geometric_distribution<long>        geometric {1 / params.mean_fragments};
+		std::uniform_int_distribution<int>       alpha     {1, color::channel_max};
+		std::uniform_real_distribution<double>   offset    {0, slab_width};
+
+		for (auto row {row_begin}; row < row_end; ++row) {
+			std::mt19937_64 rng {hash(params.seed, rank, frame, row)};
+
+			for (IceTSizeType x {0}; x < params.width; ++x) {
+				auto const tile {hash(params.seed, rank, frame, row / tile_size, x / tile_size)};
+
+				if (unit(tile) >= params.coverage) {
+					continue;
+					}
+
+				// Draw the number of active fragments of this pixel.
+				long num_active {1};
+
+				switch (params.distribution) {
+					case Distribution::constant:
+						num_active = std::lround(params.mean_fragments);
+						break;
+					case Distribution::uniform:
+						num_active = uniform(rng);
+						break;
+					case Distribution::geometric:
+						num_active = 1 + geometric(rng);
+						break;
+					}
+
+				auto const count {static_cast<std::size_t>(
+						std::clamp<long>(num_active, 1, params.max_layers)
+						)};
+
+				// Draw the fragments.
+				auto const pixel_color {colors.subspan(row * row_size + x * layers, count)};
+				auto const pixel_depth {depths.subspan(row * row_size + x * layers, count)};
+
+				for (std::size_t frag {0}; frag < count; ++frag) {
+					auto const a {static_cast<color::Channel>(alpha(rng))};
+
+					pixel_color[frag] = {
+							static_cast<color::Channel>(rank_color[0] * a),
+							static_cast<color::Channel>(rank_color[1] * a),
+							static_cast<color::Channel>(rank_color[2] * a),
+							a,
+							};
+					pixel_depth[frag] = static_cast<Depth>(slab_start + offset(rng));
+					}
+
+				std::sort(pixel_depth.begin(), pixel_depth.end());
+				}}});
+
+	return {params.width, params.height, params.max_layers, std::move(buffer)};
+	}
+
+} // namespace synthetic
+
+} // namespace layered_icet
@@ -0,0 +1,73 @@
+#pragma once
+
+#include <cstdint>
+#include <string_view>
+
+#include "common.hpp"
+
+
+namespace layered_icet {
+
+/// Procedural layered frames, which stand in for rendered captures when benchmarking at
+/// resolutions, process counts and layer counts for which none exist.
+/// Frames are determined entirely by their parameters, the rank they are generated for and their
+/// frame number, regardless of the number of threads used.
+namespace synthetic {
+
+/// Distribution of the number of active fragments of covered pixels.
+enum class Distribution : uint8_t {
+	/// Every covered pixel has the mean number of fragments, rounded.
+	constant,
+	/// Counts are uniformly distributed around the mean.
+	uniform,
+	/// Counts follow a geometric distribution, so most pixels have few fragments and some many.
+	geometric,
+	};
+
+/// Parameters of generated frames.
+struct Params {
+	IceTSizeType   width          {0};
+	IceTSizeType   height         {0};
+	IceTLayerCount max_layers     {1};
+	/// Mean number of active fragments per covered pixel, at least 1, which is only reached if
+	/// `max_layers` does not clip the distribution.
+	double         mean_fragments {1};
+	Distribution   distribution   {Distribution::uniform};
+	/// Fraction of tiles of the screen which each rank covers.
+	double         coverage       {1};
+	/// Fraction of the depth range each rank's fragments share with other ranks.
+	/// At 0, ranks occupy disjoint slabs of depth in order of their ranks, at 1, all ranks'
+	/// fragments are interleaved across the whole depth range.
+	double         overlap        {0};
+	std::uint64_t  seed           {0};
+	};
+
+/// Return the distribution with the given name, or throw if there is none.
+[[nodiscard]] auto parse_distribution(std::string_view name) -> Distribution;
+
+/// Parse a command line option `--fragments`, `--distribution`, `--coverage`, `--overlap` or
+/// `--seed` with the given value into `params`.
+/// Returns false if `option` is not one of these options.
+[[nodiscard]] auto parse_option(Params& params, std::string_view option, char const* value)
+		-> bool;
+
+/// Usage of the options accepted by `parse_option`.
+constexpr std::string_view options_usage {
+		"[--fragments <mean #fragments>] [--distribution constant|uniform|geometric] "
+		"[--coverage <fraction>] [--overlap <fraction>] [--seed <seed>]"
+		};
+
+/// Generate frame `frame` of process `rank` of `num_ranks`, with colors premultiplied by alpha and
+/// the active fragments of each pixel sorted by depth.
+/// Rows are generated in parallel on up to `num_threads` threads.
+[[nodiscard]] auto generate(
+		Params const& params,
+		int           rank,
+		int           num_ranks,
+		unsigned      frame       = 0,
+		unsigned      num_threads = 1
+		) -> RawImage;
+
+} // namespace synthetic
+
+} // namespace layered_icet
@@ -0,0 +1,98 @@
+#include "tiles.hpp"
+
+#include <cstdlib>
+#include <vector>
+
+
+namespace layered_icet {
+
+namespace tiles {
+
+auto parse_grid(std::string_view const value) -> Grid {
+	std::string const text {value};
+	char*             columns_end;
+	char*             rows_end {nullptr};
+
+	auto const columns {std::strtol(text.c_str(), &columns_end, 10)};
+	auto const rows    {*columns_end == 'x' ? std::strtol(columns_end + 1, &rows_end, 10) : 0};
+
+	if (columns <= 0 or rows <= 0 or *rows_end != '\0') {
+		throw std::runtime_error{concat(
+				"Invalid tile grid `", value, "`, must be of the form <columns>x<rows>."
+				)};
+		}
+
+	return {static_cast<int>(columns), static_cast<int>(rows)};
+	}
+
+auto add(Grid const& grid, IceTSizeType const width, IceTSizeType const height, int const num_procs)
+		-> void {
+	if (grid.count() > num_procs) {
+		throw std::runtime_error{concat(
+				"Cannot display ", grid.count(), " tiles with ", num_procs, " processes."
+				)};
+		}
+
+	if (grid.columns > width or grid.rows > height) {
+		throw std::runtime_error{concat(
+				"Cannot divide ", width, "x", height, " pixels into ", grid.columns, "x",
+				grid.rows, " tiles."
+				)};
+		}
+
+	// Return the start of part `idx` of `num` equal parts of `size` pixels.
+	auto split = [](IceTSizeType const size, int const idx, int const num) {
+		return static_cast<IceTInt>(std::int64_t(size) * idx / num);
+		};
+
+	icetResetTiles();
+
+	for (int row {0}; row < grid.rows; ++row) {
+		for (int column {0}; column < grid.columns; ++column) {
+			auto const index {row * grid.columns + column};
+			auto const x     {split(width, column, grid.columns)};
+			auto const y     {split(height, row, grid.rows)};
+
+			icetAddTile(
+					x,
+					y,
+					split(width, column + 1, grid.columns) - x,
+					split(height, row + 1, grid.rows) - y,
+					index * num_procs / grid.count()
+					);
+			}}}
+
+auto displayed() -> std::optional<Tile> {
+	IceTInt index;
+	icetGetIntegerv(ICET_TILE_DISPLAYED, &index);
+
+	if (index < 0) {
+		return std::nullopt;
+		}
+
+	IceTInt count;
+	icetGetIntegerv(ICET_NUM_TILES, &count);
+
+	std::vector<IceTInt> viewports (std::size_t(count) * 4);
+	icetGetIntegerv(ICET_TILE_VIEWPORTS, viewports.data());
+
+	std::array<IceTInt, 4> global;
+	icetGetIntegerv(ICET_GLOBAL_VIEWPORT, global.data());
+
+	// Place tiles relative to the image, which need not start at the origin.
+	auto const viewport {std::span{viewports}.subspan(std::size_t(index) * 4, 4)};
+
+	Tile tile;
+	tile.index        = index;
+	tile.count        = count;
+	tile.region       = {
+			viewport[0] - global[0], viewport[1] - global[1], viewport[2], viewport[3]
+			};
+	tile.image_width  = global[2];
+	tile.image_height = global[3];
+	return tile;
+	}
+
+} // namespace tiles
+
+} // namespace layered_icet
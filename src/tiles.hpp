@@ -0,0 +1,45 @@
+#pragma once
+
+#include <optional>
+#include <string_view>
+
+#include "common.hpp"
+#include "output.hpp"
+
+
+namespace layered_icet {
+
+/// Division of composited images into tiles, each collected by a different display process, so no
+/// single process gathers and writes the whole image.
+namespace tiles {
+
+/// A grid of equally sized tiles covering an image.
+struct Grid {
+	int columns {1};
+	int rows    {1};
+
+	[[nodiscard]] constexpr auto count() const noexcept -> int {
+		return columns * rows;
+		}
+
+	};
+
+/// A tile displayed by this process.
+using Tile = output::Tile;
+
+/// Return the grid described by `<columns>x<rows>`, or throw if it is invalid.
+[[nodiscard]] auto parse_grid(std::string_view value) -> Grid;
+
+/// Replace the tiles of the current IceT context by `grid` over an image of `width` by `height`
+/// pixels, where tiles are numbered row by row and displayed by processes spread evenly across all
+/// `num_procs`, starting with 0.
+/// Throws if there are more tiles than processes or pixels, since each process displays at most
+/// one tile.
+auto add(Grid const& grid, IceTSizeType width, IceTSizeType height, int num_procs) -> void;
+
+/// Return the tile this process displays in the current IceT context, if any.
+[[nodiscard]] auto displayed() -> std::optional<Tile>;
+
+} // namespace tiles
+
+} // namespace layered_icet